@@ -0,0 +1,149 @@
+#include "AllocationCounter.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace smp::debug
+{
+
+#ifndef NDEBUG
+// plain counters, so touching them from operator new never allocates
+static thread_local AllocationStats t_Allocations;
+#endif
+
+auto GetThreadAllocations() -> AllocationStats
+{
+#ifndef NDEBUG
+    return t_Allocations;
+#else
+    return {};
+#endif
+}
+
+FrameAllocationReport::FrameAllocationReport(uint64_t reportInterval)
+    : m_ReportInterval{ reportInterval }
+{
+}
+void FrameAllocationReport::BeginFrame()
+{
+    m_FrameStart = GetThreadAllocations();
+}
+void FrameAllocationReport::EndFrame()
+{
+    if constexpr (!AllocationCountingEnabled)
+    {
+        return;
+    }
+
+    auto frameEnd{ GetThreadAllocations() };
+    auto allocations{ frameEnd.Count - m_FrameStart.Count };
+    m_FrameAllocations.Record(allocations);
+    m_Bytes += frameEnd.Bytes - m_FrameStart.Bytes;
+    if (allocations != 0)
+    {
+        m_AllocatingFrames++;
+    }
+
+    if (m_FrameAllocations.GetCount() < m_ReportInterval)
+    {
+        return;
+    }
+    if (m_AllocatingFrames != 0)
+    {
+        std::cout << "Frame allocations: " << m_AllocatingFrames << " of "
+                  << m_FrameAllocations.GetCount()
+                  << " frames allocated, p99 "
+                  << m_FrameAllocations.GetPercentile(99) << ", max "
+                  << m_FrameAllocations.GetMax() << ", " << m_Bytes
+                  << " bytes total\n";
+    }
+    m_FrameAllocations.Reset();
+    m_AllocatingFrames = 0;
+    m_Bytes = 0;
+}
+
+} // namespace smp::debug
+
+#ifndef NDEBUG
+
+static auto CountedAlloc(std::size_t size, std::size_t alignment) -> void*
+{
+    auto& allocations{ smp::debug::t_Allocations };
+    allocations.Count++;
+    allocations.Bytes += size;
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+    void* ptr{ nullptr };
+    if (alignment <= alignof(std::max_align_t))
+    {
+        ptr = std::malloc(size);
+    }
+    else
+    {
+        // aligned_alloc wants the size to be a multiple of alignment
+        ptr = std::aligned_alloc(alignment,
+                                 (size + alignment - 1) / alignment *
+                                     alignment);
+    }
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+auto operator new(std::size_t size) -> void*
+{
+    return CountedAlloc(size, alignof(std::max_align_t));
+}
+auto operator new[](std::size_t size) -> void*
+{
+    return CountedAlloc(size, alignof(std::max_align_t));
+}
+auto operator new(std::size_t size, std::align_val_t alignment) -> void*
+{
+    return CountedAlloc(size, static_cast<std::size_t>(alignment));
+}
+auto operator new[](std::size_t size, std::align_val_t alignment) -> void*
+{
+    return CountedAlloc(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::align_val_t /*alignment*/) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t /*alignment*/) noexcept
+{
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t /*size*/,
+                     std::align_val_t /*alignment*/) noexcept
+{
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t /*size*/,
+                       std::align_val_t /*alignment*/) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+#include "Histogram.hpp"
+#include <cstdint>
+
+namespace smp::debug
+{
+
+// Global operator new is replaced in debug builds to count heap allocations
+// per thread. Release builds keep the default allocator and report zeros.
+#ifdef NDEBUG
+inline constexpr bool AllocationCountingEnabled{ false };
+#else
+inline constexpr bool AllocationCountingEnabled{ true };
+#endif
+
+struct AllocationStats
+{
+    uint64_t Count{ 0 };
+    uint64_t Bytes{ 0 };
+};
+
+// allocations made by the calling thread since it started
+auto GetThreadAllocations() -> AllocationStats;
+
+// Counts allocations the calling thread makes between BeginFrame and
+// EndFrame and prints a summary every reportInterval frames, if any frame
+// allocated at all
+class FrameAllocationReport
+{
+public:
+    explicit FrameAllocationReport(uint64_t reportInterval = 600);
+
+    void BeginFrame();
+    void EndFrame();
+
+private:
+    uint64_t m_ReportInterval;
+    AllocationStats m_FrameStart;
+
+    metrics::Histogram m_FrameAllocations;
+    uint64_t m_AllocatingFrames{ 0 };
+    uint64_t m_Bytes{ 0 };
+};
+
+} // namespace smp::debug
@@ -0,0 +1,113 @@
+#include "Benchmark.hpp"
+#include "AllocationCounter.hpp"
+#include "Histogram.hpp"
+#include "SessionOptions.hpp"
+#include "Systems.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <raymath.h>
+
+namespace smp::game
+{
+
+void RunBenchmark(uint32_t bulletCount, uint32_t frameCount)
+{
+    static constexpr uint32_t s_PlayerCount{ 16 };
+    static constexpr float s_FrameTime{ 1.F / 60.F };
+
+    SessionOptions options;
+    Registry registry;
+    std::mt19937 random{ 42 };
+    std::uniform_real_distribution<float> xDist{ 0, options.WorldWidth };
+    std::uniform_real_distribution<float> yDist{ 0, options.WorldHeight };
+    std::uniform_real_distribution<float> dirDist{ -1, 1 };
+
+    auto addWall{ [&](Vector2 start, Vector2 end)
+                  {
+                      registry.emplace<LineCollider>(registry.create(), start,
+                                                     end);
+                  } };
+    addWall({ 0, 0 }, { options.WorldWidth, 0 });
+    addWall({ options.WorldWidth, 0 },
+            { options.WorldWidth, options.WorldHeight });
+    addWall({ options.WorldWidth, options.WorldHeight },
+            { 0, options.WorldHeight });
+    addWall({ 0, options.WorldHeight }, { 0, 0 });
+
+    for (uint32_t i{ 0 }; i < s_PlayerCount; i++)
+    {
+        auto player{ registry.create() };
+        registry.emplace<CircleCollider>(
+            player, Vector2{ xDist(random), yDist(random) },
+            options.PlayerRadius);
+        registry.emplace<PlayerTag>(player);
+    }
+    for (uint32_t i{ 0 }; i < bulletCount; i++)
+    {
+        auto bullet{ registry.create() };
+        auto& collider{ registry.emplace<CircleCollider>(
+            bullet, Vector2{ xDist(random), yDist(random) },
+            options.BulletRadius) };
+        collider.SetVelocity(Vector2Scale(
+            Vector2Normalize({ dirDist(random), dirDist(random) }),
+            options.BulletSpeed));
+        registry.emplace<BulletTag>(bullet, IdType{ 0 });
+    }
+
+    DrawCommands commands;
+    metrics::Histogram frameTimes;
+    uint64_t frameAllocations{ 0 };
+    for (uint32_t frame{ 0 }; frame < frameCount; frame++)
+    {
+        auto allocationsBefore{ debug::GetThreadAllocations().Count };
+        auto frameStart{ std::chrono::steady_clock::now() };
+
+        // stands in for coords messages, one position update per bullet
+        auto bulletsView{ registry.view<BulletTag, CircleCollider>() };
+        for (auto&& [entity, tag, collider] : bulletsView.each())
+        {
+            auto next{ collider.GetNextPosition(s_FrameTime) };
+            next.x = std::fmod(next.x + options.WorldWidth, options.WorldWidth);
+            next.y =
+                std::fmod(next.y + options.WorldHeight, options.WorldHeight);
+            collider.SetPosition(next);
+        }
+        systems::UpdateControllers(registry);
+        systems::BuildDrawCommands(registry, commands);
+
+        frameTimes.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - frameStart)
+                .count()));
+        // first frame grows the command buffers, that one doesn't count
+        if (frame != 0)
+        {
+            frameAllocations +=
+                debug::GetThreadAllocations().Count - allocationsBefore;
+        }
+    }
+
+    auto toMicroseconds{ [](double nanoseconds) { return nanoseconds / 1e3; } };
+    std::cout << "Benchmark: " << bulletCount << " bullets, " << frameCount
+              << " frames, draw commands: " << commands.Bullets.size()
+              << " bullets\n"
+              << "  frame cpu us: mean "
+              << toMicroseconds(frameTimes.GetMean()) << ", p50 "
+              << toMicroseconds(
+                     static_cast<double>(frameTimes.GetPercentile(50)))
+              << ", p99 "
+              << toMicroseconds(
+                     static_cast<double>(frameTimes.GetPercentile(99)))
+              << ", max "
+              << toMicroseconds(static_cast<double>(frameTimes.GetMax()))
+              << '\n';
+    if constexpr (debug::AllocationCountingEnabled)
+    {
+        std::cout << "  steady frame allocations: " << frameAllocations
+                  << '\n';
+    }
+}
+
+} // namespace smp::game
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+namespace smp::game
+{
+
+// Runs the per-frame client systems without a window or a server: a fight
+// with the given number of bullets, every bullet moved each frame as if its
+// coords message arrived. Prints frame CPU time percentiles.
+void RunBenchmark(uint32_t bulletCount, uint32_t frameCount);
+
+} // namespace smp::game
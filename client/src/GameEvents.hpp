@@ -1,22 +1,19 @@
 #pragma once
+#include "Typedefs.hpp"
 #include <raylib.h>
 
 namespace smp::game
 {
 
-class Player;
-class Bullet;
-class GameObject;
-
 struct ShootEvent
 {
-    Player* Shooter;
+    IdType Shooter;
     Vector2 Target;
 };
 
 struct KillEvent
 {
-    Bullet* Projectile;
-    GameObject* Victim;
+    IdType Projectile;
+    IdType Victim;
 };
 } // namespace smp::game
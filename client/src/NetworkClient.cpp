@@ -1,6 +1,8 @@
 #include "NetworkClient.hpp"
 #include "ServerBase.hpp"
 #include "Typedefs.hpp"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <raylib.h>
 #include <raymath.h>
@@ -34,6 +36,11 @@ void NetworkClient::Run()
                 PollConnectionStateChanges();
 
                 auto now{ std::chrono::steady_clock::now() };
+                if (now - m_LastTimeSync >= s_TimeSyncInterval)
+                {
+                    m_LastTimeSync = now;
+                    SendTimeSync();
+                }
 
                 std::chrono::duration<float, std::micro> sleepTime{
                     std::chrono::microseconds{
@@ -68,6 +75,19 @@ auto NetworkClient::ConnectToGameServer() -> std::future<json>
         throw std::runtime_error{ "Failed to connect to server" };
     }
 
+    // queued until the connection is up, room spawns us once it arrives
+    m_JoinPayload = { { "compression", CompressionOffer() } };
+    if (!m_ReservationToken.empty())
+    {
+        m_JoinPayload["token"] = m_ReservationToken;
+    }
+    if (m_Spectator)
+    {
+        m_JoinPayload["spectator"] = true;
+    }
+    json joinMessage = { { "type", "join" }, { "payload", m_JoinPayload } };
+    SendMessage("join", joinMessage.dump());
+
     auto playerIdFuture{ std::async(
         std::launch::async,
         [this]()
@@ -84,11 +104,27 @@ auto NetworkClient::ConnectToGameServer() -> std::future<json>
                     auto type{
                         messageOpt.value()["type"].template get<std::string>()
                     };
+                    if (type == "redirect")
+                    {
+                        // room moved before we got in
+                        Redirect(messageOpt.value()["payload"]);
+                        continue;
+                    }
                     if (type != "greeting")
                     {
                         continue;
                     }
 
+                    m_Greeted = true;
+                    const auto& payload{ messageOpt.value()["payload"] };
+                    if (payload.contains("player_id"))
+                    {
+                        std::lock_guard<std::mutex> mtxLock{ m_StatsMutex };
+                        m_PlayerId =
+                            payload["player_id"].template get<IdType>();
+                    }
+                    m_ResumeToken =
+                        payload.value("resume_token", std::string{});
                     return messageOpt.value();
                 }
             }
@@ -128,17 +164,68 @@ void NetworkClient::FindFreeRoom(const std::string& entryPointIp)
         auto host{ messageOpt.value()["ip"].template get<std::string>() };
         auto port{ messageOpt.value()["port"].template get<int32_t>() };
         m_GameServerAddr = host + ":" + std::to_string(port);
+        m_ReservationToken =
+            messageOpt.value().value("token", std::string{});
         m_Interface->CloseConnection(connection, 0, nullptr, false);
         return;
     }
 }
 
+void NetworkClient::Spectate(const std::string& address)
+{
+    m_GameServerAddr = address;
+    m_Spectator = true;
+}
+
+auto NetworkClient::FetchSession(const std::string& hash) -> json
+{
+    json request = { { "type", "session_request" },
+                     { "payload", { { "hash", hash } } } };
+    SendMessage("session_request", request.dump());
+
+    while (m_Alive)
+    {
+        auto messageOpt{ RecieveMessage(m_Connection) };
+        if (!messageOpt.has_value())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+            continue;
+        }
+
+        if (messageOpt.value()["type"].template get<std::string>() !=
+            "session")
+        {
+            m_Backlog.push_back(std::move(messageOpt.value()));
+            continue;
+        }
+        return std::move(messageOpt.value()["payload"]);
+    }
+    throw std::runtime_error{ "Connection lost while loading session" };
+}
+void NetworkClient::SetDictionary(std::span<const std::byte> dictionary)
+{
+    m_Decompressor.SetDictionary(dictionary);
+    json offer = { { "type", "compression" },
+                   { "payload", CompressionOffer() } };
+    SendMessage("compression", offer.dump());
+}
+auto NetworkClient::CompressionOffer() const -> json
+{
+    json offer = { { "codecs", { compression::Codec } } };
+    if (m_Decompressor.GetDictionaryId() != 0)
+    {
+        offer["dict_id"] = m_Decompressor.GetDictionaryId();
+    }
+    return offer;
+}
+
 void NetworkClient::SendMovement(IdType playerId, Vector2 nextPlayerCoords)
 {
     // not quite thread safe, but we are in one thread for now
     static Vector2 lastPos{ nextPlayerCoords };
 
-    if (Vector2Equals(lastPos, nextPlayerCoords) != 0)
+    if (Vector2Equals(lastPos, nextPlayerCoords) != 0 &&
+        !m_ResendMovement.exchange(false))
     {
         return;
     }
@@ -152,8 +239,18 @@ void NetworkClient::SendMovement(IdType playerId, Vector2 nextPlayerCoords)
                         { "x", nextPlayerCoords.x },
                         { "y", nextPlayerCoords.y },
                     } } };
+    if (m_TraceSampler.Sample())
+    {
+        // untraced until the first time sync is back
+        auto offset{ m_ClockOffset.Get() };
+        if (offset.has_value())
+        {
+            data["payload"]["trace"] = { { "c_send",
+                                           trace::Now() + *offset } };
+        }
+    }
 
-    SendMessage(data.dump());
+    SendMessage("coords", data.dump());
 }
 void NetworkClient::SendShoot(IdType shooterId, Vector2 target)
 {
@@ -165,13 +262,177 @@ void NetworkClient::SendShoot(IdType shooterId, Vector2 target)
                         { "target_y", target.y },
                     } } };
 
-    SendMessage(data.dump());
+    SendMessage("shoot", data.dump());
+}
+void NetworkClient::SetTraceSampleRate(double rate)
+{
+    m_TraceSampler.SetRate(rate);
+}
+auto NetworkClient::GetClockOffset() const -> std::optional<int64_t>
+{
+    return m_ClockOffset.Get();
+}
+auto NetworkClient::GetLinkStats() const -> std::optional<LinkStats>
+{
+    SteamNetConnectionRealTimeStatus_t status{};
+    if (m_Interface->GetConnectionRealTimeStatus(m_Connection, &status, 0,
+                                                 nullptr) != k_EResultOK)
+    {
+        return std::nullopt;
+    }
+    return LinkStats{ .PingMs = status.m_nPing,
+                      .Loss = 1.0F - status.m_flConnectionQualityLocal,
+                      .InBytesPerSecond = status.m_flInBytesPerSec,
+                      .OutBytesPerSecond = status.m_flOutBytesPerSec };
 }
-void NetworkClient::SendMessage(const std::string& message)
+void NetworkClient::GetTraffic(TrafficByType& in, TrafficByType& out) const
+{
+    std::lock_guard<std::mutex> mtxLock{ m_StatsMutex };
+    in = m_InTraffic;
+    out = m_OutTraffic;
+}
+void NetworkClient::TakeUpdateGaps(metrics::Histogram& gaps)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_StatsMutex };
+    gaps.Merge(m_UpdateGaps);
+    m_UpdateGaps.Reset();
+}
+void NetworkClient::CountTraffic(TrafficByType& traffic,
+                                 std::string_view type, std::size_t bytes,
+                                 std::size_t wireBytes,
+                                 uint64_t decodeNanoseconds)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_StatsMutex };
+    auto trafficIt{ traffic.find(type) };
+    if (trafficIt == traffic.end())
+    {
+        trafficIt = traffic.emplace(std::string{ type }, Traffic{}).first;
+    }
+    trafficIt->second.Messages++;
+    trafficIt->second.Bytes += bytes;
+    trafficIt->second.WireBytes += wireBytes;
+    trafficIt->second.DecodeNanoseconds += decodeNanoseconds;
+}
+void NetworkClient::Redirect(const json& payload)
+{
+    auto host{ payload["ip"].template get<std::string>() };
+    auto port{ payload["port"].template get<int32_t>() };
+    std::cout << "Room moved to " << host << ':' << port << '\n';
+    Reconnect(host + ":" + std::to_string(port),
+              payload.value("token", std::string{}));
+}
+void NetworkClient::Reconnect(const std::string& address,
+                              const std::string& resumeToken)
+{
+    m_GameServerAddr = address;
+
+    SteamNetworkingConfigValue_t opt{};
+    opt.SetPtr(
+        k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged,
+        reinterpret_cast<void*>(SteamNetConnectionStatusChangedCallback));
+
+    SteamNetworkingIPAddr serverAddr{};
+    serverAddr.Clear();
+    serverAddr.ParseString(m_GameServerAddr.c_str());
+
+    m_PreviousConnection = m_Connection;
+    m_Interface->CloseConnection(m_PreviousConnection,
+                                 k_ESteamNetConnectionEnd_App_Generic,
+                                 "Redirected", false);
+    m_Connection = m_Interface->ConnectByIPAddress(serverAddr, 1, &opt);
+    if (m_Connection == k_HSteamNetConnection_Invalid)
+    {
+        m_Alive = false;
+        json netIssueMessage = { { "type", "network_error" },
+                                 { "payload",
+                                   { { "what", "room moved away" } } } };
+        m_MessageCallback(std::move(netIssueMessage));
+        return;
+    }
+
+    // by now we may have the dictionary
+    m_JoinPayload["compression"] = CompressionOffer();
+    json joinMessage = { { "type", "join" }, { "payload", m_JoinPayload } };
+    if (!resumeToken.empty())
+    {
+        joinMessage["payload"] = { { "resume", resumeToken },
+                                   { "compression", CompressionOffer() } };
+    }
+    SendMessage("join", joinMessage.dump());
+
+    m_AwaitingResume = m_Greeted;
+    m_RedirectedAt = std::chrono::steady_clock::now();
+    // another server, another clock
+    m_ClockOffset.Reset();
+    m_LastTimeSync = {};
+}
+auto NetworkClient::TryResume() -> bool
+{
+    if (!m_Greeted || m_ResumeToken.empty())
+    {
+        return false;
+    }
+    auto now{ std::chrono::steady_clock::now() };
+    if (!m_ResumeDeadline.has_value())
+    {
+        std::cout << "Lost the room, trying to get back in\n";
+        m_ResumeDeadline = now + s_ResumeWindow;
+    }
+    if (now >= *m_ResumeDeadline)
+    {
+        return false;
+    }
+
+    // polling thread, nothing else to do meanwhile anyway
+    std::this_thread::sleep_for(s_ResumeRetryInterval);
+    Reconnect(m_GameServerAddr, m_ResumeToken);
+    return true;
+}
+void NetworkClient::DispatchMessage(json&& message)
+{
+    const auto& type{ message["type"].template get_ref<const std::string&>() };
+    if (type == "redirect")
+    {
+        Redirect(message["payload"]);
+        return;
+    }
+    if (type == "time_sync")
+    {
+        const auto& payload{ message["payload"] };
+        m_ClockOffset.AddSample(payload["c"].template get<int64_t>(),
+                                payload["s"].template get<int64_t>(),
+                                payload["received_at"].template get<int64_t>());
+        return;
+    }
+    if (type == "greeting" && m_AwaitingResume)
+    {
+        // same world with the same ids, the game just goes on
+        m_AwaitingResume = false;
+        m_ResumeDeadline.reset();
+        m_ResendMovement = true;
+        m_ResumeToken = message["payload"].value("resume_token", m_ResumeToken);
+        std::cout << "Back in the room after "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - m_RedirectedAt)
+                         .count()
+                  << "ms\n";
+        return;
+    }
+    m_MessageCallback(std::move(message));
+}
+void NetworkClient::SendMessage(std::string_view type,
+                                const std::string& message)
 {
     m_Interface->SendMessageToConnection(
         m_Connection, message.c_str(), message.size(),
         k_nSteamNetworkingSend_Reliable, nullptr);
+    CountTraffic(m_OutTraffic, type, message.size(), message.size());
+}
+void NetworkClient::SendTimeSync()
+{
+    json request = { { "type", "time_sync" },
+                     { "payload", { { "c", trace::Now() } } } };
+    SendMessage("time_sync", request.dump());
 }
 auto NetworkClient::RecieveMessage(HSteamNetConnection connection)
     -> std::optional<json>
@@ -194,13 +455,68 @@ auto NetworkClient::RecieveMessage(HSteamNetConnection connection)
     std::string messageString{};
     messageString.assign(static_cast<const char*>(incomingMessage->m_pData),
                          incomingMessage->m_cbSize);
+    // it may have waited for us to poll, up to a whole loop
+    auto receivedAt{ trace::Now() -
+                     (SteamNetworkingUtils()->GetLocalTimestamp() -
+                      incomingMessage->m_usecTimeReceived) };
     incomingMessage->Release();
 
-    json messageJson = json::parse(messageString);
+    std::string_view text{ messageString };
+    uint64_t decodeNanoseconds{ 0 };
+    if (compression::IsCompressed(text))
+    {
+        auto decodeStart{ std::chrono::steady_clock::now() };
+        m_Decompressor.Decompress(text, m_Decompressed);
+        decodeNanoseconds = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - decodeStart)
+                .count());
+        text = m_Decompressed;
+    }
+
+    json messageJson = json::parse(text.begin(), text.end());
+    auto& payload{ messageJson["payload"] };
+    const auto& type{
+        messageJson["type"].template get_ref<const std::string&>()
+    };
+    CountTraffic(m_InTraffic, type, text.size(), messageString.size(),
+                 decodeNanoseconds);
+    if (type == "coords")
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_StatsMutex };
+        if (m_PlayerId.has_value() &&
+            payload["id"].template get<IdType>() == *m_PlayerId)
+        {
+            if (m_LastOwnUpdateAt != 0)
+            {
+                m_UpdateGaps.Record(static_cast<uint64_t>(
+                    std::max<int64_t>(receivedAt - m_LastOwnUpdateAt, 0)));
+            }
+            m_LastOwnUpdateAt = receivedAt;
+        }
+    }
+    if (type == "time_sync")
+    {
+        payload["received_at"] = receivedAt;
+    }
+    else if (payload.is_object() && payload.contains("trace"))
+    {
+        auto offset{ m_ClockOffset.Get() };
+        if (offset.has_value())
+        {
+            payload["trace"]["c_recv"] = receivedAt + *offset;
+        }
+    }
     return messageJson;
 }
 void NetworkClient::PollIncomingMessages()
 {
+    for (auto& message : m_Backlog)
+    {
+        DispatchMessage(std::move(message));
+    }
+    m_Backlog.clear();
+
     while (m_Alive /* have pending messages */)
     {
         auto messageOpt{ RecieveMessage(m_Connection) };
@@ -210,17 +526,29 @@ void NetworkClient::PollIncomingMessages()
             break;
         }
 
-        m_MessageCallback(std::move(messageOpt.value()));
+        DispatchMessage(std::move(messageOpt.value()));
     }
 }
 void NetworkClient::OnConnectionStatusChanged(
     SteamNetConnectionStatusChangedCallback_t* info)
 {
+    if (info->m_hConn == m_PreviousConnection)
+    {
+        // we left it for the room's new server
+        return;
+    }
     switch (info->m_info.m_eState)
     {
     case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
     case k_ESteamNetworkingConnectionState_ClosedByPeer:
     {
+        // closed by the room means it is there and does not want us
+        if (info->m_info.m_eState ==
+                k_ESteamNetworkingConnectionState_ProblemDetectedLocally &&
+            TryResume())
+        {
+            break;
+        }
         m_Alive = false;
         json netIssueMessage = { { "type", "network_error" },
                                  { "payload",
@@ -1,16 +1,26 @@
 #pragma once
+#include "Compression.hpp"
+#include "Histogram.hpp"
+#include "LatencyTrace.hpp"
 #include "Typedefs.hpp"
 #include "steam/steamnetworkingtypes.h"
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <raylib.h>
+#include <span>
 #include <steam/isteamnetworkingutils.h>
 #include <steam/steamnetworkingsockets.h>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -20,6 +30,27 @@ namespace smp::network
 class NetworkClient
 {
 public:
+    struct Traffic
+    {
+        uint64_t Messages{ 0 };
+        // decoded json
+        uint64_t Bytes{ 0 };
+        // as it came in, smaller than Bytes if compressed
+        uint64_t WireBytes{ 0 };
+        uint64_t DecodeNanoseconds{ 0 };
+    };
+    // message payloads by their "type", totals since we started
+    using TrafficByType = std::map<std::string, Traffic, std::less<>>;
+
+    // what GNS knows about our connection to the room, wire bytes
+    struct LinkStats
+    {
+        int32_t PingMs{ 0 };
+        float Loss{ 0.0F };
+        float InBytesPerSecond{ 0.0F };
+        float OutBytesPerSecond{ 0.0F };
+    };
+
     NetworkClient();
 
     ~NetworkClient();
@@ -31,12 +62,49 @@ public:
     auto
     ConnectToGameServer() -> std::future<json>;
     void FindFreeRoom(const std::string& entryPointIp);
+    // watch a room (or a relay of it) without playing, instead of
+    // FindFreeRoom
+    void Spectate(const std::string& address);
+    // downloads session blob from the room, blocks until it arrives
+    [[nodiscard]] auto FetchSession(const std::string& hash) -> json;
+    // the room's dictionary from its session, call before Run. The room
+    // sends smaller frames once it hears we have it.
+    void SetDictionary(std::span<const std::byte> dictionary);
 
     void SendMovement(IdType playerId, Vector2 nextPlayerCoords);
     void SendShoot(IdType shooterId, Vector2 target);
 
+    // share of movement inputs sent with a latency trace, 0 for none
+    void SetTraceSampleRate(double rate);
+    // room's clock minus ours, what trace timestamps are converted with
+    [[nodiscard]] auto GetClockOffset() const -> std::optional<int64_t>;
+
+    // nullopt while not connected
+    [[nodiscard]] auto GetLinkStats() const -> std::optional<LinkStats>;
+    // copied out, callers keep their maps to reuse
+    void GetTraffic(TrafficByType& in, TrafficByType& out) const;
+    // gaps between arrivals of our own position since the last call, the
+    // client has no interpolation buffer, this is what one would have to
+    // bridge
+    void TakeUpdateGaps(metrics::Histogram& gaps);
+
 private:
-    void SendMessage(const std::string& message);
+    // type is only for the traffic counters
+    void SendMessage(std::string_view type, const std::string& message);
+    void SendTimeSync();
+    void CountTraffic(TrafficByType& traffic, std::string_view type,
+                      std::size_t bytes, std::size_t wireBytes,
+                      uint64_t decodeNanoseconds = 0);
+    // what we decode, goes with every join
+    [[nodiscard]] auto CompressionOffer() const -> json;
+    // the room moved to another server, reconnect there and join again (as
+    // the same player if the redirect carries a resume token)
+    void Redirect(const json& payload);
+    void Reconnect(const std::string& address, const std::string& resumeToken);
+    // the room went away without a word, maybe it crashed and comes back
+    // from its checkpoint. False once there is no point trying again.
+    auto TryResume() -> bool;
+    void DispatchMessage(json&& message);
     [[nodiscard]] auto
     RecieveMessage(HSteamNetConnection connection) -> std::optional<json>;
     void PollIncomingMessages();
@@ -52,12 +120,56 @@ private:
 
 private:
     std::string m_GameServerAddr;
+    // slot the entry point reserved for us in that room
+    std::string m_ReservationToken;
+    bool m_Spectator{ false };
+    // what we joined with, sent again when redirected without a token
+    json m_JoinPayload;
+    bool m_Greeted{ false };
+    // from our greeting, gets us our player back after a crash
+    std::string m_ResumeToken;
+    std::optional<std::chrono::steady_clock::time_point> m_ResumeDeadline;
+    // the room's greeting after a redirect changes nothing, ids are kept
+    bool m_AwaitingResume{ false };
+    std::chrono::steady_clock::time_point m_RedirectedAt;
+    HSteamNetConnection m_PreviousConnection{ k_HSteamNetConnection_Invalid };
+    // the new server has not seen our movement yet
+    std::atomic<bool> m_ResendMovement{ false };
+
+    // main and polling thread both send, the polling thread receives
+    mutable std::mutex m_StatsMutex;
+    TrafficByType m_InTraffic;
+    TrafficByType m_OutTraffic;
+    metrics::Histogram m_UpdateGaps;
+    int64_t m_LastOwnUpdateAt{ 0 };
+    // from the greeting, spectators have none
+    std::optional<IdType> m_PlayerId;
+
+    // only used by whichever thread receives, never two at once
+    compression::Decompressor m_Decompressor;
+    std::string m_Decompressed;
+
+    trace::ClockOffset m_ClockOffset;
+    std::chrono::steady_clock::time_point m_LastTimeSync;
+    // main thread only, like SendMovement
+    trace::Sampler m_TraceSampler;
+    static constexpr std::chrono::seconds s_TimeSyncInterval{ 1 };
+
+    // a restarted room keeps players for 30s, crashes are noticed after the
+    // 10s connection timeout
+    static constexpr std::chrono::seconds s_ResumeWindow{ 20 };
+    static constexpr std::chrono::milliseconds s_ResumeRetryInterval{ 500 };
 
     std::unique_ptr<std::thread> m_PollingThread{ nullptr };
     ISteamNetworkingSockets* m_Interface{ nullptr };
-    HSteamNetConnection m_Connection{ k_HSteamNetConnection_Invalid };
+    // replaced by the polling thread on redirects
+    std::atomic<HSteamNetConnection> m_Connection{
+        k_HSteamNetConnection_Invalid
+    };
     bool m_Alive{ true };
     std::function<void(json&&)> m_MessageCallback{ [](json&&) {} };
+    // received while waiting for the session, delivered once we run
+    std::vector<json> m_Backlog;
     std::chrono::steady_clock::time_point m_TickStart;
 };
 
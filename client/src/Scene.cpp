@@ -1,26 +1,25 @@
 #include "Scene.hpp"
-#include "Bullet.hpp"
 #include "Components.hpp"
-#include "GameObject.hpp"
-#include "Player.hpp"
+#include "Compression.hpp"
+#include "LatencyTrace.hpp"
+#include "SessionBlob.hpp"
 #include "Typedefs.hpp"
-#include "Wall.hpp"
 #include <cassert>
 #include <iostream>
 #include <memory>
 #include <raylib.h>
+#include <raymath.h>
 #include <string>
 
 namespace smp::game
 {
 
-Scene::Scene(std::unique_ptr<network::NetworkClient> networkClient)
+Scene::Scene(std::unique_ptr<network::NetworkClient> networkClient,
+             const SessionCache& sessionCache)
     : m_NetworkClient{ std::move(networkClient) }
 {
     auto gameStateFuture{ m_NetworkClient->ConnectToGameServer() };
 
-    m_Registry = std::make_shared<Registry>();
-
     m_NetworkClient->SetMessageCallback(
         [this](json&& message)
         {
@@ -32,9 +31,24 @@ Scene::Scene(std::unique_ptr<network::NetworkClient> networkClient)
     std::cout << gameStateJson << std::endl;
     gameStateJson = gameStateJson["payload"];
 
-    Vector2 spawnPos{ gameStateJson["player_x"].template get<float>(),
-                      gameStateJson["player_y"].template get<float>() };
-    AddMainPlayer(gameStateJson["player_id"].template get<IdType>(), spawnPos);
+    auto sessionJson{ LoadSession(
+        gameStateJson["session_hash"].template get<std::string>(),
+        sessionCache) };
+    m_Options = SessionOptions{ sessionJson };
+    if (!m_Options.Dictionary.empty())
+    {
+        m_NetworkClient->SetDictionary(
+            compression::DecodeBase64(m_Options.Dictionary));
+    }
+
+    // spectators get no player of their own
+    if (gameStateJson.contains("player_id"))
+    {
+        Vector2 spawnPos{ gameStateJson["player_x"].template get<float>(),
+                          gameStateJson["player_y"].template get<float>() };
+        AddMainPlayer(gameStateJson["player_id"].template get<IdType>(),
+                      spawnPos);
+    }
     for (const auto& playerJson : gameStateJson["players"])
     {
         auto id{ playerJson["id"].template get<IdType>() };
@@ -42,7 +56,7 @@ Scene::Scene(std::unique_ptr<network::NetworkClient> networkClient)
             playerJson["x"].template get<float>(),
             playerJson["y"].template get<float>(),
         };
-        AddObject<Player>(id, spawnPos);
+        AddPlayer(id, spawnPos);
     }
 
     for (const auto& bulletJson : gameStateJson["bullets"])
@@ -57,65 +71,155 @@ Scene::Scene(std::unique_ptr<network::NetworkClient> networkClient)
             bulletJson["target_x"].template get<float>(),
             bulletJson["target_y"].template get<float>(),
         };
-        AddObject<Bullet>(id, shooterId, initialPos, target);
+        AddBullet(id, shooterId, initialPos, target);
     }
 
-    for (const auto& wallJson : gameStateJson["walls"])
+    for (const auto& wallJson : sessionJson["walls"])
     {
-        AddObject<Wall>(wallJson["id"].template get<IdType>(),
-                        LineCollider{ wallJson });
+        AddWall(wallJson["id"].template get<IdType>(),
+                LineCollider{ wallJson });
     }
 
-    m_Options = SessionOptions{ gameStateJson };
-
     // dot't intercept greeting
     m_NetworkClient->Run();
 }
 
-auto Scene::GetOptions() const -> SessionOptions
+auto Scene::LoadSession(const std::string& hash,
+                        const SessionCache& sessionCache) -> json
+{
+    auto cached{ sessionCache.Load(hash) };
+    if (cached.has_value())
+    {
+        return json::parse(cached.value());
+    }
+
+    std::cout << "Map " << hash << " is not cached, downloading\n";
+    auto sessionJson{ m_NetworkClient->FetchSession(hash) };
+    auto data{ sessionJson.dump() };
+    // stored only if it re-serializes to exactly what server hashed
+    if (HashSessionData(data) == hash)
+    {
+        sessionCache.Store(hash, data);
+    }
+    return sessionJson;
+}
+auto Scene::GetStatsOverlay() -> debug::StatsOverlay&
+{
+    return m_StatsOverlay;
+}
+auto Scene::GetOptions() const -> const SessionOptions&
 {
     return m_Options;
 }
 void Scene::Update()
 {
+    if (IsKeyPressed(KEY_F3))
+    {
+        m_StatsOverlay.Toggle();
+    }
+
     // important: process queue BEFORE sending new movement to avoid packet
     // overlaps (jitter)
+    auto frameStart{ std::chrono::steady_clock::now() };
     ProcessMessages();
+    auto drained{ std::chrono::steady_clock::now() };
+    m_StatsOverlay.RecordPhase(
+        debug::StatsOverlay::Phase::Network,
+        std::chrono::duration_cast<std::chrono::microseconds>(drained -
+                                                              frameStart));
 
-    m_MainPlayer->Update();
-
-    auto [mainPlayerController, mainPlayerCollider]{
-        m_Registry->get<PlayerController, CircleCollider>(m_MainPlayer->GetId())
-    };
+    // spectators have nothing to control
+    if (m_MainPlayerId != entt::null &&
+        IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+    {
+        const auto& collider{ m_Registry.get<CircleCollider>(m_MainPlayerId) };
+        HandleEvent(ShootEvent{
+            .Shooter = m_MainPlayerId,
+            .Target = Vector2Subtract(GetMousePosition(),
+                                      collider.GetPosition()) });
+    }
 
-    mainPlayerController.Update();
-    mainPlayerCollider.SetVelocity(mainPlayerController.GetCurrentVelocity());
+    systems::UpdateControllers(m_Registry);
 
-    m_NetworkClient->SendMovement(m_MainPlayer->GetId(),
-                                  mainPlayerCollider.GetVelocity());
+    if (m_MainPlayerId != entt::null)
+    {
+        m_NetworkClient->SendMovement(
+            m_MainPlayerId,
+            m_Registry.get<CircleCollider>(m_MainPlayerId).GetVelocity());
+    }
 
     // remove queued objects after all iterations
-    for (auto& idToDelete : m_MarkedForDeletion)
+    for (auto idToDelete : m_MarkedForDeletion)
     {
-        m_Registry->destroy(idToDelete);
-        m_Objects.erase(idToDelete);
+        if (m_Registry.valid(idToDelete))
+        {
+            m_Registry.destroy(idToDelete);
+        }
     }
     m_MarkedForDeletion.clear();
+
+    systems::BuildDrawCommands(m_Registry, m_DrawCommands);
+
+    auto now{ std::chrono::steady_clock::now() };
+    m_StatsOverlay.RecordPhase(
+        debug::StatsOverlay::Phase::Update,
+        std::chrono::duration_cast<std::chrono::microseconds>(now - drained));
+    m_StatsOverlay.Refresh(*m_NetworkClient);
+
+    if (now - m_LastTraceReport >= s_TraceReportInterval)
+    {
+        m_LastTraceReport = now;
+        auto traces{ m_TraceMetrics.Collect() };
+        if (!traces.empty())
+        {
+            std::cout << "Latency traces: " << traces.dump() << '\n';
+        }
+    }
 }
 void Scene::Draw() const
 {
-    for (const auto& object : m_Objects)
-    {
-        object.second->Draw();
-    }
+    systems::SubmitDrawCommands(m_DrawCommands, m_Options);
 
-    DrawText(("FPS: " + std::to_string(GetFPS())).c_str(), 5, 5, 20, BLACK);
+    // TextFormat writes into raylib's static buffer, no allocation
+    DrawText(TextFormat("FPS: %i", GetFPS()), 5, 5, 20, BLACK);
+    m_StatsOverlay.Draw();
+}
+
+void Scene::AddPlayer(IdType id, Vector2 position)
+{
+    auto ecsId{ m_Registry.create(id) };
+    assert(ecsId == id);
+    m_Registry.emplace<CircleCollider>(ecsId, position, m_Options.PlayerRadius);
+    m_Registry.emplace<PlayerTag>(ecsId);
+}
+void Scene::AddMainPlayer(IdType id, Vector2 position)
+{
+    AddPlayer(id, position);
+    m_Registry.emplace<PlayerController>(id, m_Options.PlayerSpeed);
+    m_MainPlayerId = id;
+}
+void Scene::AddBullet(IdType id, IdType shooterId, Vector2 position,
+                      Vector2 target)
+{
+    auto ecsId{ m_Registry.create(id) };
+    assert(ecsId == id);
+    auto& collider{ m_Registry.emplace<CircleCollider>(
+        ecsId, position, m_Options.BulletRadius) };
+    collider.SetVelocity(Vector2Scale(target, m_Options.BulletSpeed));
+    m_Registry.emplace<BulletTag>(ecsId, shooterId);
+}
+void Scene::AddWall(IdType id, const LineCollider& collider)
+{
+    auto ecsId{ m_Registry.create(id) };
+    assert(ecsId == id);
+    m_Registry.emplace<LineCollider>(ecsId, collider);
 }
 
 void Scene::ProcessMessages()
 {
     std::scoped_lock<std::mutex> mtxLock{ m_MQMutex };
 
+    auto queued{ m_MessageQueue.size() };
     for (auto it{ m_MessageQueue.begin() }; it != m_MessageQueue.end();)
     {
         if (this->ProcessIncomingMessage(*it))
@@ -128,64 +232,70 @@ void Scene::ProcessMessages()
             it++;
         }
     }
+    m_StatsOverlay.RecordQueue(queued, m_MessageQueue.size());
 }
 
 auto Scene::ProcessIncomingMessage(const json& message) -> bool
 {
-    // guaranteed to exist
-    auto type{ message["type"].template get<std::string>() };
-    auto payload = message["payload"]; // nlohmann/json doesn't like universal
-                                       // initialization :(
+    // guaranteed to exist. Only references are taken, copying json subtrees
+    // allocates
+    const auto& type{ message["type"].template get_ref<const std::string&>() };
+    const auto& payload = message["payload"]; // nlohmann/json doesn't like
+                                              // universal initialization :(
 
     if (type == "coords")
     {
         auto entityId{ payload["id"].template get<IdType>() };
-        if (!m_Registry->valid(entityId))
+        if (!m_Registry.valid(entityId))
         {
             // just skip bad coordinates
             return true;
         }
 
-        m_Registry->patch<CircleCollider>(
+        m_Registry.patch<CircleCollider>(
             entityId,
-            [payload](auto& collider)
+            [&payload](auto& collider)
             {
                 collider.SetPosition({ payload["x"].template get<float>(),
                                        payload["y"].template get<float>() });
             });
+        if (payload.contains("trace"))
+        {
+            CompleteTrace(entityId, payload["trace"]);
+        }
     }
     else if (type == "connection")
     {
         Vector2 spawnPos{ payload["x"].template get<float>(),
                           payload["y"].template get<float>() };
-        AddObject<Player>(payload["id"].template get<IdType>(), spawnPos);
+        AddPlayer(payload["id"].template get<IdType>(), spawnPos);
     }
     else if (type == "shoot")
     {
         auto id{ payload["bullet_id"].template get<IdType>() };
 
         // an ugly way to check if entity exists
-        auto enttId{ m_Registry->create(id) };
+        auto enttId{ m_Registry.create(id) };
         if (enttId != id)
         {
-            m_Registry->destroy(enttId);
+            m_Registry.destroy(enttId);
             // need to wait till destruction
             return false;
         }
-        m_Registry->destroy(enttId);
+        m_Registry.destroy(enttId);
 
         Vector2 targetVec{ payload["target_x"].template get<float>(),
                            payload["target_y"].template get<float>() };
         Vector2 initialPos{ payload["bullet_x"].template get<float>(),
                             payload["bullet_y"].template get<float>() };
 
-        AddObject<Bullet>(id, payload["shooter_id"].template get<IdType>(),
-                          initialPos, targetVec);
+        AddBullet(id, payload["shooter_id"].template get<IdType>(),
+                  initialPos, targetVec);
     }
     else if (type == "destroy")
     {
         auto id{ payload["id"].template get<IdType>() };
-        // if (id == m_MainPlayer->GetId())
+        // if (id == m_MainPlayerId)
         // {
         //     m_NetworkClient = nullptr;
         //     *reinterpret_cast<char*>(0); // дружеский прикол
@@ -200,17 +310,31 @@ auto Scene::ProcessIncomingMessage(const json& message) -> bool
     return true;
 }
 
+void Scene::CompleteTrace(IdType entityId, const json& trace)
+{
+    auto offset{ m_NetworkClient->GetClockOffset() };
+    if (!offset.has_value())
+    {
+        return;
+    }
+    // sampled, so the copy is rare
+    auto completed{ trace };
+    completed["c_apply"] = trace::Now() + *offset;
+    trace::RecordStages(m_TraceMetrics, completed,
+                        entityId == m_MainPlayerId);
+}
+
 void Scene::HandleEvent(ShootEvent event)
 {
-    m_NetworkClient->SendShoot(m_MainPlayer->GetId(), event.Target);
+    m_NetworkClient->SendShoot(event.Shooter, event.Target);
 }
 
 void Scene::HandleEvent(KillEvent event)
 {
-    RemoveObject(event.Victim->GetId());
-    RemoveObject(event.Projectile->GetId());
+    RemoveObject(event.Victim);
+    RemoveObject(event.Projectile);
 
-    if (event.Victim->GetId() == m_MainPlayer->GetId())
+    if (event.Victim == m_MainPlayerId)
     {
         return;
     }
@@ -220,7 +344,11 @@ void Scene::RemoveObject(IdType id)
 {
     m_MarkedForDeletion.push_back(id);
 }
-auto Scene::GetRegistry() const -> std::shared_ptr<Registry>
+auto Scene::GetRegistry() -> Registry&
+{
+    return m_Registry;
+}
+auto Scene::GetRegistry() const -> const Registry&
 {
     return m_Registry;
 }
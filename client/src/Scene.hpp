@@ -1,15 +1,19 @@
 #pragma once
 #include "Components.hpp"
 #include "GameEvents.hpp"
+#include "Metrics.hpp"
 #include "NetworkClient.hpp"
+#include "SessionCache.hpp"
 #include "SessionOptions.hpp"
+#include "StatsOverlay.hpp"
+#include "Systems.hpp"
 #include "Typedefs.hpp"
 #include <cassert>
+#include <chrono>
 #include <entt/entt.hpp>
 #include <memory>
 #include <queue>
 #include <raylib.h>
-#include <unordered_map>
 
 using json = nlohmann::json;
 
@@ -21,70 +25,65 @@ class NetworkClient;
 namespace smp::game
 {
 
-class GameObject;
-
 class Scene
 {
-    using ObjectsContainer =
-        std::unordered_map<IdType, std::shared_ptr<GameObject>>;
-    using Registry = entt::basic_registry<IdType>;
-
 public:
-    explicit Scene(std::unique_ptr<network::NetworkClient> networkClient);
+    Scene(std::unique_ptr<network::NetworkClient> networkClient,
+          const SessionCache& sessionCache);
 
     void Update();
     void Draw() const;
 
     auto IsAlive() const -> bool;
 
-    template <class T, class... Args>
-    void AddObject(IdType id, Args&&... args)
-    {
-        auto ecsId{ m_Registry->create(id) };
-        assert(ecsId == id);
-
-        auto ptr{ std::make_unique<T>(id, this, std::forward<Args>(args)...) };
-        m_Objects[ptr->GetId()] = std::move(ptr);
-    }
-
-    template <class... Args>
-    void AddMainPlayer(IdType id, Args&&... args)
-    {
-        auto ecsId{ m_Registry->create(id) };
-        assert(ecsId == id);
-        m_Registry->emplace<PlayerController>(ecsId, m_Options.PlayerSpeed);
-
-        auto ptr{ std::make_unique<Player>(id, this,
-                                           std::forward<Args>(args)...) };
-        m_MainPlayer = ptr.get();
-        m_Objects[ptr->GetId()] = std::move(ptr);
-    }
+    // entities keep the ids the server gave them
+    void AddPlayer(IdType id, Vector2 position);
+    void AddMainPlayer(IdType id, Vector2 position);
+    void AddBullet(IdType id, IdType shooterId, Vector2 position,
+                   Vector2 target);
+    void AddWall(IdType id, const LineCollider& collider);
 
     void RemoveObject(IdType id);
 
     void HandleEvent(ShootEvent event);
     void HandleEvent(KillEvent event);
 
-    [[nodiscard]] auto GetOptions() const -> SessionOptions;
-    [[nodiscard]] auto GetRegistry() const -> std::shared_ptr<Registry>;
+    [[nodiscard]] auto GetOptions() const -> const SessionOptions&;
+    [[nodiscard]] auto GetRegistry() -> Registry&;
+    [[nodiscard]] auto GetRegistry() const -> const Registry&;
+    // F3 toggles it, the caller times Draw into it
+    [[nodiscard]] auto GetStatsOverlay() -> debug::StatsOverlay&;
 
 private:
     auto ProcessIncomingMessage(const json& message) -> bool;
+    // static part of the session, from disk cache or from the room
+    auto LoadSession(const std::string& hash,
+                     const SessionCache& sessionCache) -> json;
     void ProcessMessages();
+    // an update that carries a latency trace was just applied
+    void CompleteTrace(IdType entityId, const json& trace);
 
 
 private:
     std::unique_ptr<network::NetworkClient> m_NetworkClient;
     bool m_Alive{ true };
 
-    ObjectsContainer m_Objects;
-    std::shared_ptr<Registry> m_Registry;
+    Registry m_Registry;
+    // rebuilt every frame, reused to keep its capacity
+    DrawCommands m_DrawCommands;
 
     SessionOptions m_Options;
-    Player* m_MainPlayer{ nullptr };
-    // since we are using unordered_map, they won't invalidate
+    IdType m_MainPlayerId{ entt::null };
+    // destroyed after all systems ran for the frame
     std::vector<IdType> m_MarkedForDeletion;
 
+    // stages of the traces we saw, logged every s_TraceReportInterval
+    metrics::Registry m_TraceMetrics;
+    std::chrono::steady_clock::time_point m_LastTraceReport;
+    static constexpr std::chrono::seconds s_TraceReportInterval{ 10 };
+
+    debug::StatsOverlay m_StatsOverlay;
+
     std::list<nlohmann::json> m_MessageQueue;
 	std::mutex m_MQMutex;
 };
@@ -0,0 +1,58 @@
+#include "SessionCache.hpp"
+#include "SessionBlob.hpp"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace smp::game
+{
+
+SessionCache::SessionCache(std::filesystem::path directory)
+    : m_Directory{ std::move(directory) }
+{
+}
+auto SessionCache::Load(const std::string& hash) const
+    -> std::optional<std::string>
+{
+    std::ifstream file{ m_Directory / hash, std::ios::binary };
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    std::string data{ std::istreambuf_iterator<char>{ file },
+                      std::istreambuf_iterator<char>{} };
+    if (HashSessionData(data) != hash)
+    {
+        std::cerr << "Cached session " << hash << " is corrupted\n";
+        return std::nullopt;
+    }
+    return data;
+}
+void SessionCache::Store(const std::string& hash,
+                         const std::string& data) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+    if (error)
+    {
+        std::cerr << "Can't create session cache: " << error.message()
+                  << '\n';
+        return;
+    }
+
+    // written aside and renamed, so a crash never leaves half a file behind
+    auto tempPath{ m_Directory / (hash + ".tmp") };
+    {
+        std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file)
+        {
+            std::cerr << "Can't write session cache\n";
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, m_Directory / hash, error);
+}
+
+} // namespace smp::game
@@ -0,0 +1,25 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace smp::game
+{
+
+// On-disk cache of session blobs (see SessionBlob.hpp), one file per hash,
+// so rejoining a room with a known map needs no download
+class SessionCache
+{
+public:
+    explicit SessionCache(std::filesystem::path directory);
+
+    // nullopt if missing or the file doesn't match its hash anymore
+    [[nodiscard]] auto Load(const std::string& hash) const
+        -> std::optional<std::string>;
+    void Store(const std::string& hash, const std::string& data) const;
+
+private:
+    std::filesystem::path m_Directory;
+};
+
+} // namespace smp::game
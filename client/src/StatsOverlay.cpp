@@ -0,0 +1,204 @@
+#include "StatsOverlay.hpp"
+#include <algorithm>
+#include <raylib.h>
+
+namespace smp::debug
+{
+
+StatsOverlay::StatsOverlay()
+    : m_StartedAt{ std::chrono::steady_clock::now() },
+      m_LastRefresh{ m_StartedAt }
+{
+}
+auto StatsOverlay::OpenCsv(const std::string& path) -> bool
+{
+    m_Csv.open(path, std::ios::out | std::ios::trunc);
+    if (!m_Csv)
+    {
+        return false;
+    }
+    m_Csv << "time_s,metric,value\n";
+    return true;
+}
+void StatsOverlay::Toggle()
+{
+    m_Visible = !m_Visible;
+}
+auto StatsOverlay::IsVisible() const -> bool
+{
+    return m_Visible;
+}
+void StatsOverlay::RecordPhase(Phase phase, std::chrono::microseconds duration)
+{
+    m_Phases[static_cast<std::size_t>(phase)].Record(
+        static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0)));
+}
+void StatsOverlay::RecordQueue(std::size_t queued, std::size_t deferred)
+{
+    m_MaxQueued = std::max(m_MaxQueued, queued);
+    m_MaxDeferred = std::max(m_MaxDeferred, deferred);
+}
+void StatsOverlay::Refresh(network::NetworkClient& networkClient)
+{
+    auto now{ std::chrono::steady_clock::now() };
+    if (now - m_LastRefresh < s_RefreshInterval)
+    {
+        return;
+    }
+    auto seconds{ std::chrono::duration<double>(now - m_LastRefresh).count() };
+    m_LastRefresh = now;
+
+    if (m_Visible || m_Csv.is_open())
+    {
+        BuildRows(networkClient, seconds);
+        WriteCsv();
+    }
+    else
+    {
+        // nobody looks, only keep the client's window from growing
+        networkClient.TakeUpdateGaps(m_UpdateGaps);
+    }
+
+    for (auto& phase : m_Phases)
+    {
+        phase.Reset();
+    }
+    m_UpdateGaps.Reset();
+    m_MaxQueued = 0;
+    m_MaxDeferred = 0;
+}
+void StatsOverlay::Draw() const
+{
+    if (!m_Visible)
+    {
+        return;
+    }
+
+    static constexpr int s_FontSize{ 10 };
+    static constexpr int s_LineHeight{ 12 };
+    static constexpr int s_Left{ 5 };
+    static constexpr int s_Top{ 30 };
+    DrawRectangle(s_Left - 2, s_Top - 2, 260,
+                  static_cast<int>(m_Rows.size()) * s_LineHeight + 4,
+                  Fade(BLACK, 0.6F));
+    auto y{ s_Top };
+    for (const auto& row : m_Rows)
+    {
+        DrawText(TextFormat("%-36s %10.2f", row.Metric.c_str(), row.Value),
+                 s_Left, y, s_FontSize, GREEN);
+        y += s_LineHeight;
+    }
+}
+
+void StatsOverlay::BuildRows(network::NetworkClient& networkClient,
+                             double seconds)
+{
+    m_Rows.clear();
+
+    auto link{ networkClient.GetLinkStats() };
+    if (link.has_value())
+    {
+        m_Rows.push_back({ "rtt_ms", static_cast<double>(link->PingMs) });
+        m_Rows.push_back({ "loss_pct", link->Loss * 100.0 });
+        m_Rows.push_back({ "wire.in.bytes_per_s", link->InBytesPerSecond });
+        m_Rows.push_back({ "wire.out.bytes_per_s", link->OutBytesPerSecond });
+    }
+
+    networkClient.GetTraffic(m_In, m_Out);
+    AddTrafficRows("in", m_In, m_LastIn, seconds);
+    AddTrafficRows("out", m_Out, m_LastOut, seconds);
+    std::swap(m_In, m_LastIn);
+    std::swap(m_Out, m_LastOut);
+
+    m_Rows.push_back({ "queue.max", static_cast<double>(m_MaxQueued) });
+    m_Rows.push_back(
+        { "queue.deferred_max", static_cast<double>(m_MaxDeferred) });
+    // positions are applied as they come, the gaps between our own are
+    // what an interpolation buffer would have to cover
+    networkClient.TakeUpdateGaps(m_UpdateGaps);
+    m_Rows.push_back({ "own_updates.per_s",
+                       static_cast<double>(m_UpdateGaps.GetCount()) /
+                           seconds });
+    AddHistogramRows("own_updates.gap", m_UpdateGaps);
+
+    AddHistogramRows("frame.update",
+                     m_Phases[static_cast<std::size_t>(Phase::Update)]);
+    AddHistogramRows("frame.network",
+                     m_Phases[static_cast<std::size_t>(Phase::Network)]);
+    AddHistogramRows("frame.draw",
+                     m_Phases[static_cast<std::size_t>(Phase::Draw)]);
+}
+void StatsOverlay::AddTrafficRows(
+    const char* direction, const network::NetworkClient::TrafficByType& now,
+    const network::NetworkClient::TrafficByType& before, double seconds)
+{
+    for (const auto& [type, traffic] : now)
+    {
+        auto previous{ network::NetworkClient::Traffic{} };
+        auto beforeIt{ before.find(type) };
+        if (beforeIt != before.end())
+        {
+            previous = beforeIt->second;
+        }
+        auto prefix{ std::string{ direction } + '.' + type };
+        m_Rows.push_back(
+            { prefix + ".bytes_per_s",
+              static_cast<double>(traffic.Bytes - previous.Bytes) /
+                  seconds });
+        m_Rows.push_back(
+            { prefix + ".msgs_per_s",
+              static_cast<double>(traffic.Messages - previous.Messages) /
+                  seconds });
+        // only compressed messages differ
+        if (traffic.WireBytes != traffic.Bytes)
+        {
+            m_Rows.push_back(
+                { prefix + ".wire_bytes_per_s",
+                  static_cast<double>(traffic.WireBytes -
+                                      previous.WireBytes) /
+                      seconds });
+            auto messages{ traffic.Messages - previous.Messages };
+            m_Rows.push_back(
+                { prefix + ".decode_us_per_msg",
+                  messages == 0
+                      ? 0.0
+                      : static_cast<double>(traffic.DecodeNanoseconds -
+                                            previous.DecodeNanoseconds) /
+                            static_cast<double>(messages) / 1000.0 });
+        }
+    }
+}
+void StatsOverlay::AddHistogramRows(const char* name,
+                                    const metrics::Histogram& values)
+{
+    if (values.GetCount() == 0)
+    {
+        return;
+    }
+    // recorded in microseconds, shown in milliseconds
+    std::string prefix{ name };
+    m_Rows.push_back(
+        { prefix + ".p50_ms",
+          static_cast<double>(values.GetPercentile(50)) / 1000.0 });
+    m_Rows.push_back(
+        { prefix + ".p99_ms",
+          static_cast<double>(values.GetPercentile(99)) / 1000.0 });
+    m_Rows.push_back(
+        { prefix + ".max_ms", static_cast<double>(values.GetMax()) / 1000.0 });
+}
+void StatsOverlay::WriteCsv()
+{
+    if (!m_Csv.is_open())
+    {
+        return;
+    }
+    auto time{ std::chrono::duration<double>(m_LastRefresh - m_StartedAt)
+                   .count() };
+    for (const auto& row : m_Rows)
+    {
+        m_Csv << time << ',' << row.Metric << ',' << row.Value << '\n';
+    }
+    m_Csv.flush();
+}
+
+} // namespace smp::debug
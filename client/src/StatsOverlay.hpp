@@ -0,0 +1,84 @@
+#pragma once
+#include "Histogram.hpp"
+#include "NetworkClient.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace smp::debug
+{
+
+// Connection and frame stats, refreshed once a second. Drawn over the game
+// while toggled on and, if a csv file was given, appended to it as
+// "time_s,metric,value" rows whether shown or not.
+class StatsOverlay
+{
+public:
+    enum class Phase
+    {
+        // game logic, systems and building draw commands
+        Update,
+        // handling what the network thread queued for us
+        Network,
+        Draw
+    };
+
+    StatsOverlay();
+
+    // false if the file can't be written
+    auto OpenCsv(const std::string& path) -> bool;
+
+    void Toggle();
+    [[nodiscard]] auto IsVisible() const -> bool;
+
+    void RecordPhase(Phase phase, std::chrono::microseconds duration);
+    // messages waiting before this frame's drain, and left over after it
+    void RecordQueue(std::size_t queued, std::size_t deferred);
+
+    // once a frame, after the update
+    void Refresh(network::NetworkClient& networkClient);
+    void Draw() const;
+
+private:
+    struct Row
+    {
+        std::string Metric;
+        double Value;
+    };
+
+    void BuildRows(network::NetworkClient& networkClient, double seconds);
+    void AddTrafficRows(const char* direction,
+                        const network::NetworkClient::TrafficByType& now,
+                        const network::NetworkClient::TrafficByType& before,
+                        double seconds);
+    void AddHistogramRows(const char* name, const metrics::Histogram& values);
+    void WriteCsv();
+
+    static constexpr std::chrono::seconds s_RefreshInterval{ 1 };
+    static constexpr std::size_t s_PhaseCount{ 3 };
+
+    bool m_Visible{ false };
+    std::ofstream m_Csv;
+    std::chrono::steady_clock::time_point m_StartedAt;
+    std::chrono::steady_clock::time_point m_LastRefresh;
+
+    // since the last refresh, microseconds
+    std::array<metrics::Histogram, s_PhaseCount> m_Phases;
+    metrics::Histogram m_UpdateGaps;
+    std::size_t m_MaxQueued{ 0 };
+    std::size_t m_MaxDeferred{ 0 };
+
+    network::NetworkClient::TrafficByType m_In;
+    network::NetworkClient::TrafficByType m_Out;
+    network::NetworkClient::TrafficByType m_LastIn;
+    network::NetworkClient::TrafficByType m_LastOut;
+
+    // what was last built, drawn every frame in between
+    std::vector<Row> m_Rows;
+};
+
+} // namespace smp::debug
@@ -0,0 +1,62 @@
+#include "Systems.hpp"
+
+namespace smp::game::systems
+{
+
+void UpdateControllers(Registry& registry)
+{
+    auto controlledView{ registry.view<PlayerController, CircleCollider>() };
+    for (auto&& [entity, controller, collider] : controlledView.each())
+    {
+        controller.Update();
+        collider.SetVelocity(controller.GetCurrentVelocity());
+    }
+}
+
+void BuildDrawCommands(const Registry& registry, DrawCommands& commands)
+{
+    commands.Players.clear();
+    commands.Bullets.clear();
+    commands.Walls.clear();
+
+    auto playersView{
+        registry.view<const PlayerTag, const CircleCollider>()
+    };
+    for (auto&& [entity, collider] : playersView.each())
+    {
+        commands.Players.push_back(collider.GetPosition());
+    }
+
+    auto bulletsView{
+        registry.view<const BulletTag, const CircleCollider>()
+    };
+    for (auto&& [entity, tag, collider] : bulletsView.each())
+    {
+        commands.Bullets.push_back(collider.GetPosition());
+    }
+
+    auto wallsView{ registry.view<const LineCollider>() };
+    for (auto&& [entity, collider] : wallsView.each())
+    {
+        commands.Walls.push_back(collider);
+    }
+}
+
+void SubmitDrawCommands(const DrawCommands& commands,
+                        const SessionOptions& options)
+{
+    for (const auto& wall : commands.Walls)
+    {
+        DrawLineEx(wall.Start, wall.End, 10, BLUE);
+    }
+    for (auto position : commands.Players)
+    {
+        DrawCircleV(position, options.PlayerRadius, GREEN);
+    }
+    for (auto position : commands.Bullets)
+    {
+        DrawCircleV(position, options.BulletRadius, BLACK);
+    }
+}
+
+} // namespace smp::game::systems
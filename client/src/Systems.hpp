@@ -0,0 +1,36 @@
+#pragma once
+#include "Components.hpp"
+#include "SessionOptions.hpp"
+#include "Typedefs.hpp"
+#include <entt/entt.hpp>
+#include <raylib.h>
+#include <vector>
+
+namespace smp::game
+{
+
+using Registry = entt::basic_registry<IdType>;
+
+// Everything one frame draws, grouped by entity kind so each batch is drawn
+// with one style in one tight loop
+struct DrawCommands
+{
+    std::vector<Vector2> Players;
+    std::vector<Vector2> Bullets;
+    std::vector<LineCollider> Walls;
+};
+
+namespace systems
+{
+
+// applies local input to the controlled player's velocity
+void UpdateControllers(Registry& registry);
+
+// fills commands from dense component views, capacity is kept between
+// frames so a steady scene doesn't allocate
+void BuildDrawCommands(const Registry& registry, DrawCommands& commands);
+void SubmitDrawCommands(const DrawCommands& commands,
+                        const SessionOptions& options);
+
+} // namespace systems
+} // namespace smp::game
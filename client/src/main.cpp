@@ -1,27 +1,17 @@
+#include "AllocationCounter.hpp"
+#include "Benchmark.hpp"
+#include "DebugOutput.hpp"
 #include "NetworkClient.hpp"
-#include "Player.hpp"
 #include "Scene.hpp"
 #include "SessionOptions.hpp"
 #include "steam/steamnetworkingtypes.h"
 #include <boost/program_options.hpp>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <raylib.h>
 
-static void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType,
-                        const char* pszMsg)
-{
-    printf(" %s\n", pszMsg);
-    fflush(stdout);
-    if (eType == k_ESteamNetworkingSocketsDebugOutputType_Bug)
-    {
-        fflush(stdout);
-        fflush(stderr);
-        std::abort();
-    }
-}
-
 auto main(int argc, char** argv) -> int
 {
     SteamDatagramErrMsg errMsg;
@@ -29,18 +19,41 @@ auto main(int argc, char** argv) -> int
     {
         std::cerr << "GameNetworkingSockets_Init failed.  " << errMsg << '\n';
     }
-    SteamNetworkingUtils()->SetDebugOutputFunction(
-        k_ESteamNetworkingSocketsDebugOutputType_Msg, DebugOutput);
+    smp::network::InstallDebugOutput();
 
     namespace opts = boost::program_options;
     std::string entryPointAddr;
-    opts::options_description optsDescription{ "Allowed opitons" };
+    std::string cacheDir;
+    std::string spectateAddr;
+    uint32_t benchBullets{ 0 };
+    uint32_t benchFrames{ 0 };
+    double traceSampleRate{ 0.0 };
+    std::string statsCsv;
+    opts::options_description optsDescription{ "Allowed options" };
     // clang-format off
     optsDescription.add_options()
 		("help,h", "display help")
-		("entry,e", 
-		 opts::value<std::string>(&entryPointAddr)->required(),
-		 "entry point address");
+		("entry,e",
+		 opts::value<std::string>(&entryPointAddr),
+		 "entry point address")
+		("spectate,s",
+		 opts::value<std::string>(&spectateAddr),
+		 "watch the room or relay at this address instead of playing")
+		("cache-dir,c",
+		 opts::value<std::string>(&cacheDir)->default_value("map_cache"),
+		 "where downloaded maps are kept")
+		("bench-bullets",
+		 opts::value<uint32_t>(&benchBullets),
+		 "run headless frame benchmark with this many bullets and exit")
+		("bench-frames",
+		 opts::value<uint32_t>(&benchFrames)->default_value(1000),
+		 "frames to run in benchmark mode")
+		("trace-sample",
+		 opts::value<double>(&traceSampleRate)->default_value(0.0),
+		 "share of movement inputs to trace end to end, logged every 10s")
+		("stats-csv",
+		 opts::value<std::string>(&statsCsv),
+		 "append what the F3 overlay shows to this csv file every second");
     // clang-format on
 
     opts::variables_map vm;
@@ -62,16 +75,47 @@ auto main(int argc, char** argv) -> int
         return 0;
     }
 
+    if (vm.count("bench-bullets"))
+    {
+        smp::game::RunBenchmark(benchBullets, benchFrames);
+        return 0;
+    }
+
+    if (entryPointAddr.empty() && spectateAddr.empty())
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << "the option '--entry' is required" << std::endl;
+        return 0;
+    }
+
     auto networkClient{ std::make_unique<smp::network::NetworkClient>() };
-    networkClient->FindFreeRoom(entryPointAddr);
+    networkClient->SetTraceSampleRate(traceSampleRate);
+    if (!spectateAddr.empty())
+    {
+        networkClient->Spectate(spectateAddr);
+    }
+    else
+    {
+        networkClient->FindFreeRoom(entryPointAddr);
+    }
 
-    smp::game::Scene scene{ std::move(networkClient) };
+    smp::game::SessionCache sessionCache{ cacheDir };
+    smp::game::Scene scene{ std::move(networkClient), sessionCache };
+    if (!statsCsv.empty() && !scene.GetStatsOverlay().OpenCsv(statsCsv))
+    {
+        std::cerr << "Can't write stats to " << statsCsv << '\n';
+        return 1;
+    }
 
-    InitWindow(smp::game::SessionOptions::WorldWidth,
-               smp::game::SessionOptions::WorldHeight, "my game client hehehe");
+    const auto& options{ scene.GetOptions() };
+    InitWindow(static_cast<int>(options.WorldWidth),
+               static_cast<int>(options.WorldHeight), "my game client hehehe");
 
     SetTargetFPS(60);
 
+    // steady frames are expected not to allocate at all, debug builds say so
+    // when they do
+    smp::debug::FrameAllocationReport allocationReport;
     while (!WindowShouldClose())
     {
         if (!scene.IsAlive())
@@ -79,12 +123,20 @@ auto main(int argc, char** argv) -> int
             break;
         }
 
+        allocationReport.BeginFrame();
         scene.Update();
 
         BeginDrawing();
         ClearBackground(RAYWHITE);
+        // EndDrawing waits for vsync, so only our part is timed
+        auto drawStart{ std::chrono::steady_clock::now() };
         scene.Draw();
+        scene.GetStatsOverlay().RecordPhase(
+            smp::debug::StatsOverlay::Phase::Draw,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - drawStart));
         EndDrawing();
+        allocationReport.EndFrame();
     }
 
     CloseWindow();
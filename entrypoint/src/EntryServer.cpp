@@ -1,8 +1,42 @@
 #include "EntryServer.hpp"
+#include "Discovery.hpp"
+#include <charconv>
+#include <optional>
 
 namespace smp::server
 {
 
+// rooms write whatever they like to redis, a broken one must not take the
+// entry point down with it
+static auto IsValidEndpoint(const json& endpoint) -> bool
+{
+    return endpoint.is_object() && endpoint.contains("ip") &&
+           endpoint["ip"].is_string() && endpoint.contains("port") &&
+           endpoint["port"].is_number_integer();
+}
+// missing and mistyped fields both read as the fallback
+template <typename T>
+static auto ReadNumber(const json& object, const char* key, T fallback) -> T
+{
+    auto valueIt{ object.find(key) };
+    if (valueIt == object.end() || !valueIt->is_number())
+    {
+        return fallback;
+    }
+    return valueIt->template get<T>();
+}
+static auto ParsePlayerCount(const std::string& text) -> std::optional<int32_t>
+{
+    int32_t count{ 0 };
+    auto [end, error]{ std::from_chars(text.data(), text.data() + text.size(),
+                                       count) };
+    if (error != std::errc{} || end != text.data() + text.size())
+    {
+        return std::nullopt;
+    }
+    return count;
+}
+
 EntryServer::EntryServer(const std::string& redisHost, int32_t redisPort)
 {
     try
@@ -13,63 +47,15 @@ EntryServer::EntryServer(const std::string& redisHost, int32_t redisPort)
         options.password = "mypassword"; // hehehe
 
         m_RedisClient = std::make_unique<redis::Redis>(options);
-        m_RedisPollThread = std::make_unique<std::thread>(
-            [this]()
-            {
-                while (m_Alive)
-                {
-                    try
-                    {
-                        std::lock_guard<std::mutex> mtxLock{ m_ServerMapMutex };
-
-                        m_AvailableServersMap.clear();
-
-                        std::unordered_set<std::string> keys;
-                        auto cursor{ 0LL };
-
-                        while (m_Alive)
-                        {
-                            cursor = m_RedisClient->scan(
-                                cursor, std::inserter(keys, keys.begin()));
-
-                            if (cursor == 0)
-                            {
-                                break;
-                            }
-                        }
-
-                        for (const auto& key : keys)
-                        {
-                            auto dotIdx{ key.find('.') };
-                            auto serverName{ key.substr(0, dotIdx) };
-                            auto keyType{ key.substr(dotIdx + 1) };
-
-                            auto valueOpt{ m_RedisClient->get(key) };
-                            assert(valueOpt.has_value());
-
-                            m_AvailableServersMap[serverName];
-                            if (keyType == "player_count")
-                            {
-                                m_AvailableServersMap[serverName]
-                                                     ["player_count"] =
-                                                         std::stoi(
-                                                             valueOpt.value());
-                            }
-                            else
-                            {
-                                m_AvailableServersMap[serverName].merge_patch(
-                                    json::parse(valueOpt.value()));
-                            }
-                        }
-                    }
-                    catch (const redis::Error& error)
-                    {
-                        std::cerr << error.what() << std::endl;
-                    }
+        m_ReservationWriter = std::make_unique<RedisWriter>(options);
 
-                    std::this_thread::sleep_for(std::chrono::milliseconds{ 300 });
-                }
-            });
+        // subscriber connection must time out from time to time, so we can
+        // notice shutdown and do the periodic reconcile
+        options.socket_timeout = s_SubscriberTimeout;
+        m_RedisSubscriberClient = std::make_unique<redis::Redis>(options);
+
+        m_DiscoveryThread =
+            std::make_unique<std::thread>([this]() { RunDiscovery(); });
     }
     catch (const redis::Error& error)
     {
@@ -79,16 +65,423 @@ EntryServer::EntryServer(const std::string& redisHost, int32_t redisPort)
 EntryServer::~EntryServer()
 {
     m_Alive = false;
-    m_RedisPollThread->join();
+    if (m_DiscoveryThread != nullptr)
+    {
+        m_DiscoveryThread->join();
+    }
+}
+void EntryServer::RunDiscovery()
+{
+    while (m_Alive)
+    {
+        try
+        {
+            auto subscriber{ m_RedisSubscriberClient->subscriber() };
+            subscriber.on_message(
+                [this](const std::string& /*channel*/,
+                       const std::string& message)
+                {
+                    auto update{ json::parse(message, nullptr, false) };
+                    if (!update.is_discarded() && update.contains("name"))
+                    {
+                        ApplyServerUpdate(update);
+                    }
+                });
+            subscriber.subscribe(discovery::UpdatesChannel);
+            // wait for subscription to be confirmed, so nothing published
+            // after the snapshot below can be missed
+            subscriber.consume();
+
+            ReconcileServerMap();
+            auto lastReconcile{ std::chrono::steady_clock::now() };
+
+            while (m_Alive)
+            {
+                try
+                {
+                    subscriber.consume();
+                }
+                catch (const redis::TimeoutError&)
+                {
+                    // nothing happened, that's fine
+                }
+
+                PruneExpiredRooms();
+
+                // updates may still get lost (e.g. server crashed before
+                // publishing), so full snapshot is reloaded once in a while
+                auto now{ std::chrono::steady_clock::now() };
+                if (now - lastReconcile >= s_ReconcileInterval)
+                {
+                    ReconcileServerMap();
+                    lastReconcile = now;
+                }
+            }
+        }
+        catch (const redis::Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            std::this_thread::sleep_for(s_SubscriberTimeout);
+        }
+    }
+}
+void EntryServer::ReconcileServerMap()
+{
+    // all the redis round trips happen before anything is published, readers
+    // keep using the previous map meanwhile
+    PublishServerMap(std::make_shared<const ServerMap>(LoadServerSnapshot()));
+}
+void EntryServer::PublishServerMap(std::shared_ptr<const ServerMap> servers)
+{
+    m_AvailableServersMap.store(std::move(servers));
+    m_ServerMapVersion++;
+}
+auto EntryServer::LoadServerSnapshot() -> ServerMap
+{
+    std::unordered_set<std::string> endpointKeys;
+    auto cursor{ 0LL };
+    auto pattern{ "*" + std::string{ discovery::EndpointSuffix } };
+    do
+    {
+        cursor = m_RedisClient->scan(
+            cursor, pattern, std::inserter(endpointKeys, endpointKeys.begin()));
+    } while (cursor != 0 && m_Alive);
+
+    std::vector<std::string> serverNames;
+    std::vector<std::string> keys;
+    for (const auto& key : endpointKeys)
+    {
+        auto serverName{ key.substr(0, key.size() -
+                                           discovery::EndpointSuffix.size()) };
+        keys.push_back(key);
+        keys.push_back(discovery::PlayerCountKey(serverName));
+        keys.push_back(discovery::HeartbeatKey(serverName));
+        serverNames.push_back(std::move(serverName));
+    }
+
+    // whole snapshot in one round trip
+    std::vector<redis::OptionalString> values;
+    if (!keys.empty())
+    {
+        m_RedisClient->mget(keys.begin(), keys.end(),
+                            std::back_inserter(values));
+    }
+
+    auto now{ std::chrono::steady_clock::now() };
+    ServerMap snapshot;
+    for (std::size_t i{ 0 }; i < serverNames.size(); i++)
+    {
+        const auto& endpoint{ values[3 * i] };
+        const auto& playerCount{ values[3 * i + 1] };
+        const auto& heartbeat{ values[3 * i + 2] };
+        if (!endpoint.has_value() || !heartbeat.has_value())
+        {
+            // deregistered while we were scanning, or heartbeat has expired
+            continue;
+        }
+
+        auto endpointJson{ json::parse(endpoint.value(), nullptr, false) };
+        auto heartbeatJson{ json::parse(heartbeat.value(), nullptr, false) };
+        auto players{ playerCount.has_value()
+                          ? ParsePlayerCount(playerCount.value())
+                          : std::optional<int32_t>{ 0 } };
+        if (!IsValidEndpoint(endpointJson) || !heartbeatJson.is_object() ||
+            !players.has_value())
+        {
+            std::cerr << "Skipping room " << serverNames[i]
+                      << " with malformed discovery data\n";
+            continue;
+        }
+
+        Room room;
+        room.Endpoint = std::move(endpointJson);
+        room.Info = room.Endpoint;
+        room.Info["player_count"] = *players;
+        room.Info["heartbeat"] = std::move(heartbeatJson);
+        room.AssignmentPrefix = MakeAssignmentPrefix(room.Endpoint);
+        room.LastHeartbeat = now;
+        UpdateRoomLoad(room);
+        snapshot.emplace(serverNames[i],
+                         std::make_shared<const Room>(std::move(room)));
+    }
+    return snapshot;
+}
+auto EntryServer::MakeAssignmentPrefix(const json& endpoint) -> std::string
+{
+    // client only needs to know where to go. Tokens are hex digits and dots,
+    // they need no escaping.
+    return R"({"ip":)" + endpoint["ip"].dump() + R"(,"port":)" +
+           endpoint["port"].dump() + R"(,"token":")";
+}
+void EntryServer::ApplyServerUpdate(const json& update)
+{
+    if (!update["name"].is_string() ||
+        (update.contains("endpoint") && !IsValidEndpoint(update["endpoint"])) ||
+        (update.contains("player_count") &&
+         !update["player_count"].is_number_integer()) ||
+        (update.contains("heartbeat") && !update["heartbeat"].is_object()))
+    {
+        std::cerr << "Dropping malformed discovery update\n";
+        return;
+    }
+    auto serverName{ update["name"].template get<std::string>() };
+
+    // only the discovery thread writes, so copy-modify-store can't race.
+    // The copy holds names and pointers, rooms aren't copied.
+    auto servers{ std::make_shared<ServerMap>(*m_AvailableServersMap.load()) };
+
+    if (update.contains("removed"))
+    {
+        if (servers->erase(serverName) != 0)
+        {
+            PublishServerMap(std::move(servers));
+        }
+        return;
+    }
+
+    Room room;
+    auto serverIt{ servers->find(serverName) };
+    if (serverIt != servers->end())
+    {
+        // readers may still hold the published one
+        room = *serverIt->second;
+    }
+    else if (!update.contains("endpoint"))
+    {
+        // can't route players anywhere without an endpoint, wait for
+        // registration or reconcile
+        return;
+    }
+    else
+    {
+        room.Info["player_count"] = 0;
+    }
+
+    // registration counts as a sign of life as well
+    room.LastHeartbeat = std::chrono::steady_clock::now();
+
+    if (update.contains("endpoint") && room.Endpoint != update["endpoint"])
+    {
+        room.Endpoint = update["endpoint"];
+        room.Info.merge_patch(room.Endpoint);
+        room.AssignmentPrefix = MakeAssignmentPrefix(room.Endpoint);
+    }
+    if (update.contains("player_count"))
+    {
+        room.Info["player_count"] = update["player_count"];
+    }
+    if (update.contains("heartbeat"))
+    {
+        room.Info["heartbeat"] = update["heartbeat"];
+    }
+    UpdateRoomLoad(room);
+    (*servers)[serverName] = std::make_shared<const Room>(std::move(room));
+    PublishServerMap(std::move(servers));
+}
+void EntryServer::UpdateRoomLoad(Room& room)
+{
+    auto& load{ room.Load };
+    load.Host = room.Endpoint.value("ip", "");
+    load.Capacity =
+        ReadNumber(room.Endpoint, "capacity", m_DefaultRoomCapacity);
+    load.PlayerCount = ReadNumber(room.Info, "player_count", 0);
+    if (room.Info.contains("heartbeat"))
+    {
+        const auto& heartbeat{ room.Info["heartbeat"] };
+        load.TickP99Us = ReadNumber(heartbeat, "tick_p99_us", 0.F);
+        load.CpuShare = ReadNumber(heartbeat, "cpu_share", 0.F);
+    }
+    load.Revision = ++m_LoadRevision;
+}
+void EntryServer::SetDefaultRoomCapacity(int32_t capacity)
+{
+    m_DefaultRoomCapacity = capacity;
+}
+void EntryServer::SetPlacementScore(PlacementScore score)
+{
+    m_Placement.SetScoreFunction(std::move(score));
+}
+void EntryServer::PruneExpiredRooms()
+{
+    auto now{ std::chrono::steady_clock::now() };
+    auto servers{ m_AvailableServersMap.load() };
+
+    auto isExpired{ [now](const auto& serverPair)
+                    {
+                        return now - serverPair.second->LastHeartbeat >
+                               discovery::HeartbeatTtl;
+                    } };
+    if (std::none_of(servers->begin(), servers->end(), isExpired))
+    {
+        return;
+    }
+
+    auto alive{ std::make_shared<ServerMap>(*servers) };
+    std::erase_if(*alive,
+                  [&isExpired](const auto& serverPair)
+                  {
+                      if (isExpired(serverPair))
+                      {
+                          std::cout << "Room " << serverPair.first
+                                    << " stopped sending heartbeats\n";
+                          return true;
+                      }
+                      return false;
+                  });
+    PublishServerMap(std::move(alive));
 }
 void EntryServer::Run(const std::string& addrIpv4)
 {
+    // this loop services GNS instead of its own thread, so waiting in
+    // SteamNetworkingSockets_Poll wakes up as soon as a packet arrives
+    SteamNetworkingSockets_SetManualPollMode(true);
     InitConnection(addrIpv4);
 
+    auto lastMetricsReport{ std::chrono::steady_clock::now() };
+    auto lastThroughputReport{ lastMetricsReport };
     while (m_Alive)
     {
+        auto wait{ m_PendingAssignments.empty() ? s_IdleWait : s_ParkedWait };
+        SteamNetworkingSockets_Poll(static_cast<int>(wait.count()));
+
+        auto wakeup{ std::chrono::steady_clock::now() };
         PollConnectionStateChanges();
-        std::this_thread::sleep_for(std::chrono::seconds{ 1 });
+        MatchPendingAssignments();
+        ExpirePendingAssignments();
+
+        auto now{ std::chrono::steady_clock::now() };
+        m_WakeupTimes.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now -
+                                                                  wakeup)
+                .count()));
+        if (m_ThroughputMode &&
+            now - lastThroughputReport >= s_ThroughputReportInterval)
+        {
+            ReportThroughput(now - lastThroughputReport);
+            lastThroughputReport = now;
+        }
+        if (now - lastMetricsReport >= s_MetricsReportInterval)
+        {
+            m_Metrics.SetGauge("matchmaking.queue_depth",
+                               static_cast<double>(
+                                   m_PendingAssignments.size()));
+            m_Metrics.MergeHistogram("entry.wakeup_busy_us", m_WakeupTimes);
+            m_WakeupTimes.Reset();
+            std::cout << "Metrics: " << m_Metrics.Collect().dump() << '\n';
+            lastMetricsReport = now;
+        }
+    }
+}
+void EntryServer::SetThroughputMode(bool enabled)
+{
+    m_ThroughputMode = enabled;
+}
+void EntryServer::ReportThroughput(std::chrono::nanoseconds interval)
+{
+    auto perSecond{ static_cast<double>(m_IntervalAssignments) /
+                    std::chrono::duration<double>{ interval }.count() };
+    m_PeakAssignmentsPerSecond =
+        std::max(m_PeakAssignmentsPerSecond, perSecond);
+    std::cout << "Assignments/s: " << perSecond << " (peak "
+              << m_PeakAssignmentsPerSecond << "), queue "
+              << m_PendingAssignments.size() << '\n';
+    m_IntervalAssignments = 0;
+}
+void EntryServer::MatchPendingAssignments()
+{
+    if (m_PendingAssignments.empty())
+    {
+        return;
+    }
+
+    // nobody new is waiting and rooms didn't change, so the answer is the
+    // same as last time
+    auto serverMapVersion{ m_ServerMapVersion.load() };
+    if (!m_HasNewPendingAssignments &&
+        serverMapVersion == m_MatchedServerMapVersion)
+    {
+        return;
+    }
+    m_HasNewPendingAssignments = false;
+
+    if (serverMapVersion != m_MatchedServerMapVersion)
+    {
+        // keeping the snapshot alive keeps pointers handed to placement valid
+        m_PlacementServers = m_AvailableServersMap.load();
+        m_PlacementRooms.clear();
+        std::vector<std::pair<const std::string*, const RoomLoad*>> rooms;
+        rooms.reserve(m_PlacementServers->size());
+        for (const auto& [name, room] : *m_PlacementServers)
+        {
+            rooms.emplace_back(&name, &room->Load);
+            m_PlacementRooms.emplace_back(&name, room.get());
+        }
+        m_Placement.Update(rooms);
+        m_MatchedServerMapVersion = serverMapVersion;
+    }
+
+    auto now{ std::chrono::steady_clock::now() };
+    while (!m_PendingAssignments.empty())
+    {
+        auto roomIdx{ m_Placement.Place(now) };
+        if (!roomIdx.has_value())
+        {
+            // every room is full, keep them parked
+            break;
+        }
+
+        const auto& pending{ m_PendingAssignments.front() };
+        const auto& [roomName, room]{ m_PlacementRooms[*roomIdx] };
+        // no Nagle delay, the client has nothing else coming
+        SendMessageToConnection(pending.Connection,
+                                ReserveSlot(*roomName, *room),
+                                k_nSteamNetworkingSend_ReliableNoNagle);
+        m_IntervalAssignments++;
+
+        m_Metrics.AddCounter("matchmaking.assigned");
+        m_Metrics.RecordValue(
+            "matchmaking.wait_us",
+            static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - pending.EnqueuedAt)
+                    .count()));
+        m_PendingAssignments.pop_front();
+    }
+}
+auto EntryServer::ReserveSlot(const std::string& roomName, const Room& room)
+    -> std::string
+{
+    discovery::Reservation reservation{
+        m_SlotIdGenerator(),
+        std::chrono::system_clock::now() + s_ReservationLifetime
+    };
+    auto token{ discovery::SignReservation(
+        reservation, discovery::TokenPurpose::Join, roomName,
+        m_ReservationKey) };
+
+    // every reservation has to reach the room, so nothing is coalesced
+    json notice = { { "token", token } };
+    m_ReservationWriter->Publish(discovery::ReservationsChannel(roomName),
+                                 notice.dump(), token);
+
+    auto reply{ room.AssignmentPrefix };
+    reply.reserve(reply.size() + token.size() + s_AssignmentSuffix.size());
+    reply.append(token).append(s_AssignmentSuffix);
+    return reply;
+}
+void EntryServer::ExpirePendingAssignments()
+{
+    auto now{ std::chrono::steady_clock::now() };
+    // queue is ordered by arrival, so expired ones are all at the front
+    while (!m_PendingAssignments.empty() &&
+           now - m_PendingAssignments.front().EnqueuedAt >=
+               s_AssignmentTimeout)
+    {
+        m_Interface->CloseConnection(m_PendingAssignments.front().Connection,
+                                     k_ESteamNetConnectionEnd_App_Generic,
+                                     "No free room", false);
+        m_Metrics.AddCounter("matchmaking.timed_out");
+        m_PendingAssignments.pop_front();
     }
 }
 void EntryServer::OnConnectionStatusChanged(
@@ -99,6 +492,7 @@ void EntryServer::OnConnectionStatusChanged(
     case k_ESteamNetworkingConnectionState_ClosedByPeer:
     {
         m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+        RemovePendingAssignment(info->m_hConn);
 
         std::cout << "Bro left to connect to room: "
                   << std::string{ info->m_info.m_szConnectionDescription }
@@ -108,6 +502,7 @@ void EntryServer::OnConnectionStatusChanged(
     case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
     {
         m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+        RemovePendingAssignment(info->m_hConn);
 
         std::cout << "Bro left with no game: "
                   << std::string{ info->m_info.m_szConnectionDescription }
@@ -127,32 +522,10 @@ void EntryServer::OnConnectionStatusChanged(
             break;
         }
 
-        // find room or die
-        while (m_Alive)
-        {
-            m_ServerMapMutex.lock();
-
-            auto suitableServerIt{ std::min_element(
-                m_AvailableServersMap.begin(), m_AvailableServersMap.end(),
-                [](auto a, auto b)
-                {
-                    return a.second["player_count"].template get<int32_t>() <
-                           b.second["player_count"].template get<int32_t>();
-                }) };
-
-            if (suitableServerIt != m_AvailableServersMap.end())
-            {
-                SendMessageToConnection(info->m_hConn,
-                                        suitableServerIt->second);
-                m_ServerMapMutex.unlock();
-                break;
-            }
-
-            m_ServerMapMutex.unlock();
-
-            std::cout << "No suitable server :( Retrying...\n";
-            std::this_thread::sleep_for(std::chrono::seconds{ 1 });
-        }
+        // park it, matcher will pick it up on this or one of the next ticks
+        m_PendingAssignments.push_back(
+            { info->m_hConn, std::chrono::steady_clock::now() });
+        m_HasNewPendingAssignments = true;
         break;
     }
     case k_ESteamNetworkingConnectionState_Connected:
@@ -162,4 +535,9 @@ void EntryServer::OnConnectionStatusChanged(
     }
     }
 }
+void EntryServer::RemovePendingAssignment(HSteamNetConnection connection)
+{
+    std::erase_if(m_PendingAssignments, [connection](const auto& pending)
+                  { return pending.Connection == connection; });
+}
 } // namespace smp::server
@@ -1,16 +1,25 @@
 #pragma once
+#include "Metrics.hpp"
+#include "Placement.hpp"
+#include "RedisWriter.hpp"
+#include "ReservationToken.hpp"
 #include "ServerBase.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <deque>
 #include <iostream>
 #include <iterator>
 #include <memory>
-#include <mutex>
+#include <random>
 #include <string>
+#include <string_view>
 #include <sw/redis++/redis++.h>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace smp::server
 {
@@ -19,6 +28,30 @@ using namespace sw;
 
 class EntryServer : public ServerBase
 {
+    struct Room
+    {
+        // endpoint, player_count and the latest heartbeat load report
+        json Info;
+        json Endpoint;
+        // serialized reply for clients sent here up to the token's value,
+        // the token and s_AssignmentSuffix complete it. Built by the
+        // discovery thread, only when the endpoint changes.
+        std::string AssignmentPrefix;
+        std::chrono::steady_clock::time_point LastHeartbeat;
+        RoomLoad Load;
+    };
+    // rooms are never changed once published, an update replaces the one
+    // room it touches and shares all others with the previous map
+    using ServerMap =
+        std::unordered_map<std::string, std::shared_ptr<const Room>>;
+
+    // accepted client still waiting for a room
+    struct PendingAssignment
+    {
+        HSteamNetConnection Connection;
+        std::chrono::steady_clock::time_point EnqueuedAt;
+    };
+
 public:
     EntryServer(const std::string& redisHost, int32_t redisPort);
 
@@ -26,15 +59,91 @@ public:
 
     void Run(const std::string& addrIpv4) override;
 
+    // periodically print assignments per second, for sizing replicas
+    void SetThroughputMode(bool enabled);
+    // used for rooms that don't report their own capacity
+    void SetDefaultRoomCapacity(int32_t capacity);
+    void SetPlacementScore(PlacementScore score);
+
 private:
     void OnConnectionStatusChanged(
         SteamNetConnectionStatusChangedCallback_t* info) override;
 
+    // loads one snapshot, then follows published updates
+    void RunDiscovery();
+    void ReconcileServerMap();
+    [[nodiscard]] auto LoadServerSnapshot() -> ServerMap;
+    [[nodiscard]] static auto
+    MakeAssignmentPrefix(const json& endpoint) -> std::string;
+    // drops rooms whose heartbeat is older than its ttl
+    void PruneExpiredRooms();
+    void UpdateRoomLoad(Room& room);
+    void ApplyServerUpdate(const json& update);
+    void PublishServerMap(std::shared_ptr<const ServerMap> servers);
+
+    // assigns all parked clients in one batch, runs on the loop thread
+    void MatchPendingAssignments();
+    void ExpirePendingAssignments();
+    void RemovePendingAssignment(HSteamNetConnection connection);
+
+    // reserves a slot in the room and tells it the client is coming,
+    // returns the reply for the client
+    [[nodiscard]] auto ReserveSlot(const std::string& roomName,
+                                   const Room& room) -> std::string;
+
+    void ReportThroughput(std::chrono::nanoseconds interval);
+
 private:
-    std::unique_ptr<std::thread> m_RedisPollThread{ nullptr };
-    std::unordered_map<std::string, json> m_AvailableServersMap;
+    static constexpr std::chrono::milliseconds s_SubscriberTimeout{ 200 };
+    static constexpr std::chrono::seconds s_ReconcileInterval{ 5 };
+    static constexpr std::chrono::seconds s_AssignmentTimeout{ 30 };
+    static constexpr std::chrono::seconds s_MetricsReportInterval{ 10 };
+    static constexpr std::chrono::seconds s_ThroughputReportInterval{ 1 };
+    // longest the loop waits for GNS, expiry and reports need it now and
+    // then. Parked clients wait for discovery, which can't wake GNS.
+    static constexpr std::chrono::milliseconds s_IdleWait{ 100 };
+    static constexpr std::chrono::milliseconds s_ParkedWait{ 1 };
+    static constexpr std::chrono::seconds s_ReservationLifetime{ 10 };
+    // closes the token string and the reply, see Room::AssignmentPrefix
+    static constexpr std::string_view s_AssignmentSuffix{ R"("})" };
+
+    std::unique_ptr<std::thread> m_DiscoveryThread{ nullptr };
+    // immutable snapshot, replaced as a whole by the discovery thread so
+    // readers never wait for redis or for each other
+    std::atomic<std::shared_ptr<const ServerMap>> m_AvailableServersMap{
+        std::make_shared<const ServerMap>()
+    };
     std::unique_ptr<redis::Redis> m_RedisClient;
-    std::mutex m_ServerMapMutex;
+    std::unique_ptr<redis::Redis> m_RedisSubscriberClient;
+    // reservations are published from its thread, never from the loop
+    std::unique_ptr<RedisWriter> m_ReservationWriter;
+    discovery::ReservationKey m_ReservationKey{
+        discovery::LoadReservationKey()
+    };
+    std::mt19937_64 m_SlotIdGenerator{ std::random_device{}() };
+    // bumped on every discovery change
+    std::atomic<uint64_t> m_ServerMapVersion{ 0 };
+    uint64_t m_MatchedServerMapVersion{ 0 };
+    // keeps growing across reloads, so placement tells every load apart.
+    // Only the discovery thread touches it.
+    uint64_t m_LoadRevision{ 0 };
+
+    int32_t m_DefaultRoomCapacity{ 16 };
+    PlacementEngine m_Placement;
+    // snapshot placement currently works on, m_PlacementRooms point into it
+    std::shared_ptr<const ServerMap> m_PlacementServers;
+    std::vector<std::pair<const std::string*, const Room*>> m_PlacementRooms;
+
+    std::deque<PendingAssignment> m_PendingAssignments;
+    bool m_HasNewPendingAssignments{ false };
+
+    metrics::Registry m_Metrics;
+    bool m_ThroughputMode{ false };
+    uint64_t m_IntervalAssignments{ 0 };
+    double m_PeakAssignmentsPerSecond{ 0 };
+    // busy time of every wakeup in microseconds, merged into m_Metrics when
+    // they are reported
+    metrics::Histogram m_WakeupTimes;
 };
 
 } // namespace smp::server
@@ -0,0 +1,131 @@
+#include "Placement.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+namespace smp::server
+{
+
+namespace placement
+{
+auto FillScore(const PlacementCandidate& candidate) -> std::optional<float>
+{
+    const auto& load{ *candidate.Load };
+    auto projected{ load.PlayerCount + candidate.InFlight };
+    if (load.Capacity <= 0 || projected >= load.Capacity)
+    {
+        return std::nullopt;
+    }
+
+    // reference budget is one 60 Hz tick
+    constexpr float tickBudgetUs{ 16667.F };
+    constexpr float tickWeight{ 2.F };
+    constexpr float hostWeight{ 0.5F };
+    // a join raises fill by 1/capacity, the burst term has to take back
+    // more than that or every join makes the room look better still
+    constexpr float burstWeight{ 2.F };
+
+    auto capacity{ static_cast<float>(load.Capacity) };
+    auto fill{ static_cast<float>(projected) / capacity };
+    auto burst{ static_cast<float>(candidate.WindowJoins) / capacity };
+    auto tickPressure{ std::clamp(load.TickP99Us / tickBudgetUs, 0.F, 1.F) };
+
+    return fill - tickWeight * tickPressure * tickPressure -
+           hostWeight * candidate.HostCpuShare - burstWeight * burst;
+}
+auto SpreadScore(const PlacementCandidate& candidate) -> std::optional<float>
+{
+    const auto& load{ *candidate.Load };
+    auto projected{ load.PlayerCount + candidate.InFlight };
+    if (load.Capacity <= 0 || projected >= load.Capacity)
+    {
+        return std::nullopt;
+    }
+    return -static_cast<float>(projected);
+}
+} // namespace placement
+
+PlacementEngine::PlacementEngine(PlacementScore score)
+    : m_Score{ std::move(score) }
+{
+}
+void PlacementEngine::SetScoreFunction(PlacementScore score)
+{
+    m_Score = std::move(score);
+}
+void PlacementEngine::Update(
+    const std::vector<std::pair<const std::string*, const RoomLoad*>>& rooms)
+{
+    m_Candidates.clear();
+    m_CandidateStates.clear();
+
+    std::unordered_map<std::string_view, float> hostCpuShares;
+    for (const auto& [name, load] : rooms)
+    {
+        hostCpuShares[load->Host] += load->CpuShare;
+    }
+
+    std::unordered_set<std::string_view> present;
+    for (const auto& [name, load] : rooms)
+    {
+        present.insert(*name);
+        auto& state{ m_States[*name] };
+
+        if (state.LastRevision != load->Revision)
+        {
+            // joins that made it to the room are not in flight anymore
+            auto arrived{ load->PlayerCount - state.LastPlayerCount };
+            for (; arrived > 0 && !state.InFlight.empty(); arrived--)
+            {
+                state.InFlight.pop_front();
+            }
+            state.LastPlayerCount = load->PlayerCount;
+            state.LastRevision = load->Revision;
+            state.WindowJoins = 0;
+        }
+
+        m_Candidates.push_back(
+            { load, static_cast<int32_t>(state.InFlight.size()),
+              state.WindowJoins, hostCpuShares[load->Host] });
+        m_CandidateStates.push_back(&state);
+    }
+
+    std::erase_if(m_States, [&present](const auto& statePair)
+                  { return present.count(statePair.first) == 0; });
+}
+auto PlacementEngine::Place(Clock::time_point now) -> std::optional<std::size_t>
+{
+    std::optional<std::size_t> best;
+    float bestScore{ 0 };
+
+    for (std::size_t i{ 0 }; i < m_Candidates.size(); i++)
+    {
+        auto& state{ *m_CandidateStates[i] };
+        auto& candidate{ m_Candidates[i] };
+
+        while (!state.InFlight.empty() &&
+               now - state.InFlight.front() > s_InFlightTimeout)
+        {
+            state.InFlight.pop_front();
+            candidate.InFlight--;
+        }
+
+        auto score{ m_Score(candidate) };
+        if (score.has_value() && (!best.has_value() || *score > bestScore))
+        {
+            best = i;
+            bestScore = *score;
+        }
+    }
+
+    if (best.has_value())
+    {
+        auto& state{ *m_CandidateStates[*best] };
+        state.InFlight.push_back(now);
+        state.WindowJoins++;
+        m_Candidates[*best].InFlight++;
+        m_Candidates[*best].WindowJoins++;
+    }
+    return best;
+}
+
+} // namespace smp::server
@@ -0,0 +1,93 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace smp::server
+{
+
+// what discovery knows about a room, parsed once per update so placement
+// never touches json
+struct RoomLoad
+{
+    std::string Host;
+    int32_t PlayerCount{ 0 };
+    int32_t Capacity{ 0 };
+    float TickP99Us{ 0 };
+    float CpuShare{ 0 };
+    // bumped on every discovery update of this room
+    uint64_t Revision{ 0 };
+};
+
+struct PlacementCandidate
+{
+    const RoomLoad* Load{ nullptr };
+    // sent here by us, but not visible in PlayerCount yet
+    int32_t InFlight{ 0 };
+    // sent here since the last discovery update of this room
+    int32_t WindowJoins{ 0 };
+    // summed cpu share of all rooms on the same host
+    float HostCpuShare{ 0 };
+};
+
+// higher is better, nullopt means the room must not get this player
+using PlacementScore =
+    std::function<std::optional<float>(const PlacementCandidate&)>;
+
+namespace placement
+{
+// packs players into the fullest room that still has headroom, so empty
+// rooms stay empty and can hibernate
+auto FillScore(const PlacementCandidate& candidate) -> std::optional<float>;
+// old behaviour: least loaded room first
+auto SpreadScore(const PlacementCandidate& candidate) -> std::optional<float>;
+} // namespace placement
+
+class PlacementEngine
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PlacementEngine(PlacementScore score = placement::FillScore);
+
+    void SetScoreFunction(PlacementScore score);
+
+    // takes a new discovery snapshot; pointers must stay valid until the
+    // next call. in-flight joins of rooms that are still there are kept
+    void Update(
+        const std::vector<std::pair<const std::string*, const RoomLoad*>>&
+            rooms);
+
+    // picks a room (index into the last Update) and accounts the join,
+    // nullopt when no room can take another player
+    [[nodiscard]] auto
+    Place(Clock::time_point now) -> std::optional<std::size_t>;
+
+private:
+    struct RoomState
+    {
+        std::deque<Clock::time_point> InFlight;
+        int32_t WindowJoins{ 0 };
+        int32_t LastPlayerCount{ 0 };
+        uint64_t LastRevision{ 0 };
+    };
+
+    // client that got a room but never showed up there
+    static constexpr std::chrono::seconds s_InFlightTimeout{ 5 };
+
+    PlacementScore m_Score;
+    std::vector<PlacementCandidate> m_Candidates;
+    // parallel to m_Candidates, unordered_map never moves its elements
+    std::vector<RoomState*> m_CandidateStates;
+    std::unordered_map<std::string, RoomState> m_States;
+};
+
+} // namespace smp::server
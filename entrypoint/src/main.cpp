@@ -1,22 +1,12 @@
+#include "DebugOutput.hpp"
 #include "EntryServer.hpp"
+#include "ReservationToken.hpp"
+#include <boost/program_options.hpp>
 #include <iostream>
 #include <sw/redis++/redis++.h>
 
 using namespace sw;
 
-static void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType,
-                        const char* pszMsg)
-{
-    printf(" %s\n", pszMsg);
-    fflush(stdout);
-    if (eType == k_ESteamNetworkingSocketsDebugOutputType_Bug)
-    {
-        fflush(stdout);
-        fflush(stderr);
-        std::abort();
-    }
-}
-
 auto main(int argc, char** argv) -> int
 {
     SteamDatagramErrMsg errMsg;
@@ -24,9 +14,80 @@ auto main(int argc, char** argv) -> int
     {
         std::cerr << "GameNetworkingSockets_Init failed.  " << errMsg << '\n';
     }
-    SteamNetworkingUtils()->SetDebugOutputFunction(
-        k_ESteamNetworkingSocketsDebugOutputType_Msg, DebugOutput);
+    smp::network::InstallDebugOutput();
+
+    namespace opts = boost::program_options;
+    std::string ipString{};
+    std::string portString{};
+    std::string placementName{};
+    int32_t roomCapacity{};
+    int32_t redisPort{};
+
+    opts::options_description optsDescription{ "Allowed options" };
+    // clang-format off
+    optsDescription.add_options()
+		("help,h", "display help")
+		("ip,a",
+		 opts::value<std::string>(&ipString)->default_value("127.0.0.1"),
+        "entry point ip address")
+		("port,p",
+		 opts::value<std::string>(&portString)->default_value("32232"),
+        "entry point port")
+		("placement",
+		 opts::value<std::string>(&placementName)->default_value("fill"),
+		 "room placement strategy: fill or spread")
+		("room-capacity",
+		 opts::value<int32_t>(&roomCapacity)->default_value(16),
+		 "capacity of rooms that don't report one")
+		("throughput,t", "report room assignments per second")
+		("redis-port",
+		 opts::value<int32_t>(&redisPort)->default_value(6379),
+		 "port of the discovery redis on 127.0.0.1")
+		("insecure-dev-secret",
+		 "sign tokens with a well known secret when SMP_RESERVATION_SECRET "
+		 "is not set, for local runs only");
+    // clang-format on
+
+    opts::variables_map vm;
+    try
+    {
+        opts::store(opts::parse_command_line(argc, argv, optsDescription), vm);
+        opts::notify(vm);
+    }
+    catch (const opts::error& e)
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << e.what() << std::endl;
+        return 0;
+    }
 
-    smp::server::EntryServer server{ "127.0.0.1", 6379 };
-    server.Run("127.0.0.1:32232");
+    if (vm.count("help"))
+    {
+        std::cout << optsDescription << std::endl;
+        return 0;
+    }
+
+    if (vm.count("insecure-dev-secret"))
+    {
+        smp::discovery::AllowInsecureDevSecret();
+    }
+    try
+    {
+        smp::discovery::LoadReservationKey();
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what()
+                  << ", pass --insecure-dev-secret for a local run\n";
+        return 1;
+    }
+
+    smp::server::EntryServer server{ "127.0.0.1", redisPort };
+    server.SetThroughputMode(vm.count("throughput") != 0);
+    server.SetDefaultRoomCapacity(roomCapacity);
+    if (placementName == "spread")
+    {
+        server.SetPlacementScore(smp::server::placement::SpreadScore);
+    }
+    server.Run(ipString + ":" + portString);
 }
@@ -0,0 +1,141 @@
+#include "Compression.hpp"
+#include "GameMap.hpp"
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+// Compiles JSON maps (the format of config*.json) into the binary format
+// servers memory-map on start, optionally with a compression dictionary
+// trained on messages a server recorded with --record-samples
+auto main(int argc, char** argv) -> int
+{
+    namespace opts = boost::program_options;
+    std::string inputPath;
+    std::string outputPath;
+    float cellSize{ smp::game::mapformat::DefaultCellSize };
+    std::vector<std::string> samplePaths;
+    std::size_t dictionarySize{ 8192 };
+
+    opts::options_description optsDescription{ "Allowed options" };
+    // clang-format off
+    optsDescription.add_options()
+		("help,h", "display help")
+		("input,i",
+		 opts::value<std::string>(&inputPath)->required(),
+		 "JSON map to compile")
+		("output,o",
+		 opts::value<std::string>(&outputPath)->required(),
+		 "where to write the compiled map")
+		("cell-size,s",
+		 opts::value<float>(&cellSize)->default_value(cellSize),
+		 "collision grid cell size in world units")
+		("samples",
+		 opts::value<std::vector<std::string>>(&samplePaths)->multitoken(),
+		 "recorded messages to train a compression dictionary on")
+		("dict-size",
+		 opts::value<std::size_t>(&dictionarySize)->default_value(dictionarySize),
+		 "maximum dictionary size in bytes");
+    // clang-format on
+
+    opts::variables_map vm;
+    try
+    {
+        opts::store(opts::parse_command_line(argc, argv, optsDescription), vm);
+        if (vm.count("help"))
+        {
+            std::cout << optsDescription << std::endl;
+            return 0;
+        }
+        opts::notify(vm);
+    }
+    catch (const opts::error& e)
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ifstream inputFile{ inputPath };
+    if (!inputFile.is_open())
+    {
+        std::cerr << "Could not open " << inputPath << '\n';
+        return 1;
+    }
+
+    std::vector<std::byte> dictionary;
+    if (!samplePaths.empty())
+    {
+        std::vector<std::string> samples;
+        try
+        {
+            for (const auto& samplePath : samplePaths)
+            {
+                std::ifstream sampleFile{ samplePath, std::ios::binary };
+                if (!sampleFile.is_open())
+                {
+                    std::cerr << "Could not open " << samplePath << '\n';
+                    return 1;
+                }
+                auto fileSamples{ smp::compression::ReadSamples(sampleFile) };
+                samples.insert(samples.end(),
+                               std::make_move_iterator(fileSamples.begin()),
+                               std::make_move_iterator(fileSamples.end()));
+            }
+            dictionary =
+                smp::compression::TrainDictionary(samples, dictionarySize);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        smp::compression::Compressor compressor{ dictionary };
+        std::cout << "Trained a " << dictionary.size()
+                  << " byte dictionary (id " << compressor.GetDictionaryId()
+                  << ") on " << samples.size() << " messages\n";
+    }
+
+    std::vector<std::byte> compiled;
+    try
+    {
+        compiled = smp::game::CompileMap(nlohmann::json::parse(inputFile),
+                                         cellSize, dictionary);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Could not compile " << inputPath << ": " << e.what()
+                  << '\n';
+        return 1;
+    }
+
+    std::ofstream outputFile{ outputPath, std::ios::binary | std::ios::trunc };
+    outputFile.write(reinterpret_cast<const char*>(compiled.data()),
+                     static_cast<std::streamsize>(compiled.size()));
+    if (!outputFile)
+    {
+        std::cerr << "Could not write " << outputPath << '\n';
+        return 1;
+    }
+    outputFile.close();
+
+    // load it back, so a broken map never leaves the compiler
+    try
+    {
+        auto loadStart{ std::chrono::steady_clock::now() };
+        auto map{ smp::game::GameMap::Load(outputPath) };
+        auto loadTime{ std::chrono::steady_clock::now() - loadStart };
+
+        std::cout << "Compiled " << map.GetWallCount() << " walls into "
+                  << compiled.size() << " bytes, loads in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(
+                         loadTime)
+                         .count()
+                  << "us\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Compiled map does not load: " << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,480 @@
+#include "RelayServer.hpp"
+#include "TickScheduler.hpp"
+#include <array>
+#include <iostream>
+#include <utility>
+
+namespace smp::relay
+{
+
+RelayServer::RelayServer(std::string upstreamAddr,
+                         std::chrono::milliseconds delay,
+                         std::size_t maxSpectators)
+    : m_UpstreamAddr{ std::move(upstreamAddr) },
+      m_Delay{ delay },
+      m_MaxSpectators{ maxSpectators }
+{
+}
+
+RelayServer::~RelayServer()
+{
+    if (m_Interface != nullptr)
+    {
+        for (auto connection : m_Spectators)
+        {
+            m_Interface->CloseConnection(connection, 0, nullptr, false);
+        }
+        for (auto connection : m_WaitingSpectators)
+        {
+            m_Interface->CloseConnection(connection, 0, nullptr, false);
+        }
+        for (auto pendingPair : m_PendingJoins)
+        {
+            m_Interface->CloseConnection(pendingPair.first, 0, nullptr, false);
+        }
+        m_Interface->CloseConnection(m_Upstream, 0, nullptr, false);
+        m_Interface->DestroyPollGroup(m_PollGroup);
+    }
+    m_PollGroup = k_HSteamNetPollGroup_Invalid;
+}
+
+void RelayServer::Run(const std::string& addrIpv4)
+{
+    InitConnection(addrIpv4);
+
+    m_PollGroup = m_Interface->CreatePollGroup();
+    if (m_PollGroup == k_HSteamNetPollGroup_Invalid)
+    {
+        std::cerr << "Failed to listen on " << addrIpv4 << '\n';
+        return;
+    }
+    if (!ConnectUpstream())
+    {
+        return;
+    }
+
+    m_LastReport = Clock::now();
+    while (m_Alive)
+    {
+        auto now{ Clock::now() };
+
+        PollConnectionStateChanges();
+        ReceiveUpstream();
+        ReleaseDelayed(now);
+        RefreshKeyframe(now);
+        ReceiveDownstream();
+        ExpirePendingJoins(now);
+        ReportIfDue(now);
+
+        server::TickScheduler::SleepUntil(now + s_PollInterval);
+    }
+}
+void RelayServer::Stop()
+{
+    m_Alive = false;
+}
+
+auto RelayServer::ConnectUpstream() -> bool
+{
+    SteamNetworkingIPAddr upstreamAddr{};
+    upstreamAddr.Clear();
+    if (!upstreamAddr.ParseString(m_UpstreamAddr.c_str()))
+    {
+        std::cerr << "Bad upstream address " << m_UpstreamAddr << '\n';
+        return false;
+    }
+
+    SteamNetworkingConfigValue_t opt{};
+    opt.SetPtr(
+        k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged,
+        reinterpret_cast<void*>(SteamNetConnectionStatusChangedCallback));
+    m_Upstream = m_Interface->ConnectByIPAddress(upstreamAddr, 1, &opt);
+    if (m_Upstream == k_HSteamNetConnection_Invalid)
+    {
+        std::cerr << "Failed to connect to " << m_UpstreamAddr << '\n';
+        return false;
+    }
+
+    // queued until the connection is up, same as any spectator
+    json joinMessage = { { "type", "join" },
+                         { "payload", { { "spectator", true } } } };
+    SendMessageToConnection(m_Upstream, joinMessage);
+    std::cout << "Relaying " << m_UpstreamAddr << " with "
+              << m_Delay.count() << "ms delay\n";
+    return true;
+}
+
+void RelayServer::FollowRedirect(const json& payload)
+{
+    m_Interface->CloseConnection(m_Upstream,
+                                 k_ESteamNetConnectionEnd_App_Generic,
+                                 "Redirected", false);
+    m_UpstreamAddr = payload["ip"].template get<std::string>() + ":" +
+                     std::to_string(payload["port"].template get<int32_t>());
+    if (!ConnectUpstream())
+    {
+        m_Alive = false;
+    }
+}
+
+void RelayServer::ReceiveUpstream()
+{
+    std::array<ISteamNetworkingMessage*, s_ReceiveBatchSize> messages{};
+    while (m_Alive)
+    {
+        auto numMessages{ m_Interface->ReceiveMessagesOnConnection(
+            m_Upstream, messages.data(), s_ReceiveBatchSize) };
+        if (numMessages <= 0)
+        {
+            break;
+        }
+
+        auto arrival{ Clock::now() };
+        for (int32_t idx{ 0 }; idx < numMessages; idx++)
+        {
+            auto* message{ messages[idx] };
+            const auto* data{ static_cast<const char*>(message->m_pData) };
+            auto stream{ StreamMessage{
+                std::make_shared<const std::string>(data,
+                                                    message->m_cbSize),
+                message->m_nFlags & k_nSteamNetworkingSend_Reliable } };
+            message->Release();
+
+            auto messageJson{ json::parse(*stream.Data, nullptr, false) };
+            if (messageJson.is_discarded() || !messageJson.contains("type"))
+            {
+                continue;
+            }
+
+            const auto& type{
+                messageJson["type"].template get_ref<const std::string&>()
+            };
+            if (type == "redirect")
+            {
+                FollowRedirect(messageJson["payload"]);
+                continue;
+            }
+            if (type == "session")
+            {
+                // answer to our own request, never part of the stream
+                m_SessionMessage = std::move(stream.Data);
+                continue;
+            }
+            if (type == "greeting" && m_SessionHash.empty())
+            {
+                // the map is fetched right away, spectators will ask us
+                m_SessionHash = messageJson["payload"]["session_hash"]
+                                    .template get<std::string>();
+                json request = {
+                    { "type", "session_request" },
+                    { "payload", { { "hash", m_SessionHash } } }
+                };
+                SendMessageToConnection(m_Upstream, request);
+            }
+
+            m_Delayed.push_back(
+                { arrival + m_Delay, std::move(messageJson), stream });
+        }
+
+        if (numMessages < s_ReceiveBatchSize)
+        {
+            break;
+        }
+    }
+}
+
+void RelayServer::ReleaseDelayed(Clock::time_point now)
+{
+    while (!m_Delayed.empty() && m_Delayed.front().ReleaseAt <= now)
+    {
+        auto delayed{ std::move(m_Delayed.front()) };
+        m_Delayed.pop_front();
+
+        ApplyToWorld(delayed.Message);
+        if (delayed.Message["type"] == "greeting")
+        {
+            // seeds the world, spectators get our own keyframes instead
+            m_GreetingReleased = true;
+            continue;
+        }
+        m_SinceKeyframe.push_back(delayed.Stream);
+        Broadcast(delayed.Stream);
+    }
+}
+
+void RelayServer::ApplyToWorld(const json& message)
+{
+    const auto& type{ message["type"].template get_ref<const std::string&>() };
+    const auto& payload{ message["payload"] };
+
+    if (type == "greeting")
+    {
+        m_Players.clear();
+        m_Bullets.clear();
+        for (const auto& player : payload["players"])
+        {
+            m_Players[player["id"].template get<IdType>()] = player;
+        }
+        for (const auto& bullet : payload["bullets"])
+        {
+            m_Bullets[bullet["id"].template get<IdType>()] = bullet;
+        }
+    }
+    else if (type == "coords")
+    {
+        auto id{ payload["id"].template get<IdType>() };
+        auto entityIt{ m_Players.find(id) };
+        if (entityIt == m_Players.end())
+        {
+            entityIt = m_Bullets.find(id);
+            if (entityIt == m_Bullets.end())
+            {
+                return;
+            }
+        }
+        entityIt->second["x"] = payload["x"];
+        entityIt->second["y"] = payload["y"];
+    }
+    else if (type == "connection")
+    {
+        m_Players[payload["id"].template get<IdType>()] = payload;
+    }
+    else if (type == "shoot")
+    {
+        auto id{ payload["bullet_id"].template get<IdType>() };
+        m_Bullets[id] = { { "id", id },
+                          { "x", payload["bullet_x"] },
+                          { "y", payload["bullet_y"] },
+                          { "shooter_id", payload["shooter_id"] },
+                          { "target_x", payload["target_x"] },
+                          { "target_y", payload["target_y"] } };
+    }
+    else if (type == "destroy")
+    {
+        auto id{ payload["id"].template get<IdType>() };
+        m_Players.erase(id);
+        m_Bullets.erase(id);
+    }
+}
+
+void RelayServer::Broadcast(const StreamMessage& message)
+{
+    m_MessagesRelayed++;
+    for (auto connection : m_Spectators)
+    {
+        SendMessageToConnection(connection, *message.Data, message.SendFlags);
+    }
+}
+
+void RelayServer::ReceiveDownstream()
+{
+    std::array<ISteamNetworkingMessage*, s_ReceiveBatchSize> messages{};
+    auto numMessages{ m_Interface->ReceiveMessagesOnPollGroup(
+        m_PollGroup, messages.data(), s_ReceiveBatchSize) };
+    for (int32_t idx{ 0 }; idx < numMessages; idx++)
+    {
+        auto* message{ messages[idx] };
+        const auto* data{ static_cast<const char*>(message->m_pData) };
+        auto messageJson{ json::parse(data, data + message->m_cbSize, nullptr,
+                                      false) };
+        auto connection{ message->m_conn };
+        message->Release();
+
+        if (messageJson.is_discarded() || !messageJson.contains("type"))
+        {
+            continue;
+        }
+        const auto& type{
+            messageJson["type"].template get_ref<const std::string&>()
+        };
+        if (type == "join")
+        {
+            HandleJoin(connection, messageJson["payload"]);
+        }
+        else if (type == "session_request" &&
+                 m_Spectators.contains(connection) &&
+                 m_SessionMessage != nullptr)
+        {
+            SendMessageToConnection(connection, *m_SessionMessage);
+        }
+        // anything else would be input, spectators have none
+    }
+}
+
+void RelayServer::HandleJoin(HSteamNetConnection connection,
+                             const json& payload)
+{
+    if (m_PendingJoins.erase(connection) == 0)
+    {
+        return;
+    }
+    if (!payload.value("spectator", false))
+    {
+        m_Interface->CloseConnection(connection,
+                                     k_ESteamNetConnectionEnd_App_Generic,
+                                     "Relays only take spectators", false);
+        return;
+    }
+    if (m_Spectators.size() + m_WaitingSpectators.size() >= m_MaxSpectators)
+    {
+        m_Interface->CloseConnection(connection,
+                                     k_ESteamNetConnectionEnd_App_Generic,
+                                     "Relay is full", false);
+        std::cout << "Relay is full, rejecting spectator\n";
+        return;
+    }
+
+    if (!IsReady())
+    {
+        m_WaitingSpectators.push_back(connection);
+        return;
+    }
+    ServeSpectator(connection);
+}
+
+void RelayServer::ServeSpectator(HSteamNetConnection connection)
+{
+    // reliable even for updates that were unreliable live, the catch up has
+    // to arrive in order to make sense
+    SendMessageToConnection(connection, m_Keyframe);
+    for (const auto& message : m_SinceKeyframe)
+    {
+        SendMessageToConnection(connection, *message.Data);
+    }
+    m_Spectators.insert(connection);
+}
+
+void RelayServer::ExpirePendingJoins(Clock::time_point now)
+{
+    std::erase_if(m_PendingJoins,
+                  [this, now](const auto& pair)
+                  {
+                      if (now - pair.second < s_JoinTimeout)
+                      {
+                          return false;
+                      }
+                      m_Interface->CloseConnection(
+                          pair.first, k_ESteamNetConnectionEnd_App_Generic,
+                          "No join message", false);
+                      return true;
+                  });
+}
+
+void RelayServer::RefreshKeyframe(Clock::time_point now)
+{
+    if (!m_GreetingReleased || m_SessionMessage == nullptr)
+    {
+        return;
+    }
+    if (!m_Keyframe.empty() && now - m_KeyframeTime < s_KeyframeInterval)
+    {
+        return;
+    }
+
+    // a fresh keyframe makes the catch up log obsolete
+    m_Keyframe = BuildKeyframe();
+    m_KeyframeTime = now;
+    m_SinceKeyframe.clear();
+
+    for (auto connection : m_WaitingSpectators)
+    {
+        ServeSpectator(connection);
+    }
+    m_WaitingSpectators.clear();
+}
+
+auto RelayServer::BuildKeyframe() const -> std::string
+{
+    auto players{ json::array() };
+    for (const auto& [id, player] : m_Players)
+    {
+        players.push_back(player);
+    }
+    auto bullets{ json::array() };
+    for (const auto& [id, bullet] : m_Bullets)
+    {
+        bullets.push_back(bullet);
+    }
+
+    json keyframe = { { "type", "greeting" },
+                      { "payload",
+                        { { "session_hash", m_SessionHash },
+                          { "players", std::move(players) },
+                          { "bullets", std::move(bullets) } } } };
+    return keyframe.dump();
+}
+
+auto RelayServer::IsReady() const -> bool
+{
+    return !m_Keyframe.empty();
+}
+
+void RelayServer::ReportIfDue(Clock::time_point now)
+{
+    if (now - m_LastReport < s_ReportInterval)
+    {
+        return;
+    }
+    auto seconds{ std::chrono::duration<double>{ now - m_LastReport }.count() };
+    auto bytesSent{ m_BytesSent.load(std::memory_order_relaxed) };
+
+    std::cout << "Relay: " << m_Spectators.size() << " spectators, "
+              << static_cast<double>(m_MessagesRelayed) / seconds
+              << " msg/s relayed, "
+              << static_cast<double>(bytesSent - m_LastBytesSent) / seconds
+              << " B/s out, " << m_Delayed.size() << " held back\n";
+
+    m_LastReport = now;
+    m_MessagesRelayed = 0;
+    m_LastBytesSent = bytesSent;
+}
+
+void RelayServer::OnConnectionStatusChanged(
+    SteamNetConnectionStatusChangedCallback_t* info)
+{
+    if (info->m_hConn == m_Upstream)
+    {
+        if (info->m_info.m_eState ==
+                k_ESteamNetworkingConnectionState_ClosedByPeer ||
+            info->m_info.m_eState ==
+                k_ESteamNetworkingConnectionState_ProblemDetectedLocally)
+        {
+            // without a source there is nothing to relay
+            std::cerr << "Lost upstream: " << info->m_info.m_szEndDebug
+                      << '\n';
+            m_Alive = false;
+        }
+        return;
+    }
+
+    switch (info->m_info.m_eState)
+    {
+    case k_ESteamNetworkingConnectionState_ClosedByPeer:
+    case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
+    {
+        m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+        m_PendingJoins.erase(info->m_hConn);
+        m_Spectators.erase(info->m_hConn);
+        std::erase(m_WaitingSpectators, info->m_hConn);
+        break;
+    }
+    case k_ESteamNetworkingConnectionState_Connecting:
+    {
+        if (m_Interface->AcceptConnection(info->m_hConn) != k_EResultOK ||
+            !m_Interface->SetConnectionPollGroup(info->m_hConn, m_PollGroup))
+        {
+            m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+            std::cout << "Could not accept spectator\n";
+            break;
+        }
+        m_PendingJoins[info->m_hConn] = Clock::now();
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+} // namespace smp::relay
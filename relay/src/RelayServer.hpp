@@ -0,0 +1,118 @@
+#pragma once
+#include "ServerBase.hpp"
+#include "Typedefs.hpp"
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace smp::relay
+{
+
+using json = nlohmann::json;
+
+// Watches one room as a single spectator and fans its outbound stream out
+// to many read-only spectators. Downstream it speaks the same spectator
+// protocol as a GameServer (join with "spectator", greeting, session
+// request), so relays chain: the upstream may be another relay.
+//
+// The stream can be held back by a fixed delay. Late joiners get a keyframe
+// of the (delayed) world built from the stream itself, plus everything
+// released since that keyframe, and then continue live.
+class RelayServer : public server::ServerBase
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RelayServer(std::string upstreamAddr, std::chrono::milliseconds delay,
+                std::size_t maxSpectators);
+    virtual ~RelayServer();
+
+    void Run(const std::string& addrIpv4) override;
+    // safe to call from a signal handler
+    void Stop();
+
+private:
+    struct StreamMessage
+    {
+        std::shared_ptr<const std::string> Data;
+        int32_t SendFlags;
+    };
+
+    struct DelayedMessage
+    {
+        Clock::time_point ReleaseAt;
+        json Message;
+        StreamMessage Stream;
+    };
+
+    auto ConnectUpstream() -> bool;
+    // the room moved to another server, ids are kept so the stream just
+    // continues from there
+    void FollowRedirect(const json& payload);
+    void ReceiveUpstream();
+    void ReleaseDelayed(Clock::time_point now);
+    // keeps the world the keyframes are built from in sync with the stream
+    void ApplyToWorld(const json& message);
+    void Broadcast(const StreamMessage& message);
+
+    void ReceiveDownstream();
+    void HandleJoin(HSteamNetConnection connection, const json& payload);
+    // keyframe, then what happened since it
+    void ServeSpectator(HSteamNetConnection connection);
+    void ExpirePendingJoins(Clock::time_point now);
+    void RefreshKeyframe(Clock::time_point now);
+    [[nodiscard]] auto BuildKeyframe() const -> std::string;
+    [[nodiscard]] auto IsReady() const -> bool;
+
+    void ReportIfDue(Clock::time_point now);
+
+    void OnConnectionStatusChanged(
+        SteamNetConnectionStatusChangedCallback_t* info) override;
+
+private:
+    static constexpr std::chrono::microseconds s_PollInterval{ 1000 };
+    static constexpr std::chrono::seconds s_KeyframeInterval{ 1 };
+    static constexpr std::chrono::seconds s_JoinTimeout{ 5 };
+    static constexpr std::chrono::seconds s_ReportInterval{ 10 };
+    static constexpr int32_t s_ReceiveBatchSize{ 64 };
+
+    std::string m_UpstreamAddr;
+    std::chrono::milliseconds m_Delay;
+    std::size_t m_MaxSpectators;
+
+    HSteamNetConnection m_Upstream{ k_HSteamNetConnection_Invalid };
+    HSteamNetPollGroup m_PollGroup{ k_HSteamNetPollGroup_Invalid };
+
+    std::unordered_map<HSteamNetConnection, Clock::time_point>
+        m_PendingJoins;
+    std::unordered_set<HSteamNetConnection> m_Spectators;
+    // joined before we had a keyframe to give them
+    std::vector<HSteamNetConnection> m_WaitingSpectators;
+
+    // forwarded byte for byte, so its hash still matches the greeting's
+    std::shared_ptr<const std::string> m_SessionMessage;
+    std::string m_SessionHash;
+    bool m_GreetingReleased{ false };
+
+    std::deque<DelayedMessage> m_Delayed;
+    // world as of the released stream, entity json as greetings carry it
+    std::map<IdType, json> m_Players;
+    std::map<IdType, json> m_Bullets;
+
+    std::string m_Keyframe;
+    Clock::time_point m_KeyframeTime;
+    std::vector<StreamMessage> m_SinceKeyframe;
+
+    Clock::time_point m_LastReport;
+    uint64_t m_MessagesRelayed{ 0 };
+    uint64_t m_LastBytesSent{ 0 };
+};
+
+} // namespace smp::relay
@@ -0,0 +1,85 @@
+#include "DebugOutput.hpp"
+#include "RelayServer.hpp"
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <steam/isteamnetworkingutils.h>
+#include <steam/steamnetworkingsockets.h>
+
+std::function<void(int)> ShutdownHandler = [](int) {};
+
+void SignalHandler(int sig)
+{
+    ShutdownHandler(sig);
+}
+
+auto main(int argc, char** argv) -> int
+{
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
+
+    SteamDatagramErrMsg errMsg;
+    if (!GameNetworkingSockets_Init(nullptr, errMsg))
+    {
+        std::cerr << "GameNetworkingSockets_Init failed.  " << errMsg << '\n';
+    }
+    smp::network::InstallDebugOutput();
+
+    namespace opts = boost::program_options;
+    std::string upstreamAddr{};
+    std::string ipString{};
+    std::string portString{};
+    uint32_t delayMs{};
+    std::size_t maxSpectators{};
+
+    opts::options_description optsDescription{ "Allowed options" };
+    // clang-format off
+    optsDescription.add_options()
+		("help,h", "display help")
+		("upstream,u",
+		 opts::value<std::string>(&upstreamAddr)->required(),
+		 "room or relay to watch, ip:port")
+		("ip,a",
+		 opts::value<std::string>(&ipString)->default_value("127.0.0.1"),
+		 "relay ip address")
+		("port,p",
+		 opts::value<std::string>(&portString)->required(),
+		 "relay port")
+		("delay,d",
+		 opts::value<uint32_t>(&delayMs)->default_value(0),
+		 "milliseconds to hold the stream back")
+		("max-spectators,m",
+		 opts::value<std::size_t>(&maxSpectators)->default_value(256),
+		 "spectators served by this relay, chain relays for more");
+    // clang-format on
+
+    opts::variables_map vm;
+    try
+    {
+        opts::store(opts::parse_command_line(argc, argv, optsDescription), vm);
+        opts::notify(vm);
+    }
+    catch (const opts::required_option& e)
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << e.what() << std::endl;
+        return 0;
+    }
+
+    if (vm.count("help"))
+    {
+        std::cout << optsDescription << std::endl;
+        return 0;
+    }
+
+    smp::relay::RelayServer relay{ upstreamAddr,
+                                   std::chrono::milliseconds{ delayMs },
+                                   maxSpectators };
+
+    ShutdownHandler = [&relay](int) { relay.Stop(); };
+
+    relay.Run(ipString + ":" + portString);
+}
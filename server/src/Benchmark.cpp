@@ -0,0 +1,244 @@
+#include "Benchmark.hpp"
+#include "BulletPool.hpp"
+#include "Components.hpp"
+#include "Histogram.hpp"
+#include "ServerBase.hpp"
+#include <algorithm>
+#include <chrono>
+#include <entt/entt.hpp>
+#include <iostream>
+#include <random>
+#include <raymath.h>
+#include <vector>
+
+namespace smp::server
+{
+
+namespace
+{
+
+constexpr uint32_t s_PlayerCount{ 16 };
+constexpr float s_FrameTime{ ServerBase::TickTimeMicroseconds * 1e-6F };
+
+struct Shot
+{
+    IdType Shooter;
+    Vector2 Position;
+    Vector2 Velocity;
+};
+
+struct RunStats
+{
+    metrics::Histogram TickTimes;
+    uint64_t Shots{ 0 };
+    uint64_t Hits{ 0 };
+};
+
+// a random player fires in a random direction, like HandleInput does
+class Gunfire
+{
+public:
+    Gunfire(const game::SessionOptions& options,
+            const std::vector<BulletTarget>& players)
+        : m_Options{ options },
+          m_Players{ players }
+    {
+    }
+
+    auto Next() -> Shot
+    {
+        const auto& shooter{ m_Players[m_PlayerDist(m_Random)] };
+        auto direction{ Vector2Normalize(
+            { m_DirDist(m_Random), m_DirDist(m_Random) }) };
+        return { shooter.Id,
+                 Vector2Add(shooter.NextPosition,
+                            Vector2Scale(direction, m_Options.PlayerRadius)),
+                 Vector2Scale(direction, m_Options.BulletSpeed) };
+    }
+
+private:
+    const game::SessionOptions& m_Options;
+    const std::vector<BulletTarget>& m_Players;
+    std::mt19937 m_Random{ 7 };
+    std::uniform_int_distribution<std::size_t> m_PlayerDist{
+        0, s_PlayerCount - 1
+    };
+    std::uniform_real_distribution<float> m_DirDist{ -1, 1 };
+};
+
+auto RunPool(const game::GameMap& map, const game::SessionOptions& options,
+             std::vector<BulletTarget> players, uint32_t bulletCount,
+             uint32_t tickCount) -> RunStats
+{
+    RunStats stats;
+    BulletPool bullets{ bulletCount };
+    Gunfire gunfire{ options, players };
+    std::vector<BulletHit> hits;
+    for (uint32_t tick{ 0 }; tick < tickCount; tick++)
+    {
+        auto tickStart{ std::chrono::steady_clock::now() };
+
+        while (bullets.GetSize() < bulletCount)
+        {
+            auto shot{ gunfire.Next() };
+            bullets.Spawn(shot.Shooter, shot.Position, shot.Velocity);
+            stats.Shots++;
+        }
+        for (auto& player : players)
+        {
+            player.Hit = false;
+        }
+        hits.clear();
+        StepBullets(bullets, map, options, players, s_FrameTime, hits);
+
+        stats.TickTimes.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - tickStart)
+                .count()));
+        stats.Hits += hits.size();
+    }
+    return stats;
+}
+
+// the bullet pass as it was before BulletPool, one entity per bullet
+auto RunRegistry(const game::GameMap& map, game::SessionOptions options,
+                 const std::vector<BulletTarget>& players,
+                 uint32_t bulletCount, uint32_t tickCount) -> RunStats
+{
+    RunStats stats;
+    entt::basic_registry<IdType> registry;
+    std::vector<BulletTarget> playerIds;
+    for (const auto& player : players)
+    {
+        auto entity{ registry.create() };
+        registry.emplace<game::CircleCollider>(entity, player.NextPosition,
+                                               options.PlayerRadius);
+        registry.emplace<game::PlayerTag>(entity);
+        playerIds.push_back({ entity, player.NextPosition });
+    }
+    Gunfire gunfire{ options, playerIds };
+
+    auto collideWithWalls{ [&](game::CircleCollider& collider)
+                           {
+                               auto center{ collider.GetNextPosition(
+                                   s_FrameTime) };
+                               auto radius{ collider.GetRadius() };
+                               bool collided{ false };
+                               map.ForEachWallNear(
+                                   { center.x - radius, center.y - radius },
+                                   { center.x + radius, center.y + radius },
+                                   [&](uint32_t wallIdx)
+                                   {
+                                       collided =
+                                           game::collider::CollideCircleLine(
+                                               collider,
+                                               options.Walls[wallIdx].Collider,
+                                               s_FrameTime);
+                                       return collided;
+                                   });
+                               return collided;
+                           } };
+
+    std::size_t liveBullets{ 0 };
+    for (uint32_t tick{ 0 }; tick < tickCount; tick++)
+    {
+        auto tickStart{ std::chrono::steady_clock::now() };
+
+        for (; liveBullets < bulletCount; liveBullets++)
+        {
+            auto shot{ gunfire.Next() };
+            auto bullet{ registry.create() };
+            auto& collider{ registry.emplace<game::CircleCollider>(
+                bullet, shot.Position, options.BulletRadius) };
+            collider.SetVelocity(shot.Velocity);
+            registry.emplace<game::BulletTag>(bullet, shot.Shooter);
+            stats.Shots++;
+        }
+
+        auto bulletsView{
+            registry.view<game::BulletTag, game::CircleCollider>()
+        };
+        auto playersView{
+            registry.view<game::PlayerTag, game::CircleCollider>()
+        };
+        for (auto&& [bullet, bulletTag, bulletCollider] : bulletsView.each())
+        {
+            bool hit{ collideWithWalls(bulletCollider) };
+            for (auto&& [player, playerCollider] : playersView.each())
+            {
+                if (hit)
+                {
+                    break;
+                }
+                if (player != bulletTag.ShooterId)
+                {
+                    hit = game::collider::CollideCircles(
+                        playerCollider, bulletCollider, s_FrameTime);
+                }
+            }
+            if (hit)
+            {
+                registry.destroy(bullet);
+                liveBullets--;
+                stats.Hits++;
+                continue;
+            }
+            bulletCollider.SetPosition(
+                bulletCollider.GetNextPosition(s_FrameTime));
+        }
+
+        stats.TickTimes.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - tickStart)
+                .count()));
+    }
+    return stats;
+}
+
+void PrintStats(const char* name, const RunStats& stats, uint32_t tickCount)
+{
+    auto toMicroseconds{ [](double nanoseconds) { return nanoseconds / 1e3; } };
+    std::cout << "  " << name << " tick cpu us: mean "
+              << toMicroseconds(stats.TickTimes.GetMean()) << ", p50 "
+              << toMicroseconds(
+                     static_cast<double>(stats.TickTimes.GetPercentile(50)))
+              << ", p99 "
+              << toMicroseconds(
+                     static_cast<double>(stats.TickTimes.GetPercentile(99)))
+              << ", max "
+              << toMicroseconds(static_cast<double>(stats.TickTimes.GetMax()))
+              << ", shots per tick "
+              << static_cast<double>(stats.Shots) / tickCount << ", hits "
+              << stats.Hits << '\n';
+}
+
+} // namespace
+
+void RunBulletBenchmark(const game::GameMap& map, uint32_t bulletCount,
+                        uint32_t tickCount)
+{
+    bulletCount = std::min(bulletCount, BulletPool::MaxCapacity);
+    tickCount = std::max(tickCount, 1U);
+    auto options{ map.GetOptions() };
+
+    // players stand still, only bullets move
+    std::mt19937 random{ 42 };
+    std::uniform_real_distribution<float> xDist{ 0, options.WorldWidth };
+    std::uniform_real_distribution<float> yDist{ 0, options.WorldHeight };
+    std::vector<BulletTarget> players;
+    for (uint32_t i{ 0 }; i < s_PlayerCount; i++)
+    {
+        players.push_back({ i, { xDist(random), yDist(random) } });
+    }
+
+    std::cout << "Bullet benchmark: " << bulletCount << " live bullets, "
+              << s_PlayerCount << " players, " << tickCount << " ticks\n";
+    PrintStats("pool",
+               RunPool(map, options, players, bulletCount, tickCount),
+               tickCount);
+    PrintStats("registry",
+               RunRegistry(map, options, players, bulletCount, tickCount),
+               tickCount);
+}
+
+} // namespace smp::server
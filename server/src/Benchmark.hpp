@@ -0,0 +1,15 @@
+#pragma once
+#include "GameMap.hpp"
+#include <cstdint>
+
+namespace smp::server
+{
+
+// Sustained fire on the given map without networking: standing players
+// shoot every tick, so bulletCount bullets are always in flight. The bullet
+// pass runs on the BulletPool and, for comparison, on registry entities the
+// way it was done before. Prints tick CPU time percentiles of both.
+void RunBulletBenchmark(const game::GameMap& map, uint32_t bulletCount,
+                        uint32_t tickCount);
+
+} // namespace smp::server
@@ -0,0 +1,217 @@
+#include "BulletPool.hpp"
+#include <cassert>
+#include <raymath.h>
+
+namespace smp::server
+{
+
+BulletPool::BulletPool(uint32_t capacity)
+    : m_Capacity{ capacity },
+      m_DenseIndices(capacity, s_NoBullet),
+      m_Generations(capacity, 0),
+      m_FreeSlots(capacity)
+{
+    assert(capacity <= MaxCapacity);
+    m_Ids.reserve(capacity);
+    m_Shooters.reserve(capacity);
+    m_Positions.reserve(capacity);
+    m_Velocities.reserve(capacity);
+    for (uint32_t slot{ 0 }; slot < capacity; slot++)
+    {
+        PushFreeSlot(slot);
+    }
+}
+auto BulletPool::Spawn(IdType shooterId, Vector2 position, Vector2 velocity)
+    -> std::optional<IdType>
+{
+    if (m_FreeSlotsStale)
+    {
+        RebuildFreeSlots();
+    }
+    if (m_FreeCount == 0)
+    {
+        return std::nullopt;
+    }
+    auto slot{ m_FreeSlots[m_FreeHead] };
+    m_FreeHead = (m_FreeHead + 1) % m_Capacity;
+    m_FreeCount--;
+
+    auto id{ MakeId(slot) };
+    m_DenseIndices[slot] = static_cast<uint32_t>(m_Ids.size());
+    m_Ids.push_back(id);
+    m_Shooters.push_back(shooterId);
+    m_Positions.push_back(position);
+    m_Velocities.push_back(velocity);
+    return id;
+}
+auto BulletPool::Insert(IdType id, IdType shooterId, Vector2 position,
+                        Vector2 velocity) -> bool
+{
+    auto index{ id & s_IndexMask };
+    auto generation{ id >> s_IndexBits };
+    if (index < FirstIndex || index - FirstIndex >= m_Capacity ||
+        generation >= s_GenerationCount)
+    {
+        return false;
+    }
+    auto slot{ index - FirstIndex };
+    if (m_DenseIndices[slot] != s_NoBullet)
+    {
+        return false;
+    }
+
+    m_Generations[slot] = static_cast<uint16_t>(generation);
+    m_DenseIndices[slot] = static_cast<uint32_t>(m_Ids.size());
+    m_Ids.push_back(id);
+    m_Shooters.push_back(shooterId);
+    m_Positions.push_back(position);
+    m_Velocities.push_back(velocity);
+    m_FreeSlotsStale = true;
+    return true;
+}
+void BulletPool::RemoveAt(std::size_t index)
+{
+    assert(index < m_Ids.size());
+    auto slot{ (m_Ids[index] & s_IndexMask) - FirstIndex };
+    auto last{ m_Ids.size() - 1 };
+    if (index != last)
+    {
+        m_Ids[index] = m_Ids[last];
+        m_Shooters[index] = m_Shooters[last];
+        m_Positions[index] = m_Positions[last];
+        m_Velocities[index] = m_Velocities[last];
+        m_DenseIndices[(m_Ids[index] & s_IndexMask) - FirstIndex] =
+            static_cast<uint32_t>(index);
+    }
+    m_Ids.pop_back();
+    m_Shooters.pop_back();
+    m_Positions.pop_back();
+    m_Velocities.pop_back();
+
+    m_DenseIndices[slot] = s_NoBullet;
+    m_Generations[slot] =
+        static_cast<uint16_t>((m_Generations[slot] + 1) % s_GenerationCount);
+    PushFreeSlot(slot);
+}
+auto BulletPool::GetSize() const -> std::size_t
+{
+    return m_Ids.size();
+}
+auto BulletPool::GetCapacity() const -> uint32_t
+{
+    return m_Capacity;
+}
+auto BulletPool::GetIds() const -> std::span<const IdType>
+{
+    return m_Ids;
+}
+auto BulletPool::GetShooters() const -> std::span<const IdType>
+{
+    return m_Shooters;
+}
+auto BulletPool::GetPositions() -> std::span<Vector2>
+{
+    return m_Positions;
+}
+auto BulletPool::GetPositions() const -> std::span<const Vector2>
+{
+    return m_Positions;
+}
+auto BulletPool::GetVelocities() const -> std::span<const Vector2>
+{
+    return m_Velocities;
+}
+auto BulletPool::MakeId(uint32_t slot) const -> IdType
+{
+    return (static_cast<IdType>(m_Generations[slot]) << s_IndexBits) |
+           (FirstIndex + slot);
+}
+void BulletPool::PushFreeSlot(uint32_t slot)
+{
+    m_FreeSlots[(m_FreeHead + m_FreeCount) % m_Capacity] = slot;
+    m_FreeCount++;
+}
+void BulletPool::RebuildFreeSlots()
+{
+    m_FreeHead = 0;
+    m_FreeCount = 0;
+    for (uint32_t slot{ 0 }; slot < m_Capacity; slot++)
+    {
+        if (m_DenseIndices[slot] == s_NoBullet)
+        {
+            PushFreeSlot(slot);
+        }
+    }
+    m_FreeSlotsStale = false;
+}
+
+void StepBullets(BulletPool& bullets, const game::GameMap& map,
+                 const game::SessionOptions& options,
+                 std::span<BulletTarget> targets, float frameTime,
+                 std::vector<BulletHit>& hits)
+{
+    // bullets that hit something are removed, so where they end up doesn't
+    // matter and everything can be moved up front
+    auto positions{ bullets.GetPositions() };
+    auto velocities{ bullets.GetVelocities() };
+    for (std::size_t idx{ 0 }; idx < positions.size(); idx++)
+    {
+        positions[idx].x += velocities[idx].x * frameTime;
+        positions[idx].y += velocities[idx].y * frameTime;
+    }
+
+    auto radius{ options.BulletRadius };
+    auto hitDistance{ options.BulletRadius + options.PlayerRadius };
+    auto hitDistanceSqr{ hitDistance * hitDistance };
+    std::size_t idx{ 0 };
+    while (idx < bullets.GetSize())
+    {
+        auto position{ bullets.GetPositions()[idx] };
+
+        bool hitWall{ false };
+        map.ForEachWallNear(
+            { position.x - radius, position.y - radius },
+            { position.x + radius, position.y + radius },
+            [&](uint32_t wallIdx)
+            {
+                const auto& wall{ options.Walls[wallIdx].Collider };
+                hitWall = CheckCollisionCircleLine(position, radius,
+                                                   wall.Start, wall.End);
+                return hitWall;
+            });
+        if (hitWall)
+        {
+            hits.push_back({ bullets.GetIds()[idx], std::nullopt });
+            bullets.RemoveAt(idx);
+            continue;
+        }
+
+        auto shooter{ bullets.GetShooters()[idx] };
+        std::optional<std::size_t> hitTarget;
+        for (std::size_t targetIdx{ 0 }; targetIdx < targets.size();
+             targetIdx++)
+        {
+            const auto& target{ targets[targetIdx] };
+            if (target.Hit || target.Id == shooter)
+            {
+                continue;
+            }
+            if (Vector2DistanceSqr(position, target.NextPosition) <=
+                hitDistanceSqr)
+            {
+                hitTarget = targetIdx;
+                break;
+            }
+        }
+        if (hitTarget.has_value())
+        {
+            targets[*hitTarget].Hit = true;
+            hits.push_back({ bullets.GetIds()[idx], hitTarget });
+            bullets.RemoveAt(idx);
+            continue;
+        }
+        idx++;
+    }
+}
+
+} // namespace smp::server
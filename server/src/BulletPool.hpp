@@ -0,0 +1,107 @@
+#pragma once
+#include "GameMap.hpp"
+#include "SessionOptions.hpp"
+#include "Typedefs.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <raylib.h>
+#include <span>
+#include <vector>
+
+namespace smp::server
+{
+
+// Live bullets, kept out of the registry so shots don't churn its sparse
+// sets. Every field is its own dense array preallocated to capacity, index i
+// of each is the same bullet. Removal moves the last bullet into the gap, so
+// the arrays stay contiguous and nothing allocates after construction.
+//
+// Ids are laid out like entt ids (20 bits of index, 12 of version) so clients
+// keep using them as entities: the index is FirstIndex + slot, the version
+// is the slot's generation, bumped whenever the slot is freed. Free slots are
+// handed out oldest first, an index only comes back after every other free
+// slot was used, long after clients destroyed its last bullet.
+class BulletPool
+{
+public:
+    // registry entities (walls and players) stay below it
+    static constexpr IdType FirstIndex{ 1U << 19 };
+    // the all-ones index is entt's null
+    static constexpr uint32_t MaxCapacity{ (1U << 20) - 1 - FirstIndex };
+
+    explicit BulletPool(uint32_t capacity);
+
+    // nullopt while full
+    auto Spawn(IdType shooterId, Vector2 position, Vector2 velocity)
+        -> std::optional<IdType>;
+    // for restoring a room before anything is spawned, bullets keep their
+    // ids. False if the id isn't a bullet id of this pool or already taken.
+    auto Insert(IdType id, IdType shooterId, Vector2 position,
+                Vector2 velocity) -> bool;
+    // the last bullet takes its index
+    void RemoveAt(std::size_t index);
+
+    [[nodiscard]] auto GetSize() const -> std::size_t;
+    [[nodiscard]] auto GetCapacity() const -> uint32_t;
+
+    [[nodiscard]] auto GetIds() const -> std::span<const IdType>;
+    [[nodiscard]] auto GetShooters() const -> std::span<const IdType>;
+    [[nodiscard]] auto GetPositions() -> std::span<Vector2>;
+    [[nodiscard]] auto GetPositions() const -> std::span<const Vector2>;
+    [[nodiscard]] auto GetVelocities() const -> std::span<const Vector2>;
+
+private:
+    static constexpr uint32_t s_IndexBits{ 20 };
+    static constexpr uint32_t s_IndexMask{ (1U << s_IndexBits) - 1 };
+    // all-ones is entt's tombstone version
+    static constexpr uint32_t s_GenerationCount{ (1U << 12) - 1 };
+    static constexpr uint32_t s_NoBullet{ UINT32_MAX };
+
+    [[nodiscard]] auto MakeId(uint32_t slot) const -> IdType;
+    void PushFreeSlot(uint32_t slot);
+    // Insert takes slots out of order, they are queued again on next Spawn
+    void RebuildFreeSlots();
+
+    uint32_t m_Capacity;
+
+    std::vector<IdType> m_Ids;
+    std::vector<IdType> m_Shooters;
+    std::vector<Vector2> m_Positions;
+    std::vector<Vector2> m_Velocities;
+
+    // by slot: where its bullet is in the dense arrays, s_NoBullet if free
+    std::vector<uint32_t> m_DenseIndices;
+    std::vector<uint16_t> m_Generations;
+    // ring of free slots, oldest first
+    std::vector<uint32_t> m_FreeSlots;
+    uint32_t m_FreeHead{ 0 };
+    uint32_t m_FreeCount{ 0 };
+    bool m_FreeSlotsStale{ false };
+};
+
+// what bullets can hit besides walls, gathered once a tick
+struct BulletTarget
+{
+    IdType Id;
+    // where the target will be after this tick, bullets are checked there
+    Vector2 NextPosition;
+    bool Hit{ false };
+};
+
+struct BulletHit
+{
+    IdType BulletId;
+    // index into the targets, nullopt for a wall
+    std::optional<std::size_t> Target;
+};
+
+// Moves every bullet by frameTime. Bullets that would end up in a wall or in
+// a target other than their shooter are removed instead and reported in
+// hits. A target is hit once a tick at most, later bullets pass it.
+void StepBullets(BulletPool& bullets, const game::GameMap& map,
+                 const game::SessionOptions& options,
+                 std::span<BulletTarget> targets, float frameTime,
+                 std::vector<BulletHit>& hits);
+
+} // namespace smp::server
@@ -0,0 +1,175 @@
+#include "Checkpointer.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+namespace smp::server
+{
+
+Checkpointer::Checkpointer(std::string path, RoomState room)
+    : m_Path{ std::move(path) },
+      m_Room{ std::move(room) }
+{
+    m_Thread = std::make_unique<std::thread>([this]() { Run(); });
+}
+Checkpointer::~Checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        m_Stopping = true;
+    }
+    m_Condition.notify_one();
+    m_Thread->join();
+}
+
+auto Checkpointer::AcquireBuffer() -> RoomState&
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    if (m_PendingIdx != -1)
+    {
+        // writer is slower than the interval, newer state replaces it
+        m_FillIdx = m_PendingIdx;
+        m_PendingIdx = -1;
+        m_Replaced.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_FillIdx = m_WritingIdx == 0 ? 1 : 0;
+    }
+
+    // capacity is kept, steady checkpoints don't allocate
+    auto& buffer{ m_Buffers[m_FillIdx] };
+    buffer.Players.clear();
+    buffer.Bullets.clear();
+    return buffer;
+}
+void Checkpointer::Submit()
+{
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        m_PendingIdx = m_FillIdx;
+    }
+    m_Condition.notify_one();
+}
+void Checkpointer::Discard()
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    m_Discarded = true;
+    m_PendingIdx = -1;
+    std::remove(m_Path.c_str());
+}
+
+auto Checkpointer::GetWrittenCount() const -> uint64_t
+{
+    return m_Written.load(std::memory_order_relaxed);
+}
+auto Checkpointer::GetReplacedCount() const -> uint64_t
+{
+    return m_Replaced.load(std::memory_order_relaxed);
+}
+auto Checkpointer::GetLastWriteTime() const -> std::chrono::microseconds
+{
+    return std::chrono::microseconds{ m_LastWriteMicroseconds.load(
+        std::memory_order_relaxed) };
+}
+
+auto Checkpointer::Load(const std::string& path) -> RoomState
+{
+    std::ifstream file{ path, std::ios::binary };
+    if (!file.is_open())
+    {
+        throw std::runtime_error{ "No checkpoint at " + path };
+    }
+    std::string data{ std::istreambuf_iterator<char>{ file },
+                      std::istreambuf_iterator<char>{} };
+    return DeserializeRoomState(data);
+}
+
+void Checkpointer::Run()
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    while (true)
+    {
+        m_Condition.wait(lock,
+                         [this]() { return m_Stopping || m_PendingIdx != -1; });
+        if (m_PendingIdx == -1)
+        {
+            return;
+        }
+        m_WritingIdx = std::exchange(m_PendingIdx, -1);
+
+        lock.unlock();
+        Write(m_Buffers[m_WritingIdx]);
+        lock.lock();
+
+        m_WritingIdx = -1;
+    }
+}
+void Checkpointer::Write(RoomState& snapshot)
+{
+    auto writeStart{ std::chrono::steady_clock::now() };
+
+    // borrowed for serialization, the map is not copied per checkpoint
+    m_Room.Tick = snapshot.Tick;
+    m_Room.CapturedAtMs = snapshot.CapturedAtMs;
+    m_Room.Players.swap(snapshot.Players);
+    m_Room.Bullets.swap(snapshot.Bullets);
+    auto data{ SerializeRoomState(m_Room) };
+    m_Room.Players.swap(snapshot.Players);
+    m_Room.Bullets.swap(snapshot.Bullets);
+
+    auto tempPath{ m_Path + ".tmp" };
+    auto fd{ open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+    if (fd < 0)
+    {
+        std::cerr << "Could not write checkpoint " << tempPath << ": "
+                  << std::strerror(errno) << '\n';
+        return;
+    }
+    size_t offset{ 0 };
+    while (offset < data.size())
+    {
+        auto written{ write(fd, data.data() + offset, data.size() - offset) };
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "Could not write checkpoint " << tempPath << ": "
+                      << std::strerror(errno) << '\n';
+            close(fd);
+            return;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    // so a machine crash can't leave a renamed but empty file
+    fsync(fd);
+    close(fd);
+
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        if (m_Discarded)
+        {
+            std::remove(tempPath.c_str());
+            return;
+        }
+        std::rename(tempPath.c_str(), m_Path.c_str());
+    }
+
+    m_Written.fetch_add(1, std::memory_order_relaxed);
+    m_LastWriteMicroseconds.store(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - writeStart)
+            .count(),
+        std::memory_order_relaxed);
+}
+
+} // namespace smp::server
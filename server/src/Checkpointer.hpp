@@ -0,0 +1,71 @@
+#pragma once
+#include "RoomState.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace smp::server
+{
+
+// Keeps a recent copy of the room on disk, so a crashed room can be restored
+// (see GameServer::Restore). The map never changes and is captured once. The
+// tick thread only copies entities into one of two buffers, while this
+// class's thread serializes the other one and replaces the file (written
+// aside and renamed, a crash mid-write leaves the previous checkpoint).
+class Checkpointer
+{
+public:
+    // room holds the parts that never change: name and map
+    Checkpointer(std::string path, RoomState room);
+    // the thread writes what it has, the file stays for a restore
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    auto operator=(const Checkpointer&) -> Checkpointer& = delete;
+
+    // tick thread, the buffer to fill. Never the one being written, an
+    // unwritten one is taken back and overwritten with newer state.
+    auto AcquireBuffer() -> RoomState&;
+    // hands the filled buffer to the writer
+    void Submit();
+    // the room ended cleanly (or moved), nothing to restore
+    void Discard();
+
+    [[nodiscard]] auto GetWrittenCount() const -> uint64_t;
+    // submitted, then replaced before the writer got to them
+    [[nodiscard]] auto GetReplacedCount() const -> uint64_t;
+    [[nodiscard]] auto GetLastWriteTime() const -> std::chrono::microseconds;
+
+    // throws std::runtime_error if there is no valid checkpoint
+    static auto Load(const std::string& path) -> RoomState;
+
+private:
+    void Run();
+    void Write(RoomState& snapshot);
+
+private:
+    std::string m_Path;
+    RoomState m_Room;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    RoomState m_Buffers[2];
+    int32_t m_FillIdx{ 0 };
+    int32_t m_PendingIdx{ -1 };
+    int32_t m_WritingIdx{ -1 };
+    bool m_Stopping{ false };
+    bool m_Discarded{ false };
+
+    std::atomic<uint64_t> m_Written{ 0 };
+    std::atomic<uint64_t> m_Replaced{ 0 };
+    std::atomic<int64_t> m_LastWriteMicroseconds{ 0 };
+
+    std::unique_ptr<std::thread> m_Thread{ nullptr };
+};
+
+} // namespace smp::server
@@ -1,11 +1,18 @@
 #include "GameServer.hpp"
 #include "Components.hpp"
+#include "Discovery.hpp"
 #include "Typedefs.hpp"
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <raylib.h>
 #include <raymath.h>
+#include <sys/resource.h>
 #include <thread>
 #include <utility>
 
@@ -13,10 +20,17 @@ namespace smp::server
 {
 
 GameServer::GameServer(const std::string& redisHost, int32_t redisPort,
-                       game::SessionOptions options)
-    : m_Name(options.Name),
-      m_SessionOptions{ std::move(options) }
+                       const std::string& name, game::GameMap map,
+                       uint32_t clientBytesPerSecond)
+    : m_Name(name),
+      m_ClientBytesPerTick{ static_cast<uint32_t>(
+          static_cast<uint64_t>(clientBytesPerSecond) *
+          ServerBase::TickTimeMicroseconds / 1'000'000) },
+      m_Map{ std::move(map) },
+      m_SessionOptions{ m_Map.GetOptions() }
 {
+    m_SessionOptions.Name = name;
+
     try
     {
         redis::ConnectionOptions connOptions{};
@@ -24,247 +38,1741 @@ GameServer::GameServer(const std::string& redisHost, int32_t redisPort,
         connOptions.port = redisPort;
         connOptions.password = "mypassword"; // hehehe
 
-        m_RedisClient = std::make_unique<redis::Redis>(connOptions);
+        m_RedisWriter = std::make_unique<RedisWriter>(connOptions);
+
+        // times out so the listener can notice shutdown
+        connOptions.socket_timeout = s_SubscriberTimeout;
+        m_ReservationSubscriberClient =
+            std::make_unique<redis::Redis>(connOptions);
+        m_ReservationThread = std::make_unique<std::thread>(
+            [this]() { RunReservationListener(); });
     }
     catch (const redis::Error& error)
     {
-        std::cerr << error.what() << std::endl;
+        std::cerr << error.what() << std::endl;
+    }
+
+    for (auto& wall : m_SessionOptions.Walls)
+    {
+        wall.Id = m_Registry.create();
+        m_Registry.emplace<game::LineCollider>(wall.Id, wall.Collider);
+    }
+
+    m_SessionBlob = game::MakeSessionBlob(m_SessionOptions);
+    m_SessionMessage = std::make_shared<const std::string>(
+        R"({"type":"session","payload":)" + m_SessionBlob.Data + "}");
+    m_SpectatorGreetingPrefix = R"({"type":"greeting","payload":{)"
+                                R"("session_hash":")" +
+                                m_SessionBlob.Hash + R"(")";
+}
+
+GameServer::~GameServer()
+{
+    m_Alive = false;
+    if (m_NetworkThread != nullptr)
+    {
+        m_NetworkThread->join();
+    }
+    if (m_ReservationThread != nullptr)
+    {
+        m_ReservationThread->join();
+    }
+    // I/O thread is gone, GNS is ours again
+    if (m_Interface != nullptr)
+    {
+        for (auto connection : m_IoConnections)
+        {
+            m_Interface->CloseConnection(connection, 0, nullptr, false);
+        }
+        m_Interface->CloseConnection(m_MigrationConnection, 0, nullptr,
+                                     false);
+        m_Interface->DestroyPollGroup(m_PollGroup);
+    }
+    m_PollGroup = k_HSteamNetPollGroup_Invalid;
+
+    if (m_Checkpointer != nullptr)
+    {
+        // only a crash leaves a checkpoint behind
+        m_Checkpointer->Discard();
+    }
+    if (m_Migration.has_value() && m_Migration->HandedOver)
+    {
+        // our keys belong to the room's new server now
+        return;
+    }
+    // flushed by the writer on destruction
+    m_RedisWriter->Del(discovery::EndpointKey(m_Name));
+    m_RedisWriter->Del(discovery::PlayerCountKey(m_Name));
+    m_RedisWriter->Del(discovery::HeartbeatKey(m_Name));
+    PublishDiscoveryUpdate({ { "removed", true } }, "removed");
+}
+
+static auto GetProcessCpuTime() -> std::chrono::microseconds
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return std::chrono::seconds{ usage.ru_utime.tv_sec +
+                                 usage.ru_stime.tv_sec } +
+           std::chrono::microseconds{ usage.ru_utime.tv_usec +
+                                      usage.ru_stime.tv_usec };
+}
+
+// host the way clients put it back together as "<host>:<port>"
+static auto FormatHost(const SteamNetworkingIPAddr& addr) -> std::string
+{
+    std::array<char, SteamNetworkingIPAddr::k_cchMaxString> buffer{};
+    addr.ToString(buffer.data(), buffer.size(), false);
+    if (addr.IsIPv4())
+    {
+        return buffer.data();
+    }
+    return "[" + std::string{ buffer.data() } + "]";
+}
+// anything but two numbers that fit a float is malformed input
+static auto ReadInputVector(const json& payload, const char* xKey,
+                            const char* yKey) -> std::optional<Vector2>
+{
+    if (!payload.is_object())
+    {
+        return std::nullopt;
+    }
+    auto xIt{ payload.find(xKey) };
+    auto yIt{ payload.find(yKey) };
+    if (xIt == payload.end() || yIt == payload.end() || !xIt->is_number() ||
+        !yIt->is_number())
+    {
+        return std::nullopt;
+    }
+    auto x{ xIt->template get<double>() };
+    auto y{ yIt->template get<double>() };
+    constexpr auto limit{ static_cast<double>(
+        std::numeric_limits<float>::max()) };
+    if (!(std::abs(x) <= limit && std::abs(y) <= limit))
+    {
+        return std::nullopt;
+    }
+    return Vector2{ static_cast<float>(x), static_cast<float>(y) };
+}
+
+void GameServer::RegisterSelfInRedis()
+{
+    m_EndpointInfo = { { "ip", m_Host },
+                       { "port", m_Port },
+                       { "capacity", m_SessionOptions.MaxPlayers } };
+    // everything we register expires unless heartbeats keep it alive, so a
+    // crashed room disappears by itself
+    m_RedisWriter->Set(discovery::EndpointKey(m_Name), m_EndpointInfo.dump(),
+                       s_RegistrationTtl);
+    m_RedisWriter->Set(discovery::PlayerCountKey(m_Name), "0",
+                       s_RegistrationTtl);
+    PublishDiscoveryUpdate(
+        { { "endpoint", m_EndpointInfo }, { "player_count", 0 } }, "endpoint");
+
+    m_LastHeartbeat = std::chrono::steady_clock::now();
+    m_LastCpuTime = GetProcessCpuTime();
+    SendHeartbeat();
+}
+void GameServer::SendHeartbeat()
+{
+    auto now{ std::chrono::steady_clock::now() };
+    auto cpuTime{ GetProcessCpuTime() };
+    auto interval{ std::max(
+        std::chrono::duration<double>{ now - m_LastHeartbeat }.count(),
+        1e-3) };
+    const auto& stats{ m_TickScheduler.GetStats() };
+    auto bytesSent{ m_BytesSent.load(std::memory_order_relaxed) };
+    auto ioBusy{ m_IoBusyNanoseconds.load(std::memory_order_relaxed) };
+
+    json heartbeat = {
+        { "player_count", m_ClientMap.size() },
+        { "reserved", m_Reservations.size() },
+        { "bullets", m_Bullets.GetSize() },
+        { "tick_p99_us", stats.TickTime.GetPercentile(99) },
+        { "tick_jitter_p99_us", stats.Jitter.GetPercentile(99) },
+        { "tick_overrun_rate",
+          stats.Ticks == 0 ? 0.0
+                           : static_cast<double>(stats.Overruns) /
+                                 static_cast<double>(stats.Ticks) },
+        { "out_bytes_per_sec",
+          static_cast<double>(bytesSent - m_LastBytesSent) / interval },
+        { "cpu_share",
+          std::chrono::duration<double>{ cpuTime - m_LastCpuTime }.count() /
+              interval },
+        // share of wall time each thread spent working rather than waiting
+        { "sim_utilization",
+          std::chrono::duration<double>{ m_SimBusyTime - m_LastSimBusyTime }
+                  .count() /
+              interval },
+        { "io_utilization",
+          static_cast<double>(ioBusy - m_LastIoBusyNanoseconds) * 1e-9 /
+              interval },
+        { "active_s",
+          std::chrono::duration<double>{ GetActiveTime() }.count() },
+        { "idle_s", std::chrono::duration<double>{ GetIdleTime() }.count() },
+    };
+
+    // how each client's budget was used and how long its updates waited
+    auto& clientsJson{ heartbeat["clients"] = json::array() };
+    auto tickSeconds{ ServerBase::TickTimeMicroseconds * 1e-6 };
+    for (auto& [connection, client] : m_ClientMap)
+    {
+        const auto& outbound{ client.Scheduler.GetStats() };
+        const auto& link{ client.Link.GetLastSample() };
+        clientsJson.push_back(
+            { { "player_id", client.PlayerId },
+              { "bytes_per_sec",
+                static_cast<double>(outbound.BytesSent) / interval },
+              { "budget_use",
+                outbound.BytesGranted == 0
+                    ? 0.0
+                    : static_cast<double>(outbound.BytesSent) /
+                          static_cast<double>(outbound.BytesGranted) },
+              { "updates_sent", outbound.UpdatesSent },
+              { "updates_deferred", outbound.UpdatesDeferred },
+              { "max_starvation_s",
+                static_cast<double>(outbound.MaxStarvationTicks) *
+                    tickSeconds },
+              { "starved_share",
+                outbound.EntityTicks == 0
+                    ? 0.0
+                    : static_cast<double>(outbound.StarvedEntityTicks) /
+                          static_cast<double>(outbound.EntityTicks) },
+              { "ping_ms", link.PingMs },
+              { "loss", link.Loss },
+              { "pending_reliable_bytes", link.PendingReliableBytes },
+              { "pending_unreliable_bytes", link.PendingUnreliableBytes },
+              { "send_rate_bytes_per_sec", link.SendRateBytesPerSecond },
+              { "update_interval_ticks", client.Link.GetUpdateInterval() } });
+        client.Scheduler.ResetStats();
+    }
+    if (m_Checkpointer != nullptr)
+    {
+        heartbeat["checkpoints_written"] = m_Checkpointer->GetWrittenCount();
+        heartbeat["checkpoints_replaced"] = m_Checkpointer->GetReplacedCount();
+        heartbeat["checkpoint_write_us"] =
+            m_Checkpointer->GetLastWriteTime().count();
+    }
+    FlushLinkStats();
+    heartbeat["metrics"] = m_Metrics.Collect();
+
+    m_LastHeartbeat = now;
+    m_LastCpuTime = cpuTime;
+    m_LastBytesSent = bytesSent;
+    m_LastSimBusyTime = m_SimBusyTime;
+    m_LastIoBusyNanoseconds = ioBusy;
+    m_TickScheduler.ResetStats();
+
+    m_RedisWriter->Set(discovery::HeartbeatKey(m_Name), heartbeat.dump(),
+                       s_RegistrationTtl);
+    m_RedisWriter->Set(discovery::EndpointKey(m_Name), m_EndpointInfo.dump(),
+                       s_RegistrationTtl);
+    m_RedisWriter->Set(discovery::PlayerCountKey(m_Name),
+                       std::to_string(m_ClientMap.size()), s_RegistrationTtl);
+    PublishDiscoveryUpdate(
+        { { "endpoint", m_EndpointInfo }, { "heartbeat", heartbeat } },
+        "heartbeat");
+
+    if (++m_HeartbeatCount % s_HeartbeatLogInterval == 0)
+    {
+        std::cout << "Heartbeat: " << heartbeat.dump() << '\n';
+    }
+}
+void GameServer::FlushLinkStats()
+{
+    m_Metrics.MergeHistogram("link.ping_ms", m_LinkStats.PingMs);
+    m_Metrics.MergeHistogram("link.loss_permille", m_LinkStats.LossPermille);
+    m_Metrics.MergeHistogram("link.pending_bytes", m_LinkStats.PendingBytes);
+    m_Metrics.MergeHistogram("link.send_rate_bytes_per_sec",
+                             m_LinkStats.SendRateBytesPerSecond);
+    m_Metrics.MergeHistogram("link.queue_time_us", m_LinkStats.QueueTimeUs);
+    m_LinkStats = {};
+}
+void GameServer::SendHeartbeatIfDue()
+{
+    if (m_Migration.has_value())
+    {
+        // the next registration is the target's
+        return;
+    }
+    if (std::chrono::steady_clock::now() - m_LastHeartbeat >=
+        discovery::HeartbeatInterval)
+    {
+        SendHeartbeat();
+    }
+}
+void GameServer::PublishDiscoveryUpdate(json update,
+                                        const std::string& coalesceTag)
+{
+    update["name"] = m_Name;
+    m_RedisWriter->Publish(std::string{ discovery::UpdatesChannel },
+                           update.dump(), coalesceTag);
+}
+void GameServer::PublishPlayerCount()
+{
+    if (m_Migration.has_value())
+    {
+        // the next heartbeat has it, should the room stay
+        return;
+    }
+    auto playerCount{ m_ClientMap.size() };
+    m_RedisWriter->Set(discovery::PlayerCountKey(m_Name),
+                       std::to_string(playerCount), s_RegistrationTtl);
+    PublishDiscoveryUpdate({ { "player_count", playerCount } },
+                           "player_count");
+}
+
+void GameServer::Restore(const RoomState& state,
+                         std::chrono::seconds resumeTimeout)
+{
+    // walls were created in the same order as on the old server, so the
+    // ids players and bullets had there are all free
+    auto resumeDeadline{ std::chrono::steady_clock::now() + resumeTimeout };
+    for (const auto& player : state.Players)
+    {
+        auto playerId{ m_Registry.create(player.Id) };
+        if (playerId != player.Id)
+        {
+            // taken after all (a corrupt state), its client joins anew
+            m_Registry.destroy(playerId);
+            std::cout << "Player " << player.Id << " can't be restored\n";
+            continue;
+        }
+        auto& collider{ m_Registry.emplace<game::CircleCollider>(
+            playerId, player.Position, m_SessionOptions.PlayerRadius) };
+        collider.SetVelocity(player.Velocity);
+        m_Registry.emplace<game::PlayerTag>(playerId);
+        m_ResumingPlayers.emplace(playerId, resumeDeadline);
+    }
+    for (const auto& bullet : state.Bullets)
+    {
+        if (!m_Bullets.Insert(bullet.Id, bullet.ShooterId, bullet.Position,
+                              bullet.Velocity))
+        {
+            std::cout << "Bullet " << bullet.Id << " can't be restored\n";
+        }
+    }
+
+    m_Tick = state.Tick;
+    m_MigratedAt = std::chrono::system_clock::time_point{
+        std::chrono::milliseconds{ state.CapturedAtMs }
+    };
+    std::cout << "Restored room " << m_Name << " at tick " << m_Tick << '\n';
+}
+void GameServer::EnableCheckpoints(const std::string& path,
+                                   uint32_t intervalTicks)
+{
+    RoomState room;
+    room.Name = m_Name;
+    auto mapBytes{ m_Map.GetBytes() };
+    room.Map.assign(mapBytes.begin(), mapBytes.end());
+
+    m_Checkpointer = std::make_unique<Checkpointer>(path, std::move(room));
+    m_CheckpointInterval = std::max(intervalTicks, 1U);
+}
+void GameServer::SetTraceSampleRate(double rate)
+{
+    m_TraceSampler.SetRate(rate);
+}
+void GameServer::SetCompressionThreshold(std::size_t bytes)
+{
+    m_CompressionThreshold = bytes;
+}
+void GameServer::RecordCompressionSamples(const std::string& path)
+{
+    m_SampleRecording.open(path, std::ios::binary | std::ios::app);
+    if (!m_SampleRecording.is_open())
+    {
+        std::cerr << "Could not open " << path << " for samples\n";
+    }
+}
+void GameServer::CaptureCheckpoint()
+{
+    if (m_Checkpointer == nullptr)
+    {
+        return;
+    }
+    auto captureStart{ std::chrono::steady_clock::now() };
+
+    auto& snapshot{ m_Checkpointer->AcquireBuffer() };
+    snapshot.Tick = m_Tick;
+    snapshot.CapturedAtMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    CaptureEntities(snapshot);
+    m_Checkpointer->Submit();
+
+    m_Metrics.RecordValue(
+        "checkpoint.capture_us",
+        static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - captureStart)
+                .count()));
+}
+
+void GameServer::Run(const std::string& addrIpv4)
+{
+    // the I/O thread services GNS instead of its own thread, so waiting in
+    // SteamNetworkingSockets_Poll wakes up as soon as a packet arrives
+    SteamNetworkingSockets_SetManualPollMode(true);
+    InitConnection(addrIpv4);
+
+    auto colonIdx{ addrIpv4.find(':') };
+    m_Host = addrIpv4.substr(0, colonIdx);
+    m_Port = std::stoi(addrIpv4.substr(colonIdx + 1));
+    RegisterSelfInRedis();
+
+    m_PollGroup = m_Interface->CreatePollGroup();
+    if (m_PollGroup == k_HSteamNetPollGroup_Invalid)
+    {
+        std::cerr << "Failed to listen on " << addrIpv4 << '\n';
+    }
+
+    // from here on only the I/O thread talks to GNS
+    m_NetworkThread =
+        std::make_unique<std::thread>([this]() { RunNetworkIo(); });
+
+    m_ActiveSince = std::chrono::steady_clock::now();
+
+    while (m_Alive)
+    {
+        if (m_Migration.has_value())
+        {
+            ContinueMigration();
+            continue;
+        }
+        if (IsIdle())
+        {
+            Hibernate();
+            continue;
+        }
+
+        auto frameTime{ m_TickScheduler.BeginTick() };
+        auto busyStart{ std::chrono::steady_clock::now() };
+
+        PrepareReservations();
+        DrainInboundEvents();
+        ExpirePendingJoins();
+        UpdateGameState(frameTime);
+        FlushOutboundOverflow();
+
+        m_SimBusyTime += std::chrono::steady_clock::now() - busyStart;
+        m_TickScheduler.EndTick();
+        m_Tick++;
+        if (m_CheckpointInterval != 0 && m_Tick % m_CheckpointInterval == 0)
+        {
+            CaptureCheckpoint();
+        }
+
+        SendHeartbeatIfDue();
+        BeginMigrationIfRequested();
+    }
+}
+void GameServer::BeginMigrationIfRequested()
+{
+    std::optional<SteamNetworkingIPAddr> target;
+    {
+        std::lock_guard lock{ m_IncomingMigrationMutex };
+        target.swap(m_IncomingMigrationTarget);
+    }
+    if (!target.has_value() || m_Migration.has_value())
+    {
+        return;
+    }
+
+    Migration migration{ FormatHost(*target), target->m_port,
+                         std::chrono::steady_clock::now() };
+
+    // the target registers the room next, none of our writes may land after
+    // that
+    if (!m_RedisWriter->Flush(s_MigrationFlushTimeout))
+    {
+        std::cerr << "Redis is behind, not moving the room\n";
+        return;
+    }
+    // the target stops taking it once we would resume here anyway
+    auto data{ SignRoomState(
+        CaptureRoomState(), FormatAddress(*target),
+        std::chrono::system_clock::now() + s_MigrationTimeout,
+        m_ReservationKey) };
+    if (data.size() > k_cbMaxSteamNetworkingSocketsMessageSizeSend)
+    {
+        std::cerr << "Room state is too big to move (" << data.size()
+                  << " bytes)\n";
+        return;
+    }
+
+    std::cout << "Moving room to " << FormatAddress(*target) << ", "
+              << data.size() << " bytes of state\n";
+    OutboundCommand command;
+    command.Data = std::make_shared<const std::string>(std::move(data));
+    command.MigrationTarget = *target;
+    QueueOutbound(std::move(command));
+    m_Migration = std::move(migration);
+}
+void GameServer::ContinueMigration()
+{
+    auto now{ std::chrono::steady_clock::now() };
+    DrainInboundEvents();
+    FlushOutboundOverflow();
+
+    if (m_Migration.has_value() && m_Migration->HandedOver &&
+        ((m_ClientMap.empty() && m_Spectators.empty() &&
+          m_PendingJoins.empty()) ||
+         now >= m_Migration->DrainUntil))
+    {
+        std::cout << "Room moved, shutting down\n";
+        m_Alive = false;
+        return;
+    }
+    TickScheduler::SleepUntil(now + s_MigrationPollInterval);
+}
+void GameServer::RedirectClients()
+{
+    auto& migration{ *m_Migration };
+    json redirect = { { "type", "redirect" },
+                      { "payload",
+                        { { "ip", migration.TargetHost },
+                          { "port", migration.TargetPort } } } };
+
+    // players come back as themselves, the token proves who they were
+    auto expiresAt{ std::chrono::system_clock::now() +
+                    MigrationResumeTimeout };
+    for (auto& [connection, client] : m_ClientMap)
+    {
+        redirect["payload"]["token"] = discovery::SignReservation(
+            { client.PlayerId, expiresAt }, discovery::TokenPurpose::Resume,
+            m_Name, m_ReservationKey);
+        QueueMessage(connection, redirect.dump());
+    }
+    // spectators and clients that had not joined yet join the target anew
+    redirect["payload"].erase("token");
+    auto rejoin{ std::make_shared<const std::string>(redirect.dump()) };
+    for (auto connection : m_Spectators)
+    {
+        QueueMessage(connection, rejoin);
+    }
+    for (const auto& [connection, connectedAt] : m_PendingJoins)
+    {
+        QueueMessage(connection, rejoin);
+    }
+    m_DeferredJoins.clear();
+
+    auto now{ std::chrono::steady_clock::now() };
+    migration.HandedOver = true;
+    migration.DrainUntil = now + s_MigrationDrainTimeout;
+    std::cout << "Room handed over to " << migration.TargetHost << ':'
+              << migration.TargetPort << " after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     now - migration.FrozenAt)
+                     .count()
+              << "ms frozen, redirected " << m_ClientMap.size()
+              << " players\n";
+}
+void GameServer::AbortMigration()
+{
+    std::cerr << "Migration failed, room resumes here after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() -
+                     m_Migration->FrozenAt)
+                     .count()
+              << "ms frozen\n";
+    m_Migration.reset();
+
+    for (auto& [connection, payload] : m_DeferredJoins)
+    {
+        HandleJoin(connection, payload);
+    }
+    m_DeferredJoins.clear();
+
+    // don't catch up on the frozen time
+    m_TickScheduler.Start();
+    // registration went without refresh for a while
+    SendHeartbeat();
+}
+auto GameServer::CaptureRoomState() const -> RoomState
+{
+    RoomState state;
+    state.Name = m_Name;
+    state.Tick = m_Tick;
+    state.CapturedAtMs =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    auto mapBytes{ m_Map.GetBytes() };
+    state.Map.assign(mapBytes.begin(), mapBytes.end());
+    CaptureEntities(state);
+    return state;
+}
+void GameServer::CaptureEntities(RoomState& state) const
+{
+    auto playersView{
+        m_Registry.view<game::PlayerTag, game::CircleCollider>()
+    };
+    for (auto entity : playersView)
+    {
+        const auto& collider{ playersView.get<game::CircleCollider>(entity) };
+        state.Players.push_back(
+            { entity, collider.GetPosition(), collider.GetVelocity() });
+    }
+    auto bulletIds{ m_Bullets.GetIds() };
+    auto shooters{ m_Bullets.GetShooters() };
+    auto positions{ m_Bullets.GetPositions() };
+    auto velocities{ m_Bullets.GetVelocities() };
+    for (std::size_t idx{ 0 }; idx < bulletIds.size(); idx++)
+    {
+        state.Bullets.push_back({ bulletIds[idx], shooters[idx],
+                                  positions[idx], velocities[idx] });
+    }
+}
+void GameServer::Hibernate()
+{
+    auto idleStart{ std::chrono::steady_clock::now() };
+    m_ActiveTime += idleStart - m_ActiveSince;
+    std::cout << "No players left, room is hibernating\n";
+    // nobody to restore while parked
+    CaptureCheckpoint();
+
+    // parked until the I/O thread hands over a connection or a reservation
+    // comes in, its client is on the way. Heartbeats keep going meanwhile.
+    m_SimulationParked.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (m_Alive && IsIdle())
+    {
+        DrainInboundEvents();
+        PrepareReservations();
+        BeginMigrationIfRequested();
+        if (!IsIdle() || m_Migration.has_value())
+        {
+            break;
+        }
+        SendHeartbeatIfDue();
+
+        // Stop can't notify from a signal handler, so the wait is bounded
+        auto wakeAt{ std::min(
+            m_LastHeartbeat + discovery::HeartbeatInterval,
+            std::chrono::steady_clock::now() + s_HibernateStopCheck) };
+        std::unique_lock lock{ m_WakeMutex };
+        m_WakeCondition.wait_until(lock, wakeAt, [this]() {
+            return m_WakeRequested || !m_Alive;
+        });
+        m_WakeRequested = false;
+    }
+    m_SimulationParked.store(false);
+
+    m_ActiveSince = std::chrono::steady_clock::now();
+    m_IdleTime += m_ActiveSince - idleStart;
+    // re-anchor the tick grid, otherwise we would try to catch up on the
+    // whole time spent parked
+    m_TickScheduler.Start();
+
+    std::cout << "Room woke up after "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     m_ActiveSince - idleStart)
+                     .count()
+              << "ms\n";
+}
+auto GameServer::IsIdle() const -> bool
+{
+    return m_ClientMap.empty() && m_PendingJoins.empty() &&
+           m_Reservations.empty() && m_ResumingPlayers.empty();
+}
+auto GameServer::GetIdleTime() const -> std::chrono::nanoseconds
+{
+    return m_IdleTime;
+}
+auto GameServer::GetActiveTime() const -> std::chrono::nanoseconds
+{
+    if (IsIdle())
+    {
+        return m_ActiveTime;
+    }
+    return m_ActiveTime + (std::chrono::steady_clock::now() - m_ActiveSince);
+}
+void GameServer::RunReservationListener()
+{
+    while (m_Alive)
+    {
+        try
+        {
+            auto migrationsChannel{ discovery::MigrationsChannel(m_Name) };
+            auto subscriber{ m_ReservationSubscriberClient->subscriber() };
+            subscriber.on_message(
+                [this, migrationsChannel](const std::string& channel,
+                                          const std::string& message)
+                {
+                    if (channel == migrationsChannel)
+                    {
+                        ReceiveMigrationRequest(message);
+                        return;
+                    }
+                    ReceiveReservation(message);
+                });
+            subscriber.subscribe(
+                { discovery::ReservationsChannel(m_Name), migrationsChannel });
+
+            while (m_Alive)
+            {
+                try
+                {
+                    subscriber.consume();
+                }
+                catch (const redis::TimeoutError&)
+                {
+                    // nobody is coming, that's fine
+                }
+            }
+        }
+        catch (const redis::Error& error)
+        {
+            std::cerr << error.what() << std::endl;
+            std::this_thread::sleep_for(s_SubscriberTimeout);
+        }
+    }
+}
+void GameServer::ReceiveReservation(const std::string& message)
+{
+    auto reservationJson{ json::parse(message, nullptr, false) };
+    if (reservationJson.is_discarded() || !reservationJson.contains("token"))
+    {
+        return;
+    }
+
+    // mac is checked here, off the tick thread
+    auto reservation{ discovery::VerifyReservation(
+        reservationJson["token"].template get<std::string>(),
+        discovery::TokenPurpose::Join, m_Name, m_ReservationKey) };
+    if (!reservation.has_value())
+    {
+        std::cerr << "Dropping reservation with invalid token\n";
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_IncomingReservationsMutex };
+        m_IncomingReservations.push_back(*reservation);
+    }
+    WakeSimulation();
+}
+void GameServer::ReceiveMigrationRequest(const std::string& message)
+{
+    auto requestJson{ json::parse(message, nullptr, false) };
+    if (requestJson.is_discarded() || !requestJson.contains("target") ||
+        !requestJson["target"].is_string())
+    {
+        std::cerr << "Dropping malformed migration request\n";
+        return;
+    }
+
+    auto target{ requestJson["target"].template get<std::string>() };
+    SteamNetworkingIPAddr targetAddr{};
+    targetAddr.Clear();
+    // port 0 means there was none, the standby listens on a real one
+    if (!targetAddr.ParseString(target.c_str()) || targetAddr.m_port == 0)
+    {
+        std::cerr << "Dropping migration to bad address " << target << '\n';
+        return;
+    }
+
+    {
+        std::lock_guard lock{ m_IncomingMigrationMutex };
+        m_IncomingMigrationTarget = targetAddr;
+    }
+    WakeSimulation();
+}
+void GameServer::PrepareReservations()
+{
+    std::vector<discovery::Reservation> incoming;
+    {
+        std::lock_guard lock{ m_IncomingReservationsMutex };
+        incoming.swap(m_IncomingReservations);
+    }
+
+    for (const auto& reservation : incoming)
+    {
+        // a consumed slot means its client was faster and already joined
+        if (m_Reservations.contains(reservation.SlotId) ||
+            m_ConsumedSlots.contains(reservation.SlotId))
+        {
+            continue;
+        }
+        if (std::cmp_greater_equal(TakenSlots(), m_SessionOptions.MaxPlayers))
+        {
+            std::cerr << "Room is full, dropping reservation\n";
+            continue;
+        }
+        // entity has no components yet, so it is invisible to the systems
+        auto playerId{ m_Registry.create() };
+        m_Reservations.emplace(
+            reservation.SlotId,
+            PreparedJoin{ playerId, reservation.ExpiresAt,
+                          BuildGreetingPrefix(playerId, s_PlayerSpawnPos) });
+    }
+
+    if (m_Reservations.empty() && m_ConsumedSlots.empty())
+    {
+        return;
+    }
+    auto now{ std::chrono::system_clock::now() };
+    std::erase_if(m_Reservations,
+                  [this, now](const auto& pair)
+                  {
+                      if (pair.second.ExpiresAt > now)
+                      {
+                          return false;
+                      }
+                      m_Registry.destroy(pair.second.PlayerId);
+                      return true;
+                  });
+    // expired tokens are rejected anyway
+    std::erase_if(m_ConsumedSlots, [now](const auto& pair)
+                  { return pair.second <= now; });
+}
+void GameServer::ExpirePendingJoins()
+{
+    if (m_PendingJoins.empty() && m_ResumingPlayers.empty())
+    {
+        return;
+    }
+    auto now{ std::chrono::steady_clock::now() };
+    std::erase_if(m_PendingJoins,
+                  [this, now](const auto& pair)
+                  {
+                      if (now - pair.second < s_JoinTimeout)
+                      {
+                          return false;
+                      }
+                      QueueClose(pair.first, "No join message");
+                      return true;
+                  });
+    std::erase_if(m_ResumingPlayers,
+                  [this, now](const auto& pair)
+                  {
+                      if (now < pair.second)
+                      {
+                          return false;
+                      }
+                      std::cout << "Player " << pair.first
+                                << " did not follow the room\n";
+                      NotifyEntityDestruction(pair.first);
+                      m_Registry.destroy(pair.first);
+                      return true;
+                  });
+}
+auto GameServer::TakenSlots() const -> std::size_t
+{
+    return m_ClientMap.size() + m_ResumingPlayers.size() +
+           m_Reservations.size();
+}
+void GameServer::HandleJoin(HSteamNetConnection connection,
+                            const json& payload)
+{
+    if (m_PendingJoins.erase(connection) == 0)
+    {
+        // already joined
+        return;
+    }
+    if (payload.contains("spectator") && payload["spectator"] == true)
+    {
+        HandleSpectatorJoin(connection);
+        return;
+    }
+    if (payload.contains("resume"))
+    {
+        HandleResume(connection, payload["resume"]);
+        return;
+    }
+
+    // players only come through the entry point, a join without its token
+    // would skip placement. Spectators are the ones who connect directly.
+    std::optional<discovery::Reservation> reservation;
+    if (payload.contains("token") && payload["token"].is_string())
+    {
+        // resume tokens only work through HandleResume
+        reservation = discovery::VerifyReservation(
+            payload["token"].template get<std::string>(),
+            discovery::TokenPurpose::Join, m_Name, m_ReservationKey);
+    }
+    if (!reservation.has_value())
+    {
+        QueueClose(connection, "Invalid reservation");
+        std::cout << "Rejecting join without a valid token\n";
+        return;
+    }
+    if (m_ConsumedSlots.contains(reservation->SlotId))
+    {
+        QueueClose(connection, "Reservation already used");
+        std::cout << "Rejecting join with a used token\n";
+        return;
+    }
+
+    auto preparedIt{ m_Reservations.find(reservation->SlotId) };
+    auto prepared{ preparedIt != m_Reservations.end() };
+
+    // a prepared join is one of the taken slots already. Slots reserved for
+    // others are not given away.
+    auto takenSlots{ TakenSlots() - (prepared ? 1 : 0) };
+    if (std::cmp_greater_equal(takenSlots, m_SessionOptions.MaxPlayers))
+    {
+        QueueClose(connection, "Room is full");
+        std::cout << "Room is full, rejecting connection\n";
+        return;
+    }
+    m_ConsumedSlots.emplace(reservation->SlotId, reservation->ExpiresAt);
+
+    if (prepared)
+    {
+        // fast path, player was created when the reservation came in
+        auto join{ std::move(preparedIt->second) };
+        m_Reservations.erase(preparedIt);
+        SpawnPlayer(connection, join.PlayerId, join.GreetingPrefix);
+        return;
+    }
+
+    // client was faster than its reservation
+    auto playerId{ m_Registry.create() };
+    SpawnPlayer(connection, playerId,
+                BuildGreetingPrefix(playerId, s_PlayerSpawnPos));
+}
+void GameServer::HandleResume(HSteamNetConnection connection,
+                              const json& token)
+{
+    std::optional<discovery::Reservation> resume;
+    if (token.is_string())
+    {
+        resume = discovery::VerifyReservation(
+            token.template get<std::string>(), discovery::TokenPurpose::Resume,
+            m_Name, m_ReservationKey);
+    }
+    auto resumingIt{ m_ResumingPlayers.end() };
+    if (resume.has_value() &&
+        resume->SlotId <= std::numeric_limits<IdType>::max())
+    {
+        resumingIt =
+            m_ResumingPlayers.find(static_cast<IdType>(resume->SlotId));
+    }
+    if (resumingIt == m_ResumingPlayers.end())
+    {
+        QueueClose(connection, "Invalid resume token");
+        std::cout << "Rejecting resume with invalid token\n";
+        return;
+    }
+
+    // everyone else still has this player, only the client comes back
+    auto playerId{ resumingIt->first };
+    m_ResumingPlayers.erase(resumingIt);
+    const auto& collider{ m_Registry.get<game::CircleCollider>(playerId) };
+    QueueMessage(connection, BuildGreeting(BuildGreetingPrefix(
+                                 playerId, collider.GetPosition())));
+    m_ClientMap.emplace(connection,
+                        Client{ playerId,
+                                OutboundScheduler{ m_ClientBytesPerTick },
+                                LinkQualityMonitor{} });
+    PublishPlayerCount();
+
+    // wall clocks of both servers, good enough on one host or with ntp
+    auto pauseMs{ std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now() - m_MigratedAt)
+                      .count() };
+    m_Metrics.RecordValue("migration.pause_ms",
+                          static_cast<uint64_t>(std::max<int64_t>(pauseMs, 0)));
+    std::cout << "Player " << playerId << " resumed after " << pauseMs
+              << "ms without a tick\n";
+}
+void GameServer::HandleSpectatorJoin(HSteamNetConnection connection)
+{
+    if (m_Spectators.size() >= s_MaxSpectators)
+    {
+        QueueClose(connection, "Too many spectators, use a relay");
+        std::cout << "Rejecting spectator, limit reached\n";
+        return;
+    }
+    QueueMessage(connection, BuildGreeting(m_SpectatorGreetingPrefix));
+    m_Spectators.insert(connection);
+    std::cout << "Spectator joined\n";
+}
+void GameServer::SpawnPlayer(HSteamNetConnection connection, IdType playerId,
+                             const std::string& greetingPrefix)
+{
+    QueueMessage(connection, BuildGreeting(greetingPrefix));
+
+    // for simplicity spawn is fixed
+    m_Registry.emplace<game::CircleCollider>(playerId, s_PlayerSpawnPos,
+                                             m_SessionOptions.PlayerRadius);
+    m_Registry.emplace<game::PlayerTag>(playerId);
+    json newConnectionJson = { { "type", "connection" },
+                               { "payload",
+                                 {
+                                     { "id", playerId },
+                                     { "x", s_PlayerSpawnPos.x },
+                                     { "y", s_PlayerSpawnPos.y },
+                                 } } };
+    SendMessageToAllClients(newConnectionJson);
+
+    m_ClientMap.emplace(connection,
+                        Client{ playerId,
+                                OutboundScheduler{ m_ClientBytesPerTick },
+                                LinkQualityMonitor{} });
+    PublishPlayerCount();
+    std::cout << "Successful connection. Player id: " << playerId << '\n';
+}
+void GameServer::ProcessMessage(HSteamNetConnection connection,
+                                json&& messageJson)
+{
+    auto type{ messageJson["type"].template get<std::string>() };
+    auto payload = messageJson["payload"];
+
+    if (type == "join")
+    {
+        if (m_Migration.has_value())
+        {
+            m_DeferredJoins.emplace_back(connection, std::move(payload));
+            return;
+        }
+        HandleJoin(connection, payload);
+        return;
+    }
+    if (type == "session_request" &&
+        (m_ClientMap.contains(connection) || m_Spectators.contains(connection)))
+    {
+        // client had no cached copy of our map
+        QueueMessage(connection, m_SessionMessage);
+    }
+}
+void GameServer::HandleInput(const InboundEvent& event)
+{
+    auto clientIt{ m_ClientMap.find(event.Connection) };
+    if (clientIt == m_ClientMap.end() || m_Migration.has_value())
+    {
+        // nothing but join is accepted before joining, spectators only
+        // listen. Input of a frozen room would be lost with the move.
+        return;
+    }
+    auto playerId{ clientIt->second.PlayerId };
+
+    if (event.EventType == InboundEvent::Type::Move)
+    {
+        if (!event.Message.is_null())
+        {
+            AcceptTrace(playerId, event.Message);
+        }
+        m_Registry.patch<game::CircleCollider>(
+            playerId, [&event](auto& collider)
+            { collider.SetVelocity(event.Input); });
+        return;
+    }
+
+    auto shooterPos{
+        m_Registry.get<game::CircleCollider>(playerId).GetPosition()
+    };
+    auto targetVec{ Vector2Normalize(event.Input) };
+    auto bulletPos{ Vector2Add(
+        shooterPos, Vector2Scale(targetVec, m_SessionOptions.PlayerRadius)) };
+    targetVec = Vector2Scale(targetVec, m_SessionOptions.BulletSpeed);
+
+    auto bulletId{ m_Bullets.Spawn(playerId, bulletPos, targetVec) };
+    if (!bulletId.has_value())
+    {
+        m_Metrics.AddCounter("bullets.dropped");
+        return;
+    }
+
+    // send shoot event to everyone, initial bullet pos is shifted just for
+    // fun
+    json shootMessage = { { "type", "shoot" },
+                          { "payload",
+                            { { "shooter_id", playerId },
+                              { "target_x", event.Input.x },
+                              { "target_y", event.Input.y },
+                              { "bullet_id", *bulletId },
+                              { "bullet_x", bulletPos.x },
+                              { "bullet_y", bulletPos.y } } } };
+    SendMessageToAllClients(shootMessage);
+}
+void GameServer::SendMessageToAllClients(const json& message)
+{
+    if (m_ClientMap.empty() && m_Spectators.empty())
+    {
+        return;
+    }
+    // serialized once, every receiver shares the same buffer
+    auto data{ std::make_shared<const std::string>(message.dump()) };
+    for (auto& [connection, client] : m_ClientMap)
+    {
+        client.Scheduler.Charge(data->size());
+        QueueMessage(connection, data);
+    }
+    for (auto connection : m_Spectators)
+    {
+        QueueMessage(connection, data);
+    }
+}
+void GameServer::QueueMessage(HSteamNetConnection connection,
+                              std::shared_ptr<const std::string> message,
+                              int32_t sendFlags)
+{
+    QueueOutbound({ connection, std::move(message), {}, sendFlags });
+}
+void GameServer::QueueMessage(HSteamNetConnection connection,
+                              std::string message)
+{
+    QueueMessage(connection,
+                 std::make_shared<const std::string>(std::move(message)));
+}
+void GameServer::QueueClose(HSteamNetConnection connection, std::string reason)
+{
+    QueueOutbound({ connection, nullptr, std::move(reason) });
+}
+void GameServer::QueueOutbound(OutboundCommand&& command)
+{
+    // keeps ordering: once something spilled, everything after it waits too
+    if (!m_OutboundOverflow.empty() || !m_Outbound.TryPush(std::move(command)))
+    {
+        m_OutboundOverflow.push_back(std::move(command));
     }
-
-    for (auto& wall : m_SessionOptions.Walls)
+}
+void GameServer::FlushOutboundOverflow()
+{
+    while (!m_OutboundOverflow.empty() &&
+           m_Outbound.TryPush(std::move(m_OutboundOverflow.front())))
     {
-        wall.Id = m_Registry.create();
-        m_Registry.emplace<game::LineCollider>(wall.Id, wall.Collider);
+        m_OutboundOverflow.pop_front();
     }
 }
-
-GameServer::~GameServer()
+void GameServer::DrainInboundEvents()
 {
-    m_Alive = false;
-    if (m_Interface != nullptr)
+    while (auto event{ m_Inbound.TryPop() })
     {
-        for (auto clientPair : m_ClientMap)
+        switch (event->EventType)
+        {
+        case InboundEvent::Type::Connected:
+        {
+            // player is spawned once the join message (with the reservation
+            // token) arrives
+            m_PendingJoins[event->Connection] =
+                std::chrono::steady_clock::now();
+            break;
+        }
+        case InboundEvent::Type::Disconnected:
         {
-            m_Interface->CloseConnection(clientPair.first, 0, nullptr, false);
+            HandleDisconnect(event->Connection);
+            break;
+        }
+        case InboundEvent::Type::Message:
+        {
+            ProcessMessage(event->Connection, std::move(event->Message));
+            break;
+        }
+        case InboundEvent::Type::Move:
+        case InboundEvent::Type::Shoot:
+        {
+            HandleInput(*event);
+            break;
+        }
+        case InboundEvent::Type::LinkStatus:
+        {
+            HandleLinkSample(event->Connection, event->Link);
+            break;
+        }
+        case InboundEvent::Type::MigrationReady:
+        {
+            RedirectClients();
+            break;
+        }
+        case InboundEvent::Type::MigrationFailed:
+        {
+            AbortMigration();
+            break;
+        }
         }
-        m_Interface->DestroyPollGroup(m_PollGroup);
     }
-    m_PollGroup = k_HSteamNetPollGroup_Invalid;
-
-    m_RedisClient->del(m_Name + ".endpoint");
-    m_RedisClient->del(m_Name + ".player_count");
 }
-
-void GameServer::RegisterSelfInRedis()
+void GameServer::HandleDisconnect(HSteamNetConnection connection)
 {
-    json serverInfo = { { "ip", m_Host }, { "port", m_Port } };
-    m_RedisClient->set(m_Name + ".endpoint", serverInfo.dump());
-    m_RedisClient->set(m_Name + ".player_count", "0");
-}
+    if (m_PendingJoins.erase(connection) != 0 ||
+        m_Spectators.erase(connection) != 0)
+    {
+        // nothing was spawned for it
+        return;
+    }
+    auto clientIt{ m_ClientMap.find(connection) };
+    if (clientIt == m_ClientMap.end())
+    {
+        // we closed it ourselves
+        return;
+    }
+    if (m_Migration.has_value() && m_Migration->HandedOver)
+    {
+        // client followed the redirect, its player lives on elsewhere
+        m_ClientMap.erase(clientIt);
+        return;
+    }
 
-void GameServer::Run(const std::string& addrIpv4)
-{
-    InitConnection(addrIpv4);
+    auto playerId{ clientIt->second.PlayerId };
+    m_ClientMap.erase(clientIt);
+    m_PendingTraces.erase(playerId);
+    NotifyEntityDestruction(playerId);
+    m_Registry.destroy(playerId);
 
-    auto colonIdx{ addrIpv4.find(':') };
-    m_Host = addrIpv4.substr(0, colonIdx);
-    m_Port = std::stoi(addrIpv4.substr(colonIdx + 1));
-    RegisterSelfInRedis();
+    PublishPlayerCount();
+}
 
-    m_PollGroup = m_Interface->CreatePollGroup();
-    if (m_PollGroup == k_HSteamNetPollGroup_Invalid)
+void GameServer::HandleLinkSample(HSteamNetConnection connection,
+                                  const LinkSample& sample)
+{
+    auto clientIt{ m_ClientMap.find(connection) };
+    if (clientIt == m_ClientMap.end())
     {
-        std::cerr << "Failed to listen on " << addrIpv4 << '\n';
+        return;
     }
 
-    m_TickStart = std::chrono::steady_clock::now();
+    m_LinkStats.PingMs.Record(
+        static_cast<uint64_t>(std::max(sample.PingMs, 0)));
+    m_LinkStats.LossPermille.Record(
+        static_cast<uint64_t>(sample.Loss * 1000));
+    m_LinkStats.PendingBytes.Record(static_cast<uint64_t>(std::max(
+        sample.PendingReliableBytes + sample.PendingUnreliableBytes, 0)));
+    m_LinkStats.SendRateBytesPerSecond.Record(
+        static_cast<uint64_t>(std::max(sample.SendRateBytesPerSecond, 0)));
+    m_LinkStats.QueueTimeUs.Record(
+        static_cast<uint64_t>(std::max<int64_t>(sample.QueueTime.count(), 0)));
 
-    while (m_Alive)
+    auto& client{ clientIt->second };
+    if (!client.Link.AddSample(sample, std::chrono::steady_clock::now()))
     {
-        auto now{ std::chrono::steady_clock::now() };
-        std::chrono::duration<float> frameTime{ now - m_TickStart };
-        m_TickStart = std::chrono::steady_clock::now();
-
-        PollIncomingMessages();
-        PollConnectionStateChanges();
-        UpdateGameState(frameTime.count());
-
-        now = std::chrono::steady_clock::now();
-
-        std::chrono::duration<float, std::micro> sleepTime{
-            std::chrono::microseconds{
-                server::ServerBase::TickTimeMicroseconds } -
-            (now - m_TickStart)
-        };
-        std::this_thread::sleep_for(sleepTime);
+        return;
     }
+    // only this client slows down, the others keep their full rate
+    client.Scheduler.SetUpdateInterval(client.Link.GetUpdateInterval());
+    m_Metrics.AddCounter("link.level_changes");
+    std::cout << "Player " << client.PlayerId << " link level is now "
+              << client.Link.GetLevel() << " (ping " << sample.PingMs
+              << "ms, loss " << sample.Loss << ")\n";
 }
-void GameServer::ProcessMessage(json&& messageJson)
+
+void GameServer::UpdateGameState(float frameTime)
 {
-    auto type{ messageJson["type"].template get<std::string>() };
-    auto payload = messageJson["payload"];
+    auto playersView{
+        m_Registry.view<game::PlayerTag, game::CircleCollider>()
+    };
+    m_EntityUpdates.clear();
 
-    if (type == "coords")
+    m_BulletTargets.clear();
+    for (auto&& [player, playerCollider] : playersView.each())
     {
-        m_Registry.patch<game::CircleCollider>(
-            payload["id"].template get<IdType>(),
-            [payload](auto& collider)
-            {
-                collider.SetVelocity({ payload["x"].template get<float>(),
-                                       payload["y"].template get<float>() });
-            });
+        m_BulletTargets.push_back(
+            { player, playerCollider.GetNextPosition(frameTime) });
     }
-    else if (type == "shoot")
+    m_BulletHits.clear();
+    StepBullets(m_Bullets, m_Map, m_SessionOptions, m_BulletTargets,
+                frameTime, m_BulletHits);
+    for (const auto& hit : m_BulletHits)
     {
-        auto bulletId{ m_Registry.create() };
-
-        auto shooterId{ payload["shooter_id"].template get<IdType>() };
-        auto shooterPos{
-            m_Registry.get<game::CircleCollider>(shooterId).GetPosition()
-        };
-
-        Vector2 targetVec{ payload["target_x"].template get<float>(),
-                           payload["target_y"].template get<float>() };
-        targetVec = Vector2Normalize(targetVec);
-        auto bulletPos{ Vector2Add(
-            shooterPos,
-            Vector2Scale(targetVec, m_SessionOptions.PlayerRadius)) };
-        targetVec = Vector2Scale(targetVec, m_SessionOptions.BulletSpeed);
+        NotifyEntityDestruction(hit.BulletId);
+        if (hit.Target.has_value())
+        {
+            auto& playerCollider{ m_Registry.get<game::CircleCollider>(
+                m_BulletTargets[*hit.Target].Id) };
+            playerCollider.SetPosition(s_PlayerSpawnPos);
+            playerCollider.SetVelocity({ 0, 0 });
+        }
+    }
+    auto bulletIds{ m_Bullets.GetIds() };
+    auto bulletPositions{ m_Bullets.GetPositions() };
+    for (std::size_t idx{ 0 }; idx < bulletIds.size(); idx++)
+    {
+        AddEntityUpdate(bulletIds[idx], EntityKind::Bullet,
+                        bulletPositions[idx]);
+    }
 
-        auto& newBulletCollider{ m_Registry.emplace<game::CircleCollider>(
-            bulletId, bulletPos, m_SessionOptions.BulletRadius) };
-        newBulletCollider.SetVelocity(targetVec);
+    for (auto&& [player, playerCollider] : playersView.each())
+    {
+        CollideWithWalls(playerCollider, frameTime);
 
-        // send shoot event to everyone
-        messageJson["payload"]["bullet_id"] = bulletId;
-        // shift initial bullet pos just for fun
-        messageJson["payload"]["bullet_x"] = bulletPos.x;
-        messageJson["payload"]["bullet_y"] = bulletPos.y;
-        SendMessageToAllClients(messageJson);
+        playerCollider.SetPosition(playerCollider.GetNextPosition(frameTime));
+        AddEntityUpdate(player, EntityKind::Player,
+                        playerCollider.GetPosition());
+    }
 
-        // include it in tick cycle only after creation message has been sent
-        m_Registry.emplace<game::BulletTag>(bulletId, shooterId);
+    SendEntityUpdates();
+}
+void GameServer::AcceptTrace(IdType playerId, const json& trace)
+{
+    auto sanitized{ trace::SanitizeTrace(trace) };
+    if (!sanitized.has_value() || !m_TraceSampler.Sample())
+    {
+        return;
     }
+    auto& pending{ m_PendingTraces[playerId] = std::move(*sanitized) };
+    pending["s_tick"] = m_Tick;
+    pending["s_apply"] = trace::Now();
 }
-void GameServer::SendMessageToAllClients(const json& message)
+void GameServer::AddEntityUpdate(IdType id, EntityKind kind, Vector2 position)
+{
+    json coordsMessage = { { "type", "coords" },
+                           { "payload",
+                             {
+                                 { "id", id },
+                                 { "x", position.x },
+                                 { "y", position.y },
+                             } } };
+    if (!m_PendingTraces.empty() && kind == EntityKind::Player)
+    {
+        auto traceIt{ m_PendingTraces.find(id) };
+        if (traceIt != m_PendingTraces.end())
+        {
+            traceIt->second["s_send"] = trace::Now();
+            trace::RecordStages(m_Metrics, traceIt->second);
+            coordsMessage["payload"]["trace"] = std::move(traceIt->second);
+            m_PendingTraces.erase(traceIt);
+        }
+    }
+    m_EntityUpdates.push_back(
+        { id, kind, position,
+          std::make_shared<const std::string>(coordsMessage.dump()) });
+}
+void GameServer::SendEntityUpdates()
 {
-    for (auto& pair : m_ClientMap)
+    for (auto& [connection, client] : m_ClientMap)
+    {
+        auto viewerPosition{
+            m_Registry.get<game::CircleCollider>(client.PlayerId).GetPosition()
+        };
+        client.Scheduler.Schedule(m_EntityUpdates, client.PlayerId,
+                                  viewerPosition, m_SelectedUpdates);
+        // positions are superseded every tick, a lost one is not worth
+        // resending and must not hold up the reliable stream
+        for (auto idx : m_SelectedUpdates)
+        {
+            QueueMessage(connection, m_EntityUpdates[idx].Data,
+                         k_nSteamNetworkingSend_Unreliable);
+        }
+    }
+    // spectators are relays that fan the whole stream out further
+    for (auto connection : m_Spectators)
     {
-        SendMessageToConnection(pair.first, message);
+        for (const auto& update : m_EntityUpdates)
+        {
+            QueueMessage(connection, update.Data,
+                         k_nSteamNetworkingSend_Unreliable);
+        }
     }
 }
 
-void GameServer::UpdateGameState(float frameTime)
+auto GameServer::CollideWithWalls(game::CircleCollider& collider,
+                                  float frameTime) -> bool
 {
-    auto bulletsView{
-        m_Registry.view<game::BulletTag, game::CircleCollider>()
-    };
-    auto wallsView{ m_Registry.view<game::LineCollider>() };
-    auto playersView{
-        m_Registry.view<game::PlayerTag, game::CircleCollider>()
-    };
-    json coordsMessage;
+    // collisions are checked at the next position, so only walls around it
+    // matter
+    auto center{ collider.GetNextPosition(frameTime) };
+    auto radius{ collider.GetRadius() };
+    bool collided{ false };
+    m_Map.ForEachWallNear(
+        { center.x - radius, center.y - radius },
+        { center.x + radius, center.y + radius },
+        [&](uint32_t wallIdx)
+        {
+            collided = game::collider::CollideCircleLine(
+                collider, m_SessionOptions.Walls[wallIdx].Collider, frameTime);
+            return collided;
+        });
+    return collided;
+}
 
-    for (auto&& [bullet, bulletTag, bulletCollider] : bulletsView.each())
+void GameServer::RunNetworkIo()
+{
+    while (m_Alive)
     {
-        for (auto&& [wall, wallCollider] : wallsView.each())
+        auto loopStart{ std::chrono::steady_clock::now() };
+
+        PollConnectionStateChanges();
+        ReceiveIncomingMessages();
+        SendOutboundCommands();
+        PollMigrationTransfer();
+        if (loopStart - m_LastLinkSample >= s_LinkSampleInterval)
+        {
+            m_LastLinkSample = loopStart;
+            SampleLinks();
+        }
+        if (loopStart - m_LastCompressionFlush >= discovery::HeartbeatInterval)
         {
-            auto collided{ game::collider::CollideCircleLine(
-                bulletCollider, wallCollider, frameTime) };
+            m_LastCompressionFlush = loopStart;
+            FlushCompressionStats();
+        }
+        FlushInboundOverflow();
 
-            if (collided)
-            {
-                json destroyMessage = { { "type", "destroy" },
-                                        { "payload", { { "id", bullet } } } };
-                SendMessageToAllClients(destroyMessage);
-                m_Registry.destroy(bullet);
-                goto skip_iter; // i think goto is cleaner than
-                                // break-flag-continue
-            }
+        auto loopEnd{ std::chrono::steady_clock::now() };
+        m_IoBusyNanoseconds.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(loopEnd -
+                                                                 loopStart)
+                .count(),
+            std::memory_order_relaxed);
+
+        // a parked room with nobody connected sleeps here until a packet
+        // comes in. The tick never waits on us either way.
+        auto wait{ m_IoConnections.empty() &&
+                           m_MigrationConnection ==
+                               k_HSteamNetConnection_Invalid
+                       ? s_NetworkIdleWait
+                       : s_NetworkWait };
+        SteamNetworkingSockets_Poll(static_cast<int>(wait.count()));
+    }
+}
+void GameServer::ReceiveIncomingMessages()
+{
+    std::array<ISteamNetworkingMessage*, s_ReceiveBatchSize> messages{};
+    while (m_Alive)
+    {
+        auto numMessages{ m_Interface->ReceiveMessagesOnPollGroup(
+            m_PollGroup, messages.data(), s_ReceiveBatchSize) };
+        if (numMessages < 0)
+        {
+            std::cerr << "Error polling message\n";
+            break;
         }
 
-        for (auto&& [player, playerCollider] : playersView.each())
+        for (int32_t idx{ 0 }; idx < numMessages; idx++)
         {
-            if (player == m_Registry.get<game::BulletTag>(bullet).ShooterId)
+            auto* message{ messages[idx] };
+            const auto* data{ static_cast<const char*>(message->m_pData) };
+            // parsed here, the simulation only gets ready json
+            auto messageJson{ json::parse(data, data + message->m_cbSize,
+                                          nullptr, false) };
+            auto connection{ message->m_conn };
+            message->Release();
+
+            if (messageJson.is_discarded() ||
+                !messageJson.contains("type") ||
+                !messageJson.contains("payload"))
             {
+                std::cerr << "Dropping malformed message\n";
                 continue;
             }
-
-            auto collided{ game::collider::CollideCircles(
-                playerCollider, bulletCollider, frameTime) };
-
-            if (collided)
+            const auto& type{ messageJson["type"] };
+            if (type == "time_sync")
+            {
+                // answered right here, a tick of waiting would skew it
+                auto sentAt{ trace::ParseTimeSyncRequest(
+                    messageJson["payload"]) };
+                if (sentAt.has_value() && m_IoConnections.contains(connection))
+                {
+                    json reply = { { "type", "time_sync" },
+                                   { "payload",
+                                     { { "c", *sentAt },
+                                       { "s", trace::Now() } } } };
+                    SendMessageToConnection(connection, reply);
+                }
+                continue;
+            }
+            auto& payload{ messageJson["payload"] };
+            if (type == "compression")
+            {
+                // the client got our dictionary, nothing for the simulation
+                NegotiateCompression(connection, payload);
+                continue;
+            }
+            if (type == "join")
+            {
+                // a join without an offer takes back an earlier one
+                NegotiateCompression(connection,
+                                     payload.is_object()
+                                         ? payload.value("compression", json{})
+                                         : json{});
+            }
+            if (payload.is_object() && payload.contains("trace") &&
+                payload["trace"].is_object())
+            {
+                payload["trace"]["s_recv"] = trace::Now();
+            }
+            if (type == "coords" || type == "shoot")
+            {
+                auto isMove{ type == "coords" };
+                auto input{ isMove ? ReadInputVector(payload, "x", "y")
+                                   : ReadInputVector(payload, "target_x",
+                                                     "target_y") };
+                if (!input.has_value())
+                {
+                    std::cerr << "Dropping malformed input\n";
+                    continue;
+                }
+                InboundEvent event;
+                event.EventType = isMove ? InboundEvent::Type::Move
+                                         : InboundEvent::Type::Shoot;
+                event.Connection = connection;
+                event.Input = *input;
+                if (isMove && payload.contains("trace"))
+                {
+                    event.Message = std::move(payload["trace"]);
+                }
+                PushInbound(std::move(event));
+                continue;
+            }
+            if ((type != "join" || !payload.is_object()) &&
+                type != "session_request")
             {
-                NotifyEntityDestruction(bullet);
-                m_Registry.destroy(bullet);
-                playerCollider.SetPosition(s_PlayerSpawnPos);
-                playerCollider.SetVelocity({ 0, 0 });
-                goto skip_iter;
+                // nothing else is for the simulation
+                continue;
             }
+            PushInbound({ InboundEvent::Type::Message, connection,
+                          std::move(messageJson) });
         }
 
-        bulletCollider.SetPosition(bulletCollider.GetNextPosition(frameTime));
-        // send coords message
-        coordsMessage = { { "type", "coords" },
-                          { "payload",
-                            {
-                                { "id", bullet },
-                                { "x", bulletCollider.GetPosition().x },
-                                { "y", bulletCollider.GetPosition().y },
-                            } } };
-        SendMessageToAllClients(coordsMessage);
-    skip_iter:;
+        if (numMessages < s_ReceiveBatchSize)
+        {
+            break;
+        }
     }
-
-    for (auto&& [player, playerCollider] : playersView.each())
+}
+void GameServer::SendOutboundCommands()
+{
+    while (auto command{ m_Outbound.TryPop() })
     {
-        for (auto&& [wall, wallCollider] : wallsView.each())
+        if (command->MigrationTarget.has_value())
         {
-            game::collider::CollideCircleLine(playerCollider, wallCollider,
-                                              frameTime);
+            StartMigrationTransfer(*command);
+            continue;
         }
-
-        playerCollider.SetPosition(playerCollider.GetNextPosition(frameTime));
-        coordsMessage = { { "type", "coords" },
-                          { "payload",
-                            {
-                                { "id", player },
-                                { "x", playerCollider.GetPosition().x },
-                                { "y", playerCollider.GetPosition().y },
-                            } } };
-        SendMessageToAllClients(coordsMessage);
+        if (!m_IoConnections.contains(command->Connection))
+        {
+            // closed before the simulation heard about it
+            continue;
+        }
+        if (command->Data == nullptr)
+        {
+            m_Interface->CloseConnection(
+                command->Connection, k_ESteamNetConnectionEnd_App_Generic,
+                command->CloseReason.c_str(), false);
+            m_IoConnections.erase(command->Connection);
+            m_CompressingConnections.erase(command->Connection);
+            continue;
+        }
+        SendCompressible(command->Connection, command->Data,
+                         command->SendFlags);
     }
 }
-
-void GameServer::PollIncomingMessages()
+void GameServer::NegotiateCompression(HSteamNetConnection connection,
+                                      const json& offer)
 {
-    while (m_Alive)
+    m_CompressingConnections.erase(connection);
+    if (m_CompressionThreshold == 0 || !m_IoConnections.contains(connection) ||
+        !offer.is_object() || !offer.contains("codecs") ||
+        !offer["codecs"].is_array())
     {
-        ISteamNetworkingMessage* incomingMessage{ nullptr };
-        auto numMessages{ m_Interface->ReceiveMessagesOnPollGroup(
-            m_PollGroup, &incomingMessage, 1) };
+        return;
+    }
+    const auto& codecs{ offer["codecs"] };
+    if (std::find(codecs.begin(), codecs.end(), compression::Codec) ==
+        codecs.end())
+    {
+        return;
+    }
+    // frames with a dictionary the client doesn't have can't be decoded,
+    // plain zstd always can
+    m_CompressingConnections[connection] =
+        m_Compressor.GetDictionaryId() != 0 && offer.contains("dict_id") &&
+        offer["dict_id"].is_number_unsigned() &&
+        offer["dict_id"] == m_Compressor.GetDictionaryId();
+}
+void GameServer::SendCompressible(
+    HSteamNetConnection connection,
+    const std::shared_ptr<const std::string>& data, int32_t sendFlags)
+{
+    if (m_CompressionThreshold == 0)
+    {
+        // compression is off, but samples to train a dictionary for turning
+        // it on can still be recorded
+        if (m_SampleRecording.is_open() && data != m_LastLargeMessage)
+        {
+            m_LastLargeMessage = data;
+            compression::AppendSample(m_SampleRecording, *data);
+        }
+        SendMessageToConnection(connection, *data, sendFlags);
+        return;
+    }
+    if (data->size() < m_CompressionThreshold)
+    {
+        SendMessageToConnection(connection, *data, sendFlags);
+        return;
+    }
+    if (data != m_LastLargeMessage)
+    {
+        m_LastLargeMessage = data;
+        m_LastLargeStats =
+            &m_CompressionStats[std::string{ compression::PeekType(*data) }];
+        m_LastCompressed = {};
+        if (m_SampleRecording.is_open())
+        {
+            compression::AppendSample(m_SampleRecording, *data);
+        }
+    }
+
+    auto compressing{ m_CompressingConnections.find(connection) };
+    if (compressing == m_CompressingConnections.end())
+    {
+        SendMessageToConnection(connection, *data, sendFlags);
+        return;
+    }
 
-        if (numMessages == 0)
+    auto& stats{ *m_LastLargeStats };
+    auto& compressed{ m_LastCompressed[compressing->second ? 1 : 0] };
+    if (!compressed.Done)
+    {
+        auto compressStart{ std::chrono::steady_clock::now() };
+        compressed.Smaller =
+            m_Compressor.Compress(*data, compressing->second, compressed.Frame);
+        compressed.Done = true;
+        stats.CpuNs.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - compressStart)
+                .count()));
+        auto frameSize{ compressed.Smaller ? compressed.Frame.size()
+                                           : data->size() };
+        stats.RatioPermille.Record(frameSize * 1000 / data->size());
+    }
+    const auto& sent{ compressed.Smaller ? compressed.Frame : *data };
+    stats.Messages++;
+    stats.BytesIn += data->size();
+    stats.BytesOut += sent.size();
+    SendMessageToConnection(connection, sent, sendFlags);
+}
+void GameServer::FlushCompressionStats()
+{
+    for (auto& [type, stats] : m_CompressionStats)
+    {
+        if (stats.Messages == 0)
         {
-            break;
+            continue;
         }
-        if (numMessages < 0)
+        auto prefix{ "compression." + type };
+        m_Metrics.AddCounter(prefix + ".messages", stats.Messages);
+        m_Metrics.AddCounter(prefix + ".bytes_in", stats.BytesIn);
+        m_Metrics.AddCounter(prefix + ".bytes_out", stats.BytesOut);
+        m_Metrics.MergeHistogram(prefix + ".cpu_ns", stats.CpuNs);
+        m_Metrics.MergeHistogram(prefix + ".ratio_permille",
+                                 stats.RatioPermille);
+        stats = {};
+    }
+}
+void GameServer::SampleLinks()
+{
+    for (auto connection : m_IoConnections)
+    {
+        SteamNetConnectionRealTimeStatus_t status{};
+        if (m_Interface->GetConnectionRealTimeStatus(connection, &status, 0,
+                                                     nullptr) != k_EResultOK)
         {
-            std::cerr << "Error polling message\n";
+            continue;
         }
 
-        assert(numMessages && incomingMessage);
+        LinkSample sample;
+        sample.PingMs = status.m_nPing;
+        // delivery rate the client sees, so loss on the way to it. Negative
+        // while GNS has no estimate yet.
+        sample.Loss = status.m_flConnectionQualityRemote < 0
+                          ? 0.F
+                          : 1.F - status.m_flConnectionQualityRemote;
+        sample.PendingReliableBytes = status.m_cbPendingReliable;
+        sample.PendingUnreliableBytes = status.m_cbPendingUnreliable;
+        sample.SendRateBytesPerSecond = status.m_nSendRateBytesPerSecond;
+        sample.QueueTime = std::chrono::microseconds{ status.m_usecQueueTime };
 
-        std::string messageString;
-        messageString.assign(static_cast<const char*>(incomingMessage->m_pData),
-                             incomingMessage->m_cbSize);
+        InboundEvent event;
+        event.EventType = InboundEvent::Type::LinkStatus;
+        event.Connection = connection;
+        event.Link = sample;
+        // a sample that doesn't fit is dropped, the next one is a tick away
+        if (!m_Inbound.TryPush(std::move(event)))
+        {
+            m_Metrics.AddCounter("link.dropped_samples");
+        }
+    }
+}
+void GameServer::StartMigrationTransfer(const OutboundCommand& command)
+{
+    SteamNetworkingConfigValue_t opt{};
+    opt.SetPtr(
+        k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged,
+        reinterpret_cast<void*>(SteamNetConnectionStatusChangedCallback));
+    m_MigrationConnection =
+        m_Interface->ConnectByIPAddress(*command.MigrationTarget, 1, &opt);
+    if (m_MigrationConnection == k_HSteamNetConnection_Invalid)
+    {
+        std::cerr << "Failed to connect to "
+                  << FormatAddress(*command.MigrationTarget) << '\n';
+        PushInbound({ InboundEvent::Type::MigrationFailed,
+                      k_HSteamNetConnection_Invalid, {} });
+        return;
+    }
 
-        incomingMessage->Release();
+    // queued until the connection is up
+    SendMessageToConnection(m_MigrationConnection, *command.Data);
+    m_MigrationDeadline = std::chrono::steady_clock::now() + s_MigrationTimeout;
+}
+void GameServer::PollMigrationTransfer()
+{
+    if (m_MigrationConnection == k_HSteamNetConnection_Invalid)
+    {
+        return;
+    }
 
-        json messageJson = json::parse(messageString);
+    ISteamNetworkingMessage* message{ nullptr };
+    if (m_Interface->ReceiveMessagesOnConnection(m_MigrationConnection,
+                                                 &message, 1) > 0)
+    {
+        const auto* data{ static_cast<const char*>(message->m_pData) };
+        auto reply{ json::parse(data, data + message->m_cbSize, nullptr,
+                                false) };
+        message->Release();
+        if (!reply.is_discarded() &&
+            reply.value("type", std::string{}) == "migration_ready")
+        {
+            EndMigrationTransfer(InboundEvent::Type::MigrationReady);
+            return;
+        }
+    }
 
-        ProcessMessage(std::move(messageJson));
+    if (std::chrono::steady_clock::now() >= m_MigrationDeadline)
+    {
+        std::cerr << "Migration target did not take the room in time\n";
+        EndMigrationTransfer(InboundEvent::Type::MigrationFailed);
+    }
+}
+void GameServer::EndMigrationTransfer(InboundEvent::Type outcome)
+{
+    m_Interface->CloseConnection(m_MigrationConnection, 0, nullptr, false);
+    m_MigrationConnection = k_HSteamNetConnection_Invalid;
+    PushInbound({ outcome, k_HSteamNetConnection_Invalid, {} });
+}
+void GameServer::PushInbound(InboundEvent&& event)
+{
+    if (!m_InboundOverflow.empty() || !m_Inbound.TryPush(std::move(event)))
+    {
+        m_InboundOverflow.push_back(std::move(event));
+    }
+    WakeSimulation();
+}
+void GameServer::FlushInboundOverflow()
+{
+    while (!m_InboundOverflow.empty() &&
+           m_Inbound.TryPush(std::move(m_InboundOverflow.front())))
+    {
+        m_InboundOverflow.pop_front();
+    }
+}
+void GameServer::WakeSimulation()
+{
+    // pairs with the fence in Hibernate: either we see it parked, or it sees
+    // our event before waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_SimulationParked.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    {
+        std::lock_guard lock{ m_WakeMutex };
+        m_WakeRequested = true;
     }
+    m_WakeCondition.notify_one();
 }
 
 void GameServer::NotifyEntityDestruction(IdType id)
@@ -272,11 +1780,31 @@ void GameServer::NotifyEntityDestruction(IdType id)
     json destroyMessage = { { "type", "destroy" },
                             { "payload", { { "id", id } } } };
     SendMessageToAllClients(destroyMessage);
+    for (auto& [connection, client] : m_ClientMap)
+    {
+        client.Scheduler.Forget(id);
+    }
 }
 
 void GameServer::OnConnectionStatusChanged(
     SteamNetConnectionStatusChangedCallback_t* info)
 {
+    if (info->m_hConn == m_MigrationConnection &&
+        m_MigrationConnection != k_HSteamNetConnection_Invalid)
+    {
+        if (info->m_info.m_eState ==
+                k_ESteamNetworkingConnectionState_ClosedByPeer ||
+            info->m_info.m_eState ==
+                k_ESteamNetworkingConnectionState_ProblemDetectedLocally)
+        {
+            std::cerr << "Lost migration target: "
+                      << info->m_info.m_szEndDebug << '\n';
+            EndMigrationTransfer(InboundEvent::Type::MigrationFailed);
+        }
+        // outgoing, nothing to accept
+        return;
+    }
+
     switch (info->m_info.m_eState)
     {
     case k_ESteamNetworkingConnectionState_None:
@@ -286,14 +1814,14 @@ void GameServer::OnConnectionStatusChanged(
     case k_ESteamNetworkingConnectionState_ClosedByPeer:
     case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
     {
-        auto playerId{ m_ClientMap[info->m_hConn] };
-        NotifyEntityDestruction(playerId);
-        m_Registry.destroy(playerId);
-
-        m_ClientMap.erase(info->m_hConn);
         m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
-
-        m_RedisClient->decr(m_Name + ".player_count");
+        m_CompressingConnections.erase(info->m_hConn);
+        if (m_IoConnections.erase(info->m_hConn) == 0)
+        {
+            // never accepted, or already closed by us
+            break;
+        }
+        PushInbound({ InboundEvent::Type::Disconnected, info->m_hConn, {} });
 
         std::cout << "Disconnected this one: "
                   << std::string{ info->m_info.m_szConnectionDescription }
@@ -302,12 +1830,24 @@ void GameServer::OnConnectionStatusChanged(
     }
     case k_ESteamNetworkingConnectionState_Connecting:
     {
-        assert(m_ClientMap.count(info->m_hConn) == 0);
-
         std::cout << "Connecting this guy: "
                   << std::string{ info->m_info.m_szConnectionDescription }
                   << '\n';
 
+        // exact checks happen on join, this only caps connections at what
+        // could ever join
+        if (std::cmp_greater_equal(m_IoConnections.size(),
+                                   static_cast<std::size_t>(
+                                       m_SessionOptions.MaxPlayers) +
+                                       s_MaxSpectators))
+        {
+            m_Interface->CloseConnection(info->m_hConn,
+                                         k_ESteamNetConnectionEnd_App_Generic,
+                                         "Room is full", false);
+            std::cout << "Room is full, rejecting connection\n";
+            break;
+        }
+
         if (m_Interface->AcceptConnection(info->m_hConn) != k_EResultOK)
         {
             m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
@@ -322,34 +1862,8 @@ void GameServer::OnConnectionStatusChanged(
             break;
         }
 
-        json greetingJson = { { "type", "greeting" },
-                              { "payload", GetCurrentStateJson() } };
-
-        auto newPlayerId{ m_Registry.create() };
-
-        greetingJson["payload"]["player_id"] = newPlayerId;
-        greetingJson["payload"]["player_x"] = s_PlayerSpawnPos.x;
-        greetingJson["payload"]["player_y"] = s_PlayerSpawnPos.y;
-        SendMessageToConnection(info->m_hConn,
-                                greetingJson); // we just need id for greeting
-
-        // for simplicity spawn is fixed
-        m_Registry.emplace<game::CircleCollider>(newPlayerId, s_PlayerSpawnPos,
-                                                 m_SessionOptions.PlayerRadius);
-        m_Registry.emplace<game::PlayerTag>(newPlayerId);
-        json newConnectionJson = { { "type", "connection" },
-                                   { "payload",
-                                     {
-                                         { "id", newPlayerId },
-                                         { "x", s_PlayerSpawnPos.x },
-                                         { "y", s_PlayerSpawnPos.y },
-                                     } } };
-        SendMessageToAllClients(newConnectionJson);
-
-        m_ClientMap[info->m_hConn] = newPlayerId;
-        m_RedisClient->incr(m_Name + ".player_count");
-        std::cout << "Successful connection. Player id: " << newPlayerId
-                  << '\n';
+        m_IoConnections.insert(info->m_hConn);
+        PushInbound({ InboundEvent::Type::Connected, info->m_hConn, {} });
         break;
     }
     case k_ESteamNetworkingConnectionState_Connected:
@@ -358,7 +1872,25 @@ void GameServer::OnConnectionStatusChanged(
     }
     }
 }
-auto GameServer::GetCurrentStateJson() const -> json
+auto GameServer::BuildGreetingPrefix(IdType playerId, Vector2 position) const
+    -> std::string
+{
+    // should the room crash or move, this gets the client its player back
+    auto resumeToken{ discovery::SignReservation(
+        { playerId, std::chrono::system_clock::now() + s_ResumeTokenTtl },
+        discovery::TokenPurpose::Resume, m_Name, m_ReservationKey) };
+    json playerJson = { { "player_id", playerId },
+                        { "player_x", position.x },
+                        { "player_y", position.y },
+                        { "resume_token", resumeToken } };
+    auto playerFields{ playerJson.dump() };
+    playerFields.pop_back();
+
+    return R"({"type":"greeting","payload":)" + playerFields +
+           R"(,"session_hash":")" + m_SessionBlob.Hash + R"(")";
+}
+auto GameServer::BuildGreeting(const std::string& greetingPrefix) const
+    -> std::string
 {
     auto playersView{ m_Registry.view<game::PlayerTag>() };
     std::vector<json> players;
@@ -371,24 +1903,23 @@ auto GameServer::GetCurrentStateJson() const -> json
                             { "y", playerCollider.GetPosition().y } });
     }
 
-    auto bulletsView{
-        m_Registry.view<game::BulletTag, game::CircleCollider>()
-    };
+    auto bulletIds{ m_Bullets.GetIds() };
+    auto shooters{ m_Bullets.GetShooters() };
+    auto positions{ m_Bullets.GetPositions() };
+    auto velocities{ m_Bullets.GetVelocities() };
     std::vector<json> bullets;
-    for (auto&& [entity, tag, collider] : bulletsView.each())
+    for (std::size_t idx{ 0 }; idx < bulletIds.size(); idx++)
     {
-        bullets.push_back({ { "id", entity },
-                            { "x", collider.GetPosition().x },
-                            { "y", collider.GetPosition().y },
-                            { "shooter_id", tag.ShooterId },
-                            { "target_x", collider.GetVelocity().x },
-                            { "target_y", collider.GetVelocity().y } });
+        bullets.push_back({ { "id", bulletIds[idx] },
+                            { "x", positions[idx].x },
+                            { "y", positions[idx].y },
+                            { "shooter_id", shooters[idx] },
+                            { "target_x", velocities[idx].x },
+                            { "target_y", velocities[idx].y } });
     }
 
-    json state = m_SessionOptions.ToJSON();
-    state["players"] = players;
-    state["bullets"] = bullets;
-    return state;
+    return greetingPrefix + R"(,"players":)" + json(players).dump() +
+           R"(,"bullets":)" + json(bullets).dump() + "}}";
 }
 void GameServer::Stop()
 {
@@ -1,11 +1,33 @@
 #pragma once
+#include "BulletPool.hpp"
+#include "Checkpointer.hpp"
+#include "Compression.hpp"
+#include "Discovery.hpp"
+#include "GameMap.hpp"
+#include "LatencyTrace.hpp"
+#include "LinkQuality.hpp"
+#include "Metrics.hpp"
+#include "OutboundScheduler.hpp"
+#include "RedisWriter.hpp"
+#include "RoomState.hpp"
+#include "ReservationToken.hpp"
 #include "ServerBase.hpp"
+#include "SessionBlob.hpp"
 #include "SessionOptions.hpp"
+#include "SpscQueue.hpp"
+#include "TickScheduler.hpp"
 #include "Typedefs.hpp"
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <entt/entt.hpp>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <nlohmann/json.hpp>
 #include <raylib.h>
 #include <raymath.h>
@@ -13,56 +35,428 @@
 #include <sw/redis++/redis++.h>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace smp::server
 {
 
 using namespace sw;
 
+// Networking runs on its own I/O thread: it owns every GNS call after
+// startup, decodes incoming messages and sends already encoded ones. The
+// simulation thread only exchanges in-memory events with it through SPSC
+// queues, so GNS stalls don't show up in tick time.
 class GameServer : public ServerBase
 {
+    // decoded by the I/O thread, consumed by the simulation
+    struct InboundEvent
+    {
+        enum class Type
+        {
+            Connected,
+            Disconnected,
+            Message,
+            // player input, already checked, Input holds the velocity or
+            // the aim. A move's trace (if any) is in Message.
+            Move,
+            Shoot,
+            LinkStatus,
+            // the migration target took the room, or never will
+            MigrationReady,
+            MigrationFailed
+        };
+
+        Type EventType{ Type::Message };
+        HSteamNetConnection Connection{ k_HSteamNetConnection_Invalid };
+        json Message;
+        Vector2 Input{};
+        LinkSample Link;
+    };
+
+    // encoded by the simulation, sent by the I/O thread. No data means the
+    // connection has to be closed.
+    struct OutboundCommand
+    {
+        HSteamNetConnection Connection{ k_HSteamNetConnection_Invalid };
+        // shared by all receivers of a broadcast
+        std::shared_ptr<const std::string> Data;
+        std::string CloseReason;
+        int32_t SendFlags{ k_nSteamNetworkingSend_Reliable };
+        // set to send Data (a signed room state) to a standby server at this
+        // address instead, Connection is unused then
+        std::optional<SteamNetworkingIPAddr> MigrationTarget;
+    };
+
+    struct Client
+    {
+        IdType PlayerId;
+        OutboundScheduler Scheduler;
+        LinkQualityMonitor Link;
+    };
+
 public:
+    // clientBytesPerSecond caps what each client is sent, 0 for no limit
     GameServer(const std::string& redisHost, int32_t redisPort,
-               game::SessionOptions options);
+               const std::string& name, game::GameMap map,
+               uint32_t clientBytesPerSecond);
 
     virtual ~GameServer();
 
+    // how long restored players wait for their clients
+    static constexpr std::chrono::seconds MigrationResumeTimeout{ 10 };
+    // clients only notice a crash once their connection times out
+    static constexpr std::chrono::seconds RestoreResumeTimeout{ 30 };
+
+    // continues a room another process was running (or a crashed one from
+    // its checkpoint), call before Run. Its players get resumeTimeout to
+    // come back with their resume tokens.
+    void Restore(const RoomState& state, std::chrono::seconds resumeTimeout);
+    // writes the room to path every intervalTicks for Restore, call before
+    // Run
+    void EnableCheckpoints(const std::string& path, uint32_t intervalTicks);
+    // share of the traced inputs clients send that we follow up on, see
+    // LatencyTrace.hpp. Clients pick what they trace, this caps our part.
+    void SetTraceSampleRate(double rate);
+    // messages of at least this many bytes go out compressed to clients
+    // that offered zstd, 0 sends everything as is. Call before Run.
+    void SetCompressionThreshold(std::size_t bytes);
+    // appends every distinct message compression would consider to path,
+    // training material for shooter-mapc --samples. Call before Run.
+    void RecordCompressionSamples(const std::string& path);
+
     void Run(const std::string& addrIpv4) override;
+    // safe to call from a signal handler
     void Stop();
 
+    // wall time spent ticking with players vs parked with none
+    [[nodiscard]] auto GetActiveTime() const -> std::chrono::nanoseconds;
+    [[nodiscard]] auto GetIdleTime() const -> std::chrono::nanoseconds;
+
 private:
-    void ProcessMessage(json&& messageJson);
+    void ProcessMessage(HSteamNetConnection connection, json&& messageJson);
+    // ids in the message are never trusted, input only ever steers the
+    // sender's own player
+    void HandleInput(const InboundEvent& event);
 
+    // simulation side of the outbound queue
     void SendMessageToAllClients(const json& message);
+    void QueueMessage(HSteamNetConnection connection,
+                      std::shared_ptr<const std::string> message,
+                      int32_t sendFlags = k_nSteamNetworkingSend_Reliable);
+    void QueueMessage(HSteamNetConnection connection, std::string message);
+    void QueueClose(HSteamNetConnection connection, std::string reason);
+    void QueueOutbound(OutboundCommand&& command);
+    void FlushOutboundOverflow();
+    void DrainInboundEvents();
+    void HandleDisconnect(HSteamNetConnection connection);
+    // lowers or restores the client's update rate as its link changes
+    void HandleLinkSample(HSteamNetConnection connection,
+                          const LinkSample& sample);
 
     void UpdateGameState(float frameTime);
+    // the trace rides on the next position update of that player
+    void AcceptTrace(IdType playerId, const json& trace);
+    void AddEntityUpdate(IdType id, EntityKind kind, Vector2 position);
+    // every client gets what its scheduler picks from this tick's updates
+    void SendEntityUpdates();
+    // true if it hit any wall, stops at the first one
+    auto CollideWithWalls(game::CircleCollider& collider, float frameTime)
+        -> bool;
 
-    void PollIncomingMessages();
-
+    // I/O thread
+    void RunNetworkIo();
+    void ReceiveIncomingMessages();
+    void SendOutboundCommands();
+    // offers come with join and again once the client has our dictionary
+    void NegotiateCompression(HSteamNetConnection connection,
+                              const json& offer);
+    void SendCompressible(HSteamNetConnection connection,
+                          const std::shared_ptr<const std::string>& data,
+                          int32_t sendFlags);
+    void SampleLinks();
+    void FlushCompressionStats();
+    void StartMigrationTransfer(const OutboundCommand& command);
+    // waits for the target's answer, gives up at the deadline
+    void PollMigrationTransfer();
+    void EndMigrationTransfer(InboundEvent::Type outcome);
+    void PushInbound(InboundEvent&& event);
+    void FlushInboundOverflow();
     void OnConnectionStatusChanged(
         SteamNetConnectionStatusChangedCallback_t* info) override;
 
+    // lets a hibernating simulation know there is something to look at
+    void WakeSimulation();
+
     void RegisterSelfInRedis();
+    // tells entry points what changed without them having to poll, only the
+    // latest update with the same tag is sent
+    void PublishDiscoveryUpdate(json update, const std::string& coalesceTag);
+    void PublishPlayerCount();
 
     void NotifyEntityDestruction(IdType id);
 
-    [[nodiscard]] auto GetCurrentStateJson() const -> json;
+    // load report for entry points, also keeps our registration from expiring
+    void SendHeartbeat();
+    void SendHeartbeatIfDue();
+    void FlushLinkStats();
+
+    // Migration: the room stops ticking, its state goes to the standby
+    // server at the target and, once that one runs it, every client is
+    // redirected there. The room resumes here if the target doesn't answer.
+    void BeginMigrationIfRequested();
+    void ContinueMigration();
+    void RedirectClients();
+    void AbortMigration();
+    [[nodiscard]] auto CaptureRoomState() const -> RoomState;
+    // players and bullets only, the rest of the state never changes
+    void CaptureEntities(RoomState& state) const;
+    // copies entities for the checkpointer's thread, nothing is serialized
+    // or written here
+    void CaptureCheckpoint();
+
+    // blocks until someone connects or a slot is reserved (or we are stopped)
+    void Hibernate();
+    [[nodiscard]] auto IsIdle() const -> bool;
+
+    // runs on its own thread, verifies tokens published by entry points and
+    // takes migration requests
+    void RunReservationListener();
+    void ReceiveReservation(const std::string& message);
+    void ReceiveMigrationRequest(const std::string& message);
+    // moves verified reservations into the tick thread and pre-creates their
+    // players, drops the ones nobody claimed in time
+    void PrepareReservations();
+    void ExpirePendingJoins();
+    // players, players expected back and reserved slots
+    [[nodiscard]] auto TakenSlots() const -> std::size_t;
+
+    void HandleJoin(HSteamNetConnection connection, const json& payload);
+    // player of a migrated room coming back with the token it was
+    // redirected with
+    void HandleResume(HSteamNetConnection connection, const json& token);
+    // read-only watchers (usually a relay), they get the full outbound
+    // stream but no player and no slot
+    void HandleSpectatorJoin(HSteamNetConnection connection);
+    void SpawnPlayer(HSteamNetConnection connection, IdType playerId,
+                     const std::string& greetingPrefix);
+
+    // greeting is spliced from pre-serialized parts, only players and bullets
+    // are serialized at join time. Spectators get a prefix without a player.
+    [[nodiscard]] auto BuildGreetingPrefix(IdType playerId,
+                                           Vector2 position) const
+        -> std::string;
+    [[nodiscard]] auto BuildGreeting(const std::string& greetingPrefix) const
+        -> std::string;
 
 private:
     static constexpr Vector2 s_PlayerSpawnPos{ 300, 300 };
+    // shots beyond it are dropped until some bullet hits something
+    static constexpr uint32_t s_BulletCapacity{ 1 << 14 };
+    static constexpr std::chrono::milliseconds s_RegistrationTtl{
+        discovery::HeartbeatTtl
+    };
+    static constexpr uint64_t s_HeartbeatLogInterval{ 10 };
+    static constexpr std::size_t s_QueueCapacity{ 1 << 16 };
+    static constexpr int32_t s_ReceiveBatchSize{ 64 };
+    // longest the I/O thread sleeps in GNS while anyone is connected, the
+    // simulation's outbound commands wait for its next wakeup
+    static constexpr std::chrono::milliseconds s_NetworkWait{ 1 };
+    static constexpr std::chrono::microseconds s_LinkSampleInterval{
+        ServerBase::TickTimeMicroseconds
+    };
+    // nobody connected, a packet of a new connection wakes us earlier
+    static constexpr std::chrono::milliseconds s_NetworkIdleWait{ 100 };
+    // how long Stop may go unnoticed by a hibernating room, nothing can
+    // notify it from a signal handler
+    static constexpr std::chrono::milliseconds s_HibernateStopCheck{ 100 };
+    static constexpr std::chrono::seconds s_JoinTimeout{ 5 };
+    // audiences are meant to go through relays, so a few are enough
+    static constexpr std::size_t s_MaxSpectators{ 4 };
+    static constexpr std::chrono::milliseconds s_SubscriberTimeout{ 200 };
+    // players hold still for this long at most, then the room resumes here
+    static constexpr std::chrono::seconds s_MigrationTimeout{ 2 };
+    static constexpr std::chrono::milliseconds s_MigrationFlushTimeout{ 500 };
+    // redirected clients disconnect by themselves, stragglers are dropped
+    static constexpr std::chrono::seconds s_MigrationDrainTimeout{ 2 };
+    // lets clients of a crashed room reconnect as the same player
+    static constexpr std::chrono::hours s_ResumeTokenTtl{ 1 };
+    static constexpr std::chrono::microseconds s_MigrationPollInterval{
+        1000
+    };
 
-    std::unique_ptr<redis::Redis> m_RedisClient;
+    struct Migration
+    {
+        std::string TargetHost;
+        int32_t TargetPort;
+        std::chrono::steady_clock::time_point FrozenAt;
+        // clients were redirected, the room is the target's now
+        bool HandedOver{ false };
+        std::chrono::steady_clock::time_point DrainUntil;
+    };
+
+    struct CompressedMessage
+    {
+        bool Done{ false };
+        // not worth it otherwise, the message goes out as is
+        bool Smaller{ false };
+        std::string Frame;
+    };
+
+    // compression results of one message type, I/O thread only. Merged
+    // into m_Metrics once per heartbeat interval, so sends take no lock.
+    struct CompressionStats
+    {
+        uint64_t Messages{ 0 };
+        uint64_t BytesIn{ 0 };
+        uint64_t BytesOut{ 0 };
+        // once per buffer and dictionary choice, not per receiver
+        metrics::Histogram CpuNs;
+        metrics::Histogram RatioPermille;
+    };
+
+    // link samples of all clients, tick thread only. Recorded without the
+    // metrics lock and merged into m_Metrics with every heartbeat.
+    struct LinkStats
+    {
+        metrics::Histogram PingMs;
+        metrics::Histogram LossPermille;
+        metrics::Histogram PendingBytes;
+        metrics::Histogram SendRateBytesPerSecond;
+        metrics::Histogram QueueTimeUs;
+    };
+
+    struct PreparedJoin
+    {
+        IdType PlayerId;
+        std::chrono::system_clock::time_point ExpiresAt;
+        std::string GreetingPrefix;
+    };
+
+    // all redis I/O happens on the writer's thread, never in the tick
+    std::unique_ptr<RedisWriter> m_RedisWriter;
     std::string m_Name;
     std::string m_Host;
     int32_t m_Port;
+    json m_EndpointInfo;
 
-    std::unordered_map<HSteamNetConnection, IdType> m_ClientMap;
+    std::unordered_map<HSteamNetConnection, Client> m_ClientMap;
+    std::unordered_set<HSteamNetConnection> m_Spectators;
+    uint32_t m_ClientBytesPerTick;
+    // rebuilt every tick, reused to keep capacity
+    std::vector<EntityUpdate> m_EntityUpdates;
+    std::vector<uint32_t> m_SelectedUpdates;
+    // accepted connections that have not sent their join message yet
+    std::unordered_map<HSteamNetConnection,
+                       std::chrono::steady_clock::time_point>
+        m_PendingJoins;
     HSteamNetPollGroup m_PollGroup{ k_HSteamNetPollGroup_Invalid };
 
+    // walls are looked up through its grid, indices match
+    // m_SessionOptions.Walls
+    game::GameMap m_Map;
     game::SessionOptions m_SessionOptions;
+    // never changes for the life of the room, so it is serialized once and
+    // greetings only carry its hash
+    game::SessionBlob m_SessionBlob;
+    std::shared_ptr<const std::string> m_SessionMessage;
+    std::string m_SpectatorGreetingPrefix;
     entt::basic_registry<IdType> m_Registry;
+    // bullets live outside the registry, their ids don't overlap its
+    BulletPool m_Bullets{ s_BulletCapacity };
+    // rebuilt every tick, reused to keep capacity
+    std::vector<BulletTarget> m_BulletTargets;
+    std::vector<BulletHit> m_BulletHits;
+
+    discovery::ReservationKey m_ReservationKey{
+        discovery::LoadReservationKey()
+    };
+    std::unique_ptr<redis::Redis> m_ReservationSubscriberClient;
+    std::unique_ptr<std::thread> m_ReservationThread;
+    std::mutex m_IncomingReservationsMutex;
+    std::vector<discovery::Reservation> m_IncomingReservations;
+    // keyed by slot id, only touched by the tick thread
+    std::unordered_map<uint64_t, PreparedJoin> m_Reservations;
+    // slot ids somebody joined with, kept until their token expires so a
+    // token is good for one join only
+    std::unordered_map<uint64_t, std::chrono::system_clock::time_point>
+        m_ConsumedSlots;
+
+    // parsed by the listener thread
+    std::mutex m_IncomingMigrationMutex;
+    std::optional<SteamNetworkingIPAddr> m_IncomingMigrationTarget;
+    // only touched by the tick thread
+    std::optional<Migration> m_Migration;
+    // joins that came in while frozen, replayed if the room stays
+    std::vector<std::pair<HSteamNetConnection, json>> m_DeferredJoins;
+    // restored players whose clients have not reconnected yet
+    std::unordered_map<IdType, std::chrono::steady_clock::time_point>
+        m_ResumingPlayers;
+    // when the room stopped on the server it was moved from
+    std::chrono::system_clock::time_point m_MigratedAt;
+    uint64_t m_Tick{ 0 };
+
+    std::unique_ptr<Checkpointer> m_Checkpointer;
+    uint32_t m_CheckpointInterval{ 0 };
+
+    std::unique_ptr<std::thread> m_NetworkThread;
+    SpscQueue<InboundEvent> m_Inbound{ s_QueueCapacity };
+    SpscQueue<OutboundCommand> m_Outbound{ s_QueueCapacity };
+    // spill for a full queue, each owned by that queue's producer
+    std::deque<InboundEvent> m_InboundOverflow;
+    std::deque<OutboundCommand> m_OutboundOverflow;
+    // connections the I/O thread has accepted and not closed yet
+    std::unordered_set<HSteamNetConnection> m_IoConnections;
+    std::chrono::steady_clock::time_point m_LastLinkSample;
+    // outgoing connection to a migration target, I/O thread only
+    HSteamNetConnection m_MigrationConnection{ k_HSteamNetConnection_Invalid };
+    std::chrono::steady_clock::time_point m_MigrationDeadline;
+
+    // I/O thread only. Connections that decode zstd, true once they have
+    // our dictionary too.
+    std::unordered_map<HSteamNetConnection, bool> m_CompressingConnections;
+    compression::Compressor m_Compressor{ m_Map.GetDictionary() };
+    std::size_t m_CompressionThreshold{ compression::DefaultThreshold };
+    std::ofstream m_SampleRecording;
+    // broadcasts share one buffer, so it is compressed once per dictionary
+    // choice rather than once per receiver
+    std::shared_ptr<const std::string> m_LastLargeMessage;
+    std::array<CompressedMessage, 2> m_LastCompressed;
+    // keyed by message type, entries are never erased so the pointer to the
+    // last large message's stays valid
+    std::unordered_map<std::string, CompressionStats> m_CompressionStats;
+    CompressionStats* m_LastLargeStats{ nullptr };
+    std::chrono::steady_clock::time_point m_LastCompressionFlush;
+
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+    bool m_WakeRequested{ false };
+    std::atomic<bool> m_SimulationParked{ false };
+
+    // sent with heartbeats
+    metrics::Registry m_Metrics;
+    LinkStats m_LinkStats;
+    trace::Sampler m_TraceSampler{ 1.0 };
+    // accepted traces waiting for their player's next position update
+    std::unordered_map<IdType, json> m_PendingTraces;
+
+    // busy time of each thread, reported as utilization in heartbeats
+    std::atomic<uint64_t> m_IoBusyNanoseconds{ 0 };
+    std::chrono::nanoseconds m_SimBusyTime{ 0 };
+    uint64_t m_LastIoBusyNanoseconds{ 0 };
+    std::chrono::nanoseconds m_LastSimBusyTime{ 0 };
+
+    TickScheduler m_TickScheduler{ std::chrono::microseconds{
+        ServerBase::TickTimeMicroseconds } };
+    std::chrono::steady_clock::time_point m_ActiveSince;
+    std::chrono::nanoseconds m_ActiveTime{ 0 };
+    std::chrono::nanoseconds m_IdleTime{ 0 };
 
-    std::chrono::steady_clock::time_point m_TickStart;
+    std::chrono::steady_clock::time_point m_LastHeartbeat;
+    std::chrono::microseconds m_LastCpuTime{ 0 };
+    uint64_t m_LastBytesSent{ 0 };
+    uint64_t m_HeartbeatCount{ 0 };
 };
 
 } // namespace smp::server
@@ -0,0 +1,65 @@
+#include "LinkQuality.hpp"
+
+namespace smp::server
+{
+
+auto LinkQualityMonitor::IsBad(const LinkSample& sample) -> bool
+{
+    return sample.PingMs > s_BadPingMs || sample.Loss > s_BadLoss ||
+           sample.QueueTime > s_BadQueueTime;
+}
+auto LinkQualityMonitor::IsGood(const LinkSample& sample) -> bool
+{
+    return sample.PingMs < s_GoodPingMs && sample.Loss < s_GoodLoss &&
+           sample.QueueTime < s_GoodQueueTime;
+}
+
+auto LinkQualityMonitor::AddSample(const LinkSample& sample,
+                                   Clock::time_point now) -> bool
+{
+    m_LastSample = sample;
+
+    auto bad{ IsBad(sample) };
+    auto good{ IsGood(sample) };
+    if (bad && !m_Bad)
+    {
+        m_BadSince = now;
+    }
+    if (good && !m_Good)
+    {
+        m_GoodSince = now;
+    }
+    // samples between both thresholds break both runs
+    m_Bad = bad;
+    m_Good = good;
+
+    if (m_Bad && m_Level < MaxLevel && now - m_BadSince >= s_DegradeAfter)
+    {
+        m_Level++;
+        // the lower rate needs its own chance before going down again
+        m_BadSince = now;
+        return true;
+    }
+    if (m_Good && m_Level > 0 && now - m_GoodSince >= s_RecoverAfter)
+    {
+        m_Level--;
+        m_GoodSince = now;
+        return true;
+    }
+    return false;
+}
+
+auto LinkQualityMonitor::GetLevel() const -> uint32_t
+{
+    return m_Level;
+}
+auto LinkQualityMonitor::GetUpdateInterval() const -> uint32_t
+{
+    return 1U << m_Level;
+}
+auto LinkQualityMonitor::GetLastSample() const -> const LinkSample&
+{
+    return m_LastSample;
+}
+
+} // namespace smp::server
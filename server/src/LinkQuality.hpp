@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace smp::server
+{
+
+// what GNS reports about one connection, sampled by the I/O thread
+struct LinkSample
+{
+    int32_t PingMs{ 0 };
+    // fraction of packets lost on the way to the client, 0 when unknown
+    float Loss{ 0 };
+    int32_t PendingReliableBytes{ 0 };
+    int32_t PendingUnreliableBytes{ 0 };
+    // GNS estimate of what the link can take
+    int32_t SendRateBytesPerSecond{ 0 };
+    // how long a message queued now would wait before going on the wire
+    std::chrono::microseconds QueueTime{ 0 };
+};
+
+// Turns a stream of link samples into an update rate for one client. A
+// link has to look bad for a while before the rate drops and good for much
+// longer before it comes back, and in between the level holds, so a noisy
+// link settles instead of flapping.
+class LinkQualityMonitor
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t MaxLevel{ 2 };
+
+    // true if the level changed
+    auto AddSample(const LinkSample& sample, Clock::time_point now) -> bool;
+
+    // 0 is full rate, every level halves it
+    [[nodiscard]] auto GetLevel() const -> uint32_t;
+    [[nodiscard]] auto GetUpdateInterval() const -> uint32_t;
+    [[nodiscard]] auto GetLastSample() const -> const LinkSample&;
+
+private:
+    [[nodiscard]] static auto IsBad(const LinkSample& sample) -> bool;
+    [[nodiscard]] static auto IsGood(const LinkSample& sample) -> bool;
+
+private:
+    static constexpr int32_t s_BadPingMs{ 250 };
+    static constexpr int32_t s_GoodPingMs{ 150 };
+    static constexpr float s_BadLoss{ 0.05F };
+    static constexpr float s_GoodLoss{ 0.02F };
+    static constexpr std::chrono::milliseconds s_BadQueueTime{ 200 };
+    static constexpr std::chrono::milliseconds s_GoodQueueTime{ 50 };
+    static constexpr std::chrono::milliseconds s_DegradeAfter{ 500 };
+    static constexpr std::chrono::seconds s_RecoverAfter{ 5 };
+
+    uint32_t m_Level{ 0 };
+    LinkSample m_LastSample;
+    // start of the current run of bad or good samples, if there is one
+    Clock::time_point m_BadSince{};
+    Clock::time_point m_GoodSince{};
+    bool m_Bad{ false };
+    bool m_Good{ false };
+};
+
+} // namespace smp::server
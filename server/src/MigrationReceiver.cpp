@@ -0,0 +1,140 @@
+#include "MigrationReceiver.hpp"
+#include "TickScheduler.hpp"
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace smp::server
+{
+
+MigrationReceiver::~MigrationReceiver()
+{
+    if (m_Interface != nullptr)
+    {
+        // the source's connection is left to the room, it closes it itself
+        for (auto connection : m_Connections)
+        {
+            m_Interface->CloseConnection(connection, 0, nullptr, false);
+        }
+        m_Interface->DestroyPollGroup(m_PollGroup);
+    }
+    m_PollGroup = k_HSteamNetPollGroup_Invalid;
+}
+
+void MigrationReceiver::Run(const std::string& addrIpv4)
+{
+    SteamNetworkingIPAddr address{};
+    address.Clear();
+    address.ParseString(addrIpv4.c_str());
+    m_Address = FormatAddress(address);
+    InitConnection(addrIpv4);
+
+    m_PollGroup = m_Interface->CreatePollGroup();
+    if (m_PollGroup == k_HSteamNetPollGroup_Invalid)
+    {
+        std::cerr << "Failed to listen on " << addrIpv4 << '\n';
+        return;
+    }
+
+    std::cout << "Standing by for a room on " << addrIpv4 << '\n';
+    while (m_Alive && !m_State.has_value())
+    {
+        auto loopStart{ std::chrono::steady_clock::now() };
+
+        PollConnectionStateChanges();
+        ReceiveStates();
+
+        TickScheduler::SleepUntil(loopStart + s_PollInterval);
+    }
+}
+void MigrationReceiver::Stop()
+{
+    m_Alive = false;
+}
+
+auto MigrationReceiver::TakeState() -> std::optional<RoomState>
+{
+    return std::exchange(m_State, std::nullopt);
+}
+void MigrationReceiver::Acknowledge()
+{
+    json readyMessage = { { "type", "migration_ready" },
+                          { "payload", json::object() } };
+    SendMessageToConnection(m_Source, readyMessage);
+}
+
+void MigrationReceiver::ReceiveStates()
+{
+    std::array<ISteamNetworkingMessage*, s_ReceiveBatchSize> messages{};
+    auto numMessages{ m_Interface->ReceiveMessagesOnPollGroup(
+        m_PollGroup, messages.data(), s_ReceiveBatchSize) };
+    for (int32_t idx{ 0 }; idx < numMessages; idx++)
+    {
+        auto* message{ messages[idx] };
+        auto connection{ message->m_conn };
+        std::string_view data{ static_cast<const char*>(message->m_pData),
+                               static_cast<size_t>(message->m_cbSize) };
+
+        std::optional<RoomState> state;
+        try
+        {
+            state = VerifyRoomState(data, m_Address, m_Key);
+        }
+        catch (const std::runtime_error& error)
+        {
+            std::cerr << "Bad room state: " << error.what() << '\n';
+        }
+        message->Release();
+
+        if (!state.has_value() || m_State.has_value())
+        {
+            // only servers with our secret get to move rooms here, and only
+            // with a fresh state meant for us
+            m_Interface->CloseConnection(connection,
+                                         k_ESteamNetConnectionEnd_App_Generic,
+                                         "Not a room state", false);
+            m_Connections.erase(connection);
+            continue;
+        }
+
+        std::cout << "Received room " << state->Name << " at tick "
+                  << state->Tick << " with " << state->Players.size()
+                  << " players, " << state->Bullets.size() << " bullets\n";
+        m_State = std::move(state);
+        m_Source = connection;
+        m_Connections.erase(connection);
+    }
+}
+
+void MigrationReceiver::OnConnectionStatusChanged(
+    SteamNetConnectionStatusChangedCallback_t* info)
+{
+    switch (info->m_info.m_eState)
+    {
+    case k_ESteamNetworkingConnectionState_ClosedByPeer:
+    case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
+    {
+        m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+        m_Connections.erase(info->m_hConn);
+        break;
+    }
+    case k_ESteamNetworkingConnectionState_Connecting:
+    {
+        if (m_Interface->AcceptConnection(info->m_hConn) != k_EResultOK ||
+            !m_Interface->SetConnectionPollGroup(info->m_hConn, m_PollGroup))
+        {
+            m_Interface->CloseConnection(info->m_hConn, 0, nullptr, false);
+            break;
+        }
+        m_Connections.insert(info->m_hConn);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+
+} // namespace smp::server
@@ -0,0 +1,54 @@
+#pragma once
+#include "ReservationToken.hpp"
+#include "RoomState.hpp"
+#include "ServerBase.hpp"
+#include <chrono>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+namespace smp::server
+{
+
+// Standby end of a room migration. Listens on the address the room will run
+// at until the server currently running it pushes its signed RoomState.
+// The listen socket is then handed to the GameServer built from that state,
+// and only after that the source is told to redirect its players here, so
+// they never find the address closed.
+class MigrationReceiver : public ServerBase
+{
+public:
+    MigrationReceiver() = default;
+    virtual ~MigrationReceiver();
+
+    // returns once a valid room state arrived, or we were stopped
+    void Run(const std::string& addrIpv4) override;
+    // safe to call from a signal handler
+    void Stop();
+
+    [[nodiscard]] auto TakeState() -> std::optional<RoomState>;
+    // the room runs here now, the source sends its players over
+    void Acknowledge();
+
+private:
+    void ReceiveStates();
+
+    void OnConnectionStatusChanged(
+        SteamNetConnectionStatusChangedCallback_t* info) override;
+
+private:
+    static constexpr std::chrono::microseconds s_PollInterval{ 1000 };
+    static constexpr int32_t s_ReceiveBatchSize{ 16 };
+
+    discovery::ReservationKey m_Key{ discovery::LoadReservationKey() };
+    HSteamNetPollGroup m_PollGroup{ k_HSteamNetPollGroup_Invalid };
+    // accepted and not (yet) proven to be the source
+    std::unordered_set<HSteamNetConnection> m_Connections;
+    HSteamNetConnection m_Source{ k_HSteamNetConnection_Invalid };
+    // our address the way the source formats its target, states signed for
+    // another one are refused
+    std::string m_Address;
+    std::optional<RoomState> m_State;
+};
+
+} // namespace smp::server
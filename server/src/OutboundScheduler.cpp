@@ -0,0 +1,117 @@
+#include "OutboundScheduler.hpp"
+#include <algorithm>
+#include <raymath.h>
+
+namespace smp::server
+{
+
+OutboundScheduler::OutboundScheduler(uint32_t bytesPerTick)
+    : m_BytesPerTick{ bytesPerTick }
+{
+}
+
+void OutboundScheduler::Charge(std::size_t bytes)
+{
+    m_Tokens -= static_cast<int64_t>(bytes);
+    m_Stats.BytesSent += bytes;
+}
+
+auto OutboundScheduler::GetRelevance(const EntityUpdate& update,
+                                     IdType viewerId, Vector2 viewerPosition)
+    -> float
+{
+    auto weight{ update.Kind == EntityKind::Player ? s_PlayerWeight
+                                                   : s_BulletWeight };
+    if (update.Id == viewerId)
+    {
+        weight *= s_ViewerWeight;
+    }
+    auto distance{ Vector2Distance(update.Position, viewerPosition) };
+    return weight * s_RelevanceDistance / (s_RelevanceDistance + distance);
+}
+
+void OutboundScheduler::Schedule(std::span<const EntityUpdate> updates,
+                                 IdType viewerId, Vector2 viewerPosition,
+                                 std::vector<uint32_t>& selected)
+{
+    selected.clear();
+    m_Stats.Ticks++;
+    if (m_TickIndex++ % m_UpdateInterval != 0)
+    {
+        // not even accumulated, skipped ticks should cost no CPU either
+        m_Stats.SkippedTicks++;
+        return;
+    }
+
+    auto unlimited{ m_BytesPerTick == 0 };
+    if (!unlimited)
+    {
+        m_Stats.BytesGranted += m_BytesPerTick;
+        // a client that was overdrawn by reliable traffic pays it back over
+        // a few ticks instead of losing state updates for a long time
+        m_Tokens = std::clamp(m_Tokens + m_BytesPerTick,
+                              -s_BurstTicks * m_BytesPerTick,
+                              s_BurstTicks * m_BytesPerTick);
+    }
+
+    m_Candidates.clear();
+    for (uint32_t idx{ 0 }; idx < updates.size(); idx++)
+    {
+        auto& entity{ m_Entities[updates[idx].Id] };
+        entity.Priority +=
+            GetRelevance(updates[idx], viewerId, viewerPosition);
+        m_Candidates.push_back({ entity.Priority, idx, &entity });
+    }
+    std::sort(m_Candidates.begin(), m_Candidates.end(),
+              [](const Candidate& lhs, const Candidate& rhs)
+              { return lhs.Priority > rhs.Priority; });
+
+    for (const auto& candidate : m_Candidates)
+    {
+        const auto& update{ updates[candidate.Index] };
+        auto& entity{ *candidate.Entity };
+        auto size{ static_cast<int64_t>(update.Data->size()) };
+
+        // smaller updates further down may still fit, so keep looking
+        if (!unlimited && size > m_Tokens)
+        {
+            entity.TicksWaiting += m_UpdateInterval;
+            m_Stats.UpdatesDeferred++;
+            m_Stats.MaxStarvationTicks =
+                std::max(m_Stats.MaxStarvationTicks, entity.TicksWaiting);
+            if (entity.TicksWaiting > StarvationTicks)
+            {
+                m_Stats.StarvedEntityTicks++;
+            }
+            continue;
+        }
+
+        selected.push_back(candidate.Index);
+        Charge(update.Data->size());
+        entity.Priority = 0;
+        entity.TicksWaiting = 0;
+        m_Stats.UpdatesSent++;
+    }
+    m_Stats.EntityTicks += updates.size();
+}
+
+void OutboundScheduler::SetUpdateInterval(uint32_t intervalTicks)
+{
+    m_UpdateInterval = std::max(intervalTicks, 1U);
+}
+
+void OutboundScheduler::Forget(IdType id)
+{
+    m_Entities.erase(id);
+}
+
+auto OutboundScheduler::GetStats() const -> const OutboundStats&
+{
+    return m_Stats;
+}
+void OutboundScheduler::ResetStats()
+{
+    m_Stats = {};
+}
+
+} // namespace smp::server
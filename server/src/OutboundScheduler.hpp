@@ -0,0 +1,120 @@
+#pragma once
+#include "Typedefs.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <raylib.h>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace smp::server
+{
+
+enum class EntityKind
+{
+    Player,
+    Bullet
+};
+
+// state of one entity after this tick, encoded once and shared by every
+// client it is sent to
+struct EntityUpdate
+{
+    IdType Id;
+    EntityKind Kind;
+    Vector2 Position;
+    std::shared_ptr<const std::string> Data;
+};
+
+// per client, collected between two heartbeats
+struct OutboundStats
+{
+    uint64_t Ticks{ 0 };
+    // ticks skipped because of a lowered update rate
+    uint64_t SkippedTicks{ 0 };
+    uint64_t BytesGranted{ 0 };
+    // reliable messages included, they are charged against the same budget
+    uint64_t BytesSent{ 0 };
+    uint64_t UpdatesSent{ 0 };
+    uint64_t UpdatesDeferred{ 0 };
+    // ticks an entity went without an update, worst one seen
+    uint64_t MaxStarvationTicks{ 0 };
+    // entity-ticks spent waiting longer than StarvationTicks
+    uint64_t StarvedEntityTicks{ 0 };
+    uint64_t EntityTicks{ 0 };
+};
+
+// Decides which entity updates one client gets each tick. Every entity
+// accumulates priority each tick it is not sent, scaled by how relevant it
+// is to this client (kind, distance to the client's player), and the
+// highest ones are sent until the byte budget runs out. Sending resets the
+// accumulator, so far away entities still get their turn, just less often.
+class OutboundScheduler
+{
+public:
+    static constexpr uint64_t StarvationTicks{ 30 };
+
+    // bytesPerTick of 0 disables the budget, everything goes every tick
+    explicit OutboundScheduler(uint32_t bytesPerTick);
+
+    // reliable traffic (spawns, shots, destructions) always goes out, it is
+    // only charged so state updates get what is left
+    void Charge(std::size_t bytes);
+
+    // only every intervalTicks-th tick sends state updates and gets budget,
+    // used to slow down clients on bad links
+    void SetUpdateInterval(uint32_t intervalTicks);
+
+    // fills selected with indices into updates, in the order to send them
+    void Schedule(std::span<const EntityUpdate> updates, IdType viewerId,
+                  Vector2 viewerPosition, std::vector<uint32_t>& selected);
+
+    // entity was destroyed, its accumulator goes too
+    void Forget(IdType id);
+
+    [[nodiscard]] auto GetStats() const -> const OutboundStats&;
+    void ResetStats();
+
+private:
+    [[nodiscard]] static auto GetRelevance(const EntityUpdate& update,
+                                           IdType viewerId,
+                                           Vector2 viewerPosition) -> float;
+
+private:
+    // unused budget carries over, up to this many ticks worth of it
+    static constexpr int64_t s_BurstTicks{ 2 };
+    static constexpr float s_PlayerWeight{ 1.F };
+    static constexpr float s_BulletWeight{ 0.6F };
+    // the client's own player is what it notices first when it lags
+    static constexpr float s_ViewerWeight{ 4.F };
+    // relevance halves at this distance from the client's player
+    static constexpr float s_RelevanceDistance{ 200.F };
+
+    struct EntityState
+    {
+        float Priority{ 0 };
+        uint64_t TicksWaiting{ 0 };
+    };
+
+    struct Candidate
+    {
+        float Priority;
+        uint32_t Index;
+        // map nodes don't move, so this stays valid for the whole tick
+        EntityState* Entity;
+    };
+
+    int64_t m_BytesPerTick;
+    uint32_t m_UpdateInterval{ 1 };
+    uint64_t m_TickIndex{ 0 };
+    // goes negative when reliable traffic overdraws it
+    int64_t m_Tokens{ 0 };
+    std::unordered_map<IdType, EntityState> m_Entities;
+    // reused every tick to keep its capacity
+    std::vector<Candidate> m_Candidates;
+    OutboundStats m_Stats;
+};
+
+} // namespace smp::server
@@ -0,0 +1,141 @@
+#include "RoomState.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace smp::server
+{
+
+static_assert(std::is_trivially_copyable_v<RoomState::Player> &&
+              std::is_trivially_copyable_v<RoomState::Bullet>);
+
+template <class T>
+static void Append(std::string& data, const T* values, size_t count)
+{
+    data.append(reinterpret_cast<const char*>(values), sizeof(T) * count);
+}
+
+// copies out instead of pointing in, message buffers have no alignment
+// guarantees. Sizes are checked before allocating anything.
+template <class T>
+static auto Take(std::string_view& data, size_t count) -> std::vector<T>
+{
+    if (data.size() / sizeof(T) < count)
+    {
+        throw std::runtime_error{ "Room state is truncated" };
+    }
+    std::vector<T> values(count);
+    std::memcpy(values.data(), data.data(), sizeof(T) * count);
+    data.remove_prefix(sizeof(T) * count);
+    return values;
+}
+
+auto SerializeRoomState(const RoomState& state) -> std::string
+{
+    roomformat::Header header{
+        .Magic = roomformat::Magic,
+        .Version = roomformat::Version,
+        .Tick = state.Tick,
+        .CapturedAtMs = state.CapturedAtMs,
+        .NameLength = static_cast<uint32_t>(state.Name.size()),
+        .MapSize = static_cast<uint32_t>(state.Map.size()),
+        .PlayerCount = static_cast<uint32_t>(state.Players.size()),
+        .BulletCount = static_cast<uint32_t>(state.Bullets.size()),
+    };
+
+    std::string data;
+    data.reserve(sizeof(header) + state.Name.size() + state.Map.size() +
+                 sizeof(RoomState::Player) * state.Players.size() +
+                 sizeof(RoomState::Bullet) * state.Bullets.size());
+    Append(data, &header, 1);
+    Append(data, state.Name.data(), state.Name.size());
+    Append(data, state.Map.data(), state.Map.size());
+    Append(data, state.Players.data(), state.Players.size());
+    Append(data, state.Bullets.data(), state.Bullets.size());
+    return data;
+}
+
+auto DeserializeRoomState(std::string_view data) -> RoomState
+{
+    auto header{ Take<roomformat::Header>(data, 1).front() };
+    if (header.Magic != roomformat::Magic)
+    {
+        throw std::runtime_error{ "Not a room state" };
+    }
+    if (header.Version != roomformat::Version)
+    {
+        throw std::runtime_error{ "Unsupported room state version " +
+                                  std::to_string(header.Version) };
+    }
+
+    RoomState state;
+    state.Tick = header.Tick;
+    state.CapturedAtMs = header.CapturedAtMs;
+    auto name{ Take<char>(data, header.NameLength) };
+    state.Name.assign(name.begin(), name.end());
+    state.Map = Take<std::byte>(data, header.MapSize);
+    state.Players = Take<RoomState::Player>(data, header.PlayerCount);
+    state.Bullets = Take<RoomState::Bullet>(data, header.BulletCount);
+
+    if (!data.empty())
+    {
+        throw std::runtime_error{ "Trailing bytes after room state" };
+    }
+    return state;
+}
+
+// the target is never sent, both sides put it in front of what they sign
+static auto RoomStateMac(std::string_view target, std::string_view body,
+                         const discovery::ReservationKey& key) -> uint64_t
+{
+    std::string signedData;
+    signedData.reserve(target.size() + 1 + body.size());
+    signedData.append(target).append(1, '\n').append(body);
+    return discovery::ComputeMac(signedData, key);
+}
+
+auto SignRoomState(const RoomState& state, std::string_view target,
+                   std::chrono::system_clock::time_point expiresAt,
+                   const discovery::ReservationKey& key) -> std::string
+{
+    int64_t expiresAtMs{
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            expiresAt.time_since_epoch())
+            .count()
+    };
+    std::string body;
+    Append(body, &expiresAtMs, 1);
+    body += SerializeRoomState(state);
+    auto mac{ RoomStateMac(target, body, key) };
+
+    std::string data;
+    data.reserve(sizeof(mac) + body.size());
+    Append(data, &mac, 1);
+    data += body;
+    return data;
+}
+
+auto VerifyRoomState(std::string_view data, std::string_view target,
+                     const discovery::ReservationKey& key)
+    -> std::optional<RoomState>
+{
+    if (data.size() < sizeof(uint64_t) + sizeof(int64_t))
+    {
+        return std::nullopt;
+    }
+    auto mac{ Take<uint64_t>(data, 1).front() };
+    if (!discovery::MacEquals(RoomStateMac(target, data, key), mac))
+    {
+        return std::nullopt;
+    }
+    std::chrono::system_clock::time_point expiresAt{
+        std::chrono::milliseconds{ Take<int64_t>(data, 1).front() }
+    };
+    if (expiresAt <= std::chrono::system_clock::now())
+    {
+        return std::nullopt;
+    }
+    return DeserializeRoomState(data);
+}
+
+} // namespace smp::server
@@ -0,0 +1,101 @@
+#pragma once
+#include "ReservationToken.hpp"
+#include "Typedefs.hpp"
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <raylib.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace smp::server
+{
+
+// Everything another process needs to continue a room: its map, and players
+// and bullets with their ids, so clients keep their view of the world.
+// Connections, pending joins and reservations are not part of it.
+struct RoomState
+{
+    struct Player
+    {
+        IdType Id;
+        Vector2 Position;
+        Vector2 Velocity;
+    };
+
+    struct Bullet
+    {
+        // a BulletPool id, restored into the same slot
+        IdType Id;
+        IdType ShooterId;
+        Vector2 Position;
+        Vector2 Velocity;
+    };
+
+    std::string Name;
+    uint64_t Tick{ 0 };
+    // wall clock ms when the room stopped ticking, the receiving side
+    // measures the pause from it
+    int64_t CapturedAtMs{ 0 };
+    // compiled map, see GameMap
+    std::vector<std::byte> Map;
+    std::vector<Player> Players;
+    std::vector<Bullet> Bullets;
+};
+
+// Binary layout, little-endian like compiled maps. Header fields are 4 bytes
+// wide except Tick and CapturedAtMs, which take 8:
+//   Header
+//   char Name[NameLength]
+//   std::byte Map[MapSize]
+//   RoomState::Player[PlayerCount]
+//   RoomState::Bullet[BulletCount]
+namespace roomformat
+{
+
+static_assert(std::endian::native == std::endian::little,
+              "room states are little-endian only");
+
+inline constexpr uint32_t Magic{ 0x52504D53 }; // "SMPR"
+// 2: bullet ids are BulletPool ids rather than registry entities
+inline constexpr uint32_t Version{ 2 };
+
+struct Header
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Tick;
+    int64_t CapturedAtMs;
+    uint32_t NameLength;
+    uint32_t MapSize;
+    uint32_t PlayerCount;
+    uint32_t BulletCount;
+};
+
+} // namespace roomformat
+
+auto SerializeRoomState(const RoomState& state) -> std::string;
+// throws std::runtime_error if data is truncated or not a room state
+auto DeserializeRoomState(std::string_view data) -> RoomState;
+
+// serialized state behind a mac of the reservation secret, so only servers
+// sharing it can push a room into a standby one. Layout is
+//   uint64_t Mac
+//   int64_t ExpiresAtMs (wall clock)
+//   serialized state
+// The mac also covers the target, the address of the standby as the
+// source formats it. A captured state can't be replayed to another standby
+// or once it expired.
+auto SignRoomState(const RoomState& state, std::string_view target,
+                   std::chrono::system_clock::time_point expiresAt,
+                   const discovery::ReservationKey& key) -> std::string;
+// nullopt if the mac doesn't match (wrong key or target) or the state has
+// expired, throws like DeserializeRoomState
+auto VerifyRoomState(std::string_view data, std::string_view target,
+                     const discovery::ReservationKey& key)
+    -> std::optional<RoomState>;
+
+} // namespace smp::server
@@ -1,31 +1,24 @@
+#include "Benchmark.hpp"
+#include "DebugOutput.hpp"
+#include "GameMap.hpp"
 #include "GameServer.hpp"
+#include "Checkpointer.hpp"
+#include "Compression.hpp"
+#include "MigrationReceiver.hpp"
+#include "ReservationToken.hpp"
 #include "SessionOptions.hpp"
+#include <chrono>
 #include <boost/program_options.hpp>
 #include <cmath>
 #include <csignal>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <raylib.h>
 #include <steam/isteamnetworkingutils.h>
 #include <steam/steamnetworkingsockets.h>
 
-SteamNetworkingMicroseconds logTimeZero;
-
-static void DebugOutput(ESteamNetworkingSocketsDebugOutputType eType,
-                        const char* pszMsg)
-{
-    auto time{ SteamNetworkingUtils()->GetLocalTimestamp() - logTimeZero };
-    printf("%10.6f %s\n", time * 1e-6, pszMsg);
-    fflush(stdout);
-    if (eType == k_ESteamNetworkingSocketsDebugOutputType_Bug)
-    {
-        fflush(stdout);
-        fflush(stderr);
-        std::abort();
-    }
-}
-
 std::function<void(int)> ShutdownHandler = [](int) {};
 
 void SignalHandler(int sig)
@@ -43,32 +36,82 @@ auto main(int argc, char** argv) -> int
     {
         std::cerr << "GameNetworkingSockets_Init failed.  " << errMsg << '\n';
     }
-    logTimeZero = SteamNetworkingUtils()->GetLocalTimestamp();
-
-    SteamNetworkingUtils()->SetDebugOutputFunction(
-        k_ESteamNetworkingSocketsDebugOutputType_Msg, DebugOutput);
+    smp::network::InstallDebugOutput();
 
     namespace opts = boost::program_options;
     std::string configPath{};
+    std::string mapPath{};
     std::string ipString{};
     std::string portString{};
     std::string serverName{};
+    uint32_t clientBytesPerSecond{};
+    std::string checkpointPath{};
+    uint32_t checkpointInterval{};
+    int32_t redisPort{};
+    double traceSampleRate{};
+    std::size_t compressThreshold{};
+    std::string samplesPath{};
+    uint32_t benchBullets{};
+    uint32_t benchTicks{};
 
-    opts::options_description optsDescription{ "Allowed opitons" };
+    opts::options_description optsDescription{ "Allowed options" };
     // clang-format off
     optsDescription.add_options()
 		("help,h", "display help")
 		("config,c", 
 		 opts::value<std::string>(&configPath)->default_value("./config.json"),
-		 "path to server config file")
+		 "path to server config file (JSON map)")
+		("map,m",
+		 opts::value<std::string>(&mapPath),
+		 "compiled map made by shooter-mapc, used instead of config")
 		("ip,a",
 		 opts::value<std::string>(&ipString)->default_value("127.0.0.1"),
         "server ip address")
 		("port,p",
-		 opts::value<std::string>(&portString)->required(),
+		 opts::value<std::string>(&portString),
         "server port")
-		("name,n", opts::value<std::string>(&serverName)->required(),
-		 "server name for server discovery");
+		("name,n", opts::value<std::string>(&serverName),
+		 "server name for server discovery")
+		("standby",
+		 "wait for a room to be moved here instead of starting one, takes "
+		 "name and map from the room")
+		("client-budget,b",
+		 opts::value<uint32_t>(&clientBytesPerSecond)->default_value(131072),
+		 "outbound bytes per second for each client, 0 for no limit")
+		("checkpoint",
+		 opts::value<std::string>(&checkpointPath),
+		 "file the room is periodically saved to, for --restore")
+		("checkpoint-interval",
+		 opts::value<uint32_t>(&checkpointInterval)->default_value(60),
+		 "ticks between checkpoints")
+		("restore",
+		 "continue the room from its checkpoint if there is one, players "
+		 "reconnect as themselves")
+		("redis-port",
+		 opts::value<int32_t>(&redisPort)->default_value(6379),
+		 "port of the discovery redis on 127.0.0.1")
+		("insecure-dev-secret",
+		 "sign tokens with a well known secret when SMP_RESERVATION_SECRET "
+		 "is not set, for local runs only")
+		("trace-sample",
+		 opts::value<double>(&traceSampleRate)->default_value(1.0),
+		 "share of clients' latency traces to follow, 0 to ignore them")
+		("compress-threshold",
+		 opts::value<std::size_t>(&compressThreshold)
+			 ->default_value(smp::compression::DefaultThreshold),
+		 "smallest message sent zstd-compressed to clients that take it, 0 "
+		 "to send everything as is")
+		("record-samples",
+		 opts::value<std::string>(&samplesPath),
+		 "append outgoing messages to this file, to train a dictionary "
+		 "with shooter-mapc --samples")
+		("bench-bullets",
+		 opts::value<uint32_t>(&benchBullets),
+		 "run the bullet pass on the map with this many bullets in flight "
+		 "and exit")
+		("bench-ticks",
+		 opts::value<uint32_t>(&benchTicks)->default_value(1000),
+		 "ticks to run in benchmark mode");
     // clang-format on
 
     opts::variables_map vm;
@@ -90,23 +133,151 @@ auto main(int argc, char** argv) -> int
         return 0;
     }
 
-    std::ifstream configFile{ configPath };
-    if (!configFile.is_open())
+    auto benchmark{ vm.count("bench-bullets") != 0 };
+    if (portString.empty() && !benchmark)
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << "the option '--port' is required but missing"
+                  << std::endl;
+        return 0;
+    }
+
+    if (vm.count("insecure-dev-secret"))
+    {
+        smp::discovery::AllowInsecureDevSecret();
+    }
+    if (!benchmark)
+    {
+        // fail now rather than after loading the map
+        try
+        {
+            smp::discovery::LoadReservationKey();
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cerr << e.what()
+                      << ", pass --insecure-dev-secret for a local run\n";
+            return 1;
+        }
+    }
+
+    auto address{ ipString + ":" + portString };
+    // room to continue instead of starting a fresh one
+    std::optional<smp::server::RoomState> restored;
+    auto resumeTimeout{ smp::server::GameServer::RestoreResumeTimeout };
+    std::optional<smp::server::MigrationReceiver> receiver;
+    auto loadStart{ std::chrono::steady_clock::now() };
+    if (vm.count("standby"))
+    {
+        receiver.emplace();
+        ShutdownHandler = [&receiver](int) { receiver->Stop(); };
+        receiver->Run(address);
+
+        restored = receiver->TakeState();
+        if (!restored.has_value())
+        {
+            return 0;
+        }
+        resumeTimeout = smp::server::GameServer::MigrationResumeTimeout;
+        loadStart = std::chrono::steady_clock::now();
+    }
+    else if (vm.count("restore") && !checkpointPath.empty())
+    {
+        try
+        {
+            restored = smp::server::Checkpointer::Load(checkpointPath);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << e.what() << ", starting a fresh room\n";
+        }
+    }
+
+    std::optional<smp::game::GameMap> map;
+    if (restored.has_value())
+    {
+        try
+        {
+            map = smp::game::GameMap::FromBytes(std::move(restored->Map));
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        serverName = restored->Name;
+    }
+    else if (serverName.empty() && !benchmark)
     {
         std::cout << optsDescription << std::endl;
-        std::cerr << "Could not open config!\n";
-        return 1;
+        std::cout << "the option '--name' is required but missing"
+                  << std::endl;
+        return 0;
     }
+    else if (!mapPath.empty())
+    {
+        try
+        {
+            map = smp::game::GameMap::Load(mapPath);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+    else
+    {
+        std::ifstream configFile{ configPath };
+        if (!configFile.is_open())
+        {
+            std::cout << optsDescription << std::endl;
+            std::cerr << "Could not open config!\n";
+            return 1;
+        }
 
-    nlohmann::json configJson = nlohmann::json::parse(configFile);
+        // JSON maps are compiled on the fly, so both go the same way
+        nlohmann::json configJson = nlohmann::json::parse(configFile);
+        map = smp::game::GameMap::FromBytes(
+            smp::game::CompileMap(configJson));
+    }
 
-    smp::game::SessionOptions sessionOptions{ configJson };
-    sessionOptions.Name = serverName;
+    if (benchmark)
+    {
+        smp::server::RunBulletBenchmark(*map, benchBullets, benchTicks);
+        return 0;
+    }
 
-    smp::server::GameServer server{ "127.0.0.1", 6379,
-                                    std::move(sessionOptions) };
+    smp::server::GameServer server{ "127.0.0.1", redisPort, serverName,
+                                    std::move(*map), clientBytesPerSecond };
 
     ShutdownHandler = [&server](int) { server.Stop(); };
+    server.SetTraceSampleRate(traceSampleRate);
+    server.SetCompressionThreshold(compressThreshold);
+    if (!samplesPath.empty())
+    {
+        server.RecordCompressionSamples(samplesPath);
+    }
+
+    if (restored.has_value())
+    {
+        server.Restore(*restored, resumeTimeout);
+        std::cout << "Room is back after "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - loadStart)
+                         .count()
+                  << "ms of loading\n";
+    }
+    if (!checkpointPath.empty())
+    {
+        server.EnableCheckpoints(checkpointPath, checkpointInterval);
+    }
+    if (receiver.has_value())
+    {
+        // clients are only redirected once the room can take them
+        server.AdoptListenSocket(receiver->ReleaseListenSocket());
+        receiver->Acknowledge();
+    }
 
-    server.Run(ipString + ":" + portString);
+    server.Run(address);
 }
@@ -0,0 +1,264 @@
+#include "Compression.hpp"
+#include <array>
+#include <stdexcept>
+#include <zdict.h>
+#include <zstd.h>
+
+namespace smp::compression
+{
+
+auto IsCompressed(std::string_view message) -> bool
+{
+    // ZSTD_MAGICNUMBER, little-endian
+    static constexpr std::string_view magic{ "\x28\xB5\x2F\xFD" };
+    return message.starts_with(magic);
+}
+auto PeekType(std::string_view message) -> std::string_view
+{
+    // nlohmann sorts keys, so "type" comes after the payload; messages we
+    // splice ourselves put it first
+    static constexpr std::string_view key{ R"("type":")" };
+    auto start{ message.rfind(key) };
+    if (start == std::string_view::npos)
+    {
+        return "unknown";
+    }
+    start += key.size();
+    auto end{ message.find('"', start) };
+    if (end == std::string_view::npos)
+    {
+        return "unknown";
+    }
+    return message.substr(start, end - start);
+}
+
+Compressor::Compressor(std::span<const std::byte> dictionary, int32_t level)
+    : m_Context{ ZSTD_createCCtx() },
+      m_Level{ level }
+{
+    if (!dictionary.empty())
+    {
+        m_Dictionary = ZSTD_createCDict(dictionary.data(), dictionary.size(),
+                                        level);
+        m_DictionaryId = ZSTD_getDictID_fromCDict(m_Dictionary);
+    }
+}
+Compressor::~Compressor()
+{
+    ZSTD_freeCDict(m_Dictionary);
+    ZSTD_freeCCtx(m_Context);
+}
+auto Compressor::GetDictionaryId() const -> uint32_t
+{
+    return m_DictionaryId;
+}
+auto Compressor::Compress(std::string_view message, bool useDictionary,
+                          std::string& out) -> bool
+{
+    out.resize(ZSTD_compressBound(message.size()));
+    auto size{ useDictionary && m_Dictionary != nullptr
+                   ? ZSTD_compress_usingCDict(m_Context, out.data(),
+                                              out.size(), message.data(),
+                                              message.size(), m_Dictionary)
+                   : ZSTD_compressCCtx(m_Context, out.data(), out.size(),
+                                       message.data(), message.size(),
+                                       m_Level) };
+    if (ZSTD_isError(size) != 0 || size >= message.size())
+    {
+        return false;
+    }
+    out.resize(size);
+    return true;
+}
+
+Decompressor::Decompressor()
+    : m_Context{ ZSTD_createDCtx() }
+{
+}
+Decompressor::~Decompressor()
+{
+    ZSTD_freeDDict(m_Dictionary);
+    ZSTD_freeDCtx(m_Context);
+}
+void Decompressor::SetDictionary(std::span<const std::byte> dictionary)
+{
+    ZSTD_freeDDict(m_Dictionary);
+    m_Dictionary = nullptr;
+    m_DictionaryId = 0;
+    if (!dictionary.empty())
+    {
+        m_Dictionary = ZSTD_createDDict(dictionary.data(), dictionary.size());
+        m_DictionaryId = ZSTD_getDictID_fromDDict(m_Dictionary);
+    }
+}
+auto Decompressor::GetDictionaryId() const -> uint32_t
+{
+    return m_DictionaryId;
+}
+void Decompressor::Decompress(std::string_view frame, std::string& out)
+{
+    auto contentSize{ ZSTD_getFrameContentSize(frame.data(), frame.size()) };
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR ||
+        contentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+        throw std::runtime_error{ "Broken zstd frame" };
+    }
+    if (contentSize > MaxMessageSize)
+    {
+        throw std::runtime_error{ "Compressed message is too large" };
+    }
+    auto dictionaryId{ ZSTD_getDictID_fromFrame(frame.data(), frame.size()) };
+    if (dictionaryId != 0 && dictionaryId != m_DictionaryId)
+    {
+        throw std::runtime_error{ "Message needs dictionary " +
+                                  std::to_string(dictionaryId) };
+    }
+
+    out.resize(contentSize);
+    auto size{ dictionaryId != 0
+                   ? ZSTD_decompress_usingDDict(m_Context, out.data(),
+                                                out.size(), frame.data(),
+                                                frame.size(), m_Dictionary)
+                   : ZSTD_decompressDCtx(m_Context, out.data(), out.size(),
+                                         frame.data(), frame.size()) };
+    if (ZSTD_isError(size) != 0 || size != contentSize)
+    {
+        throw std::runtime_error{ "Broken zstd frame" };
+    }
+}
+
+auto TrainDictionary(const std::vector<std::string>& samples,
+                     std::size_t maxSize) -> std::vector<std::byte>
+{
+    // zdict wants all samples back to back
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto& sample : samples)
+    {
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    std::vector<std::byte> dictionary(maxSize);
+    auto size{ ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(),
+                                     buffer.data(), sizes.data(),
+                                     static_cast<unsigned>(sizes.size())) };
+    if (ZDICT_isError(size) != 0)
+    {
+        throw std::runtime_error{ "Could not train dictionary: " +
+                                  std::string{ ZDICT_getErrorName(size) } };
+    }
+    dictionary.resize(size);
+    return dictionary;
+}
+
+void AppendSample(std::ostream& recording, std::string_view message)
+{
+    auto size{ static_cast<uint32_t>(message.size()) };
+    std::array<char, 4> sizeBytes{
+        static_cast<char>(size & 0xFF), static_cast<char>((size >> 8) & 0xFF),
+        static_cast<char>((size >> 16) & 0xFF),
+        static_cast<char>((size >> 24) & 0xFF)
+    };
+    recording.write(sizeBytes.data(), sizeBytes.size());
+    recording.write(message.data(), static_cast<std::streamsize>(size));
+}
+auto ReadSamples(std::istream& recording) -> std::vector<std::string>
+{
+    std::vector<std::string> samples;
+    std::array<char, 4> sizeBytes{};
+    while (recording.read(sizeBytes.data(), sizeBytes.size()))
+    {
+        uint32_t size{ 0 };
+        for (auto it{ sizeBytes.rbegin() }; it != sizeBytes.rend(); it++)
+        {
+            size = (size << 8) | static_cast<uint8_t>(*it);
+        }
+        if (size > MaxMessageSize)
+        {
+            throw std::runtime_error{ "Recording is broken" };
+        }
+        auto& sample{ samples.emplace_back(size, '\0') };
+        if (!recording.read(sample.data(), size))
+        {
+            throw std::runtime_error{ "Recording is truncated" };
+        }
+    }
+    if (recording.gcount() != 0)
+    {
+        throw std::runtime_error{ "Recording is truncated" };
+    }
+    return samples;
+}
+
+static constexpr std::string_view s_Base64Digits{
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+};
+
+auto EncodeBase64(std::span<const std::byte> bytes) -> std::string
+{
+    std::string text;
+    text.reserve((bytes.size() + 2) / 3 * 4);
+    for (std::size_t idx{ 0 }; idx < bytes.size(); idx += 3)
+    {
+        auto remaining{ bytes.size() - idx };
+        uint32_t group{ static_cast<uint32_t>(bytes[idx]) << 16 };
+        if (remaining > 1)
+        {
+            group |= static_cast<uint32_t>(bytes[idx + 1]) << 8;
+        }
+        if (remaining > 2)
+        {
+            group |= static_cast<uint32_t>(bytes[idx + 2]);
+        }
+        text += s_Base64Digits[(group >> 18) & 0x3F];
+        text += s_Base64Digits[(group >> 12) & 0x3F];
+        text += remaining > 1 ? s_Base64Digits[(group >> 6) & 0x3F] : '=';
+        text += remaining > 2 ? s_Base64Digits[group & 0x3F] : '=';
+    }
+    return text;
+}
+auto DecodeBase64(std::string_view text) -> std::vector<std::byte>
+{
+    if (text.size() % 4 != 0)
+    {
+        throw std::runtime_error{ "Base64 is not padded" };
+    }
+    std::vector<std::byte> bytes;
+    bytes.reserve(text.size() / 4 * 3);
+    for (std::size_t idx{ 0 }; idx < text.size(); idx += 4)
+    {
+        uint32_t group{ 0 };
+        int32_t padding{ 0 };
+        for (std::size_t digit{ 0 }; digit < 4; digit++)
+        {
+            auto character{ text[idx + digit] };
+            // padding only at the very end
+            if (character == '=' && idx + 4 == text.size() && digit >= 2)
+            {
+                padding++;
+                group <<= 6;
+                continue;
+            }
+            auto value{ s_Base64Digits.find(character) };
+            if (value == std::string_view::npos || padding != 0)
+            {
+                throw std::runtime_error{ "Not base64" };
+            }
+            group = (group << 6) | static_cast<uint32_t>(value);
+        }
+        bytes.push_back(static_cast<std::byte>((group >> 16) & 0xFF));
+        if (padding < 2)
+        {
+            bytes.push_back(static_cast<std::byte>((group >> 8) & 0xFF));
+        }
+        if (padding < 1)
+        {
+            bytes.push_back(static_cast<std::byte>(group & 0xFF));
+        }
+    }
+    return bytes;
+}
+
+} // namespace smp::compression
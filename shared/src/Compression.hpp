@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+
+// Optional zstd compression of large messages. Clients list the codecs they
+// decode in their join payload (and again in a "compression" message once
+// they have the room's dictionary):
+//   { "codecs": ["zstd"], "dict_id": 123 }
+// after which messages of at least the server's threshold may arrive as zstd
+// frames instead of json text. The dictionary is trained on recorded
+// messages by shooter-mapc and compiled into the map, so it ships with the
+// session blob and changes its hash whenever it changes.
+// A client has no dictionary before it knows the room's session, so the
+// greeting of its first join there goes out as plain zstd at best. Rejoins
+// get the dictionary right away, since the client already has the session
+// cached. Offering the ids of all cached dictionaries at join would need a
+// decompressor that holds several at once.
+namespace smp::compression
+{
+
+inline constexpr std::string_view Codec{ "zstd" };
+// smaller messages are mostly keys a frame header would eat the gain of
+inline constexpr std::size_t DefaultThreshold{ 256 };
+// decompressed size we accept, anything larger is a broken or hostile frame
+inline constexpr std::size_t MaxMessageSize{ 16 << 20 };
+
+// json text never starts with zstd's frame magic
+[[nodiscard]] auto IsCompressed(std::string_view message) -> bool;
+// top-level "type" of a serialized message, "unknown" if it has none. Only
+// for stats: payloads are expected not to use the key themselves.
+[[nodiscard]] auto PeekType(std::string_view message) -> std::string_view;
+
+// owns a zstd context, so one per thread
+class Compressor
+{
+public:
+    explicit Compressor(std::span<const std::byte> dictionary = {},
+                        int32_t level = 3);
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    auto operator=(const Compressor&) -> Compressor& = delete;
+
+    // 0 without a dictionary
+    [[nodiscard]] auto GetDictionaryId() const -> uint32_t;
+    // false if the frame wouldn't be smaller than the message, out holds
+    // nothing useful then
+    auto Compress(std::string_view message, bool useDictionary,
+                  std::string& out) -> bool;
+
+private:
+    ZSTD_CCtx_s* m_Context;
+    ZSTD_CDict_s* m_Dictionary{ nullptr };
+    uint32_t m_DictionaryId{ 0 };
+    int32_t m_Level;
+};
+
+// owns a zstd context, so one per thread
+class Decompressor
+{
+public:
+    Decompressor();
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    auto operator=(const Decompressor&) -> Decompressor& = delete;
+
+    // replaces the previous one, empty drops it
+    void SetDictionary(std::span<const std::byte> dictionary);
+    [[nodiscard]] auto GetDictionaryId() const -> uint32_t;
+    // throws std::runtime_error for broken frames, frames made with another
+    // dictionary and frames over MaxMessageSize
+    void Decompress(std::string_view frame, std::string& out);
+
+private:
+    ZSTD_DCtx_s* m_Context;
+    ZSTD_DDict_s* m_Dictionary{ nullptr };
+    uint32_t m_DictionaryId{ 0 };
+};
+
+// throws std::runtime_error if zstd can't make one out of the samples, it
+// wants a few hundred at least
+auto TrainDictionary(const std::vector<std::string>& samples,
+                     std::size_t maxSize) -> std::vector<std::byte>;
+
+// recorded messages for training, each one a 4-byte little-endian length
+// and its bytes
+void AppendSample(std::ostream& recording, std::string_view message);
+// throws std::runtime_error if the recording is truncated
+auto ReadSamples(std::istream& recording) -> std::vector<std::string>;
+
+// dictionaries travel in session json as base64
+auto EncodeBase64(std::span<const std::byte> bytes) -> std::string;
+// throws std::runtime_error on anything but padded base64
+auto DecodeBase64(std::string_view text) -> std::vector<std::byte>;
+
+} // namespace smp::compression
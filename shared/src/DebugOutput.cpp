@@ -0,0 +1,31 @@
+#include "DebugOutput.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <steam/isteamnetworkingutils.h>
+
+namespace smp::network
+{
+
+static SteamNetworkingMicroseconds s_LogTimeZero{ 0 };
+
+static void PrintDebugOutput(ESteamNetworkingSocketsDebugOutputType eType,
+                             const char* pszMsg)
+{
+    auto time{ SteamNetworkingUtils()->GetLocalTimestamp() - s_LogTimeZero };
+    printf("%10.6f %s\n", static_cast<double>(time) * 1e-6, pszMsg);
+    fflush(stdout);
+    if (eType == k_ESteamNetworkingSocketsDebugOutputType_Bug)
+    {
+        fflush(stderr);
+        std::abort();
+    }
+}
+
+void InstallDebugOutput(ESteamNetworkingSocketsDebugOutputType detailLevel)
+{
+    s_LogTimeZero = SteamNetworkingUtils()->GetLocalTimestamp();
+    SteamNetworkingUtils()->SetDebugOutputFunction(detailLevel,
+                                                   PrintDebugOutput);
+}
+
+} // namespace smp::network
@@ -0,0 +1,13 @@
+#pragma once
+#include <steam/steamnetworkingtypes.h>
+
+namespace smp::network
+{
+
+// prints GNS output down to detailLevel to stdout, stamped with seconds
+// since this call, and aborts on GNS bugs. Call after
+// GameNetworkingSockets_Init.
+void InstallDebugOutput(ESteamNetworkingSocketsDebugOutputType detailLevel =
+                            k_ESteamNetworkingSocketsDebugOutputType_Msg);
+
+} // namespace smp::network
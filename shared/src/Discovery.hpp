@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <string_view>
+
+// redis layout shared by game servers (writers) and entry points (readers)
+namespace smp::discovery
+{
+
+// every change of a room is also published here as
+// { "name": ..., <changed fields> } or { "name": ..., "removed": true }
+inline constexpr std::string_view UpdatesChannel{ "smp.servers" };
+
+inline constexpr std::string_view EndpointSuffix{ ".endpoint" };
+inline constexpr std::string_view PlayerCountSuffix{ ".player_count" };
+// load report refreshed by the room every HeartbeatInterval, expires (and
+// takes the room out of matchmaking) after HeartbeatTtl
+inline constexpr std::string_view HeartbeatSuffix{ ".heartbeat" };
+
+inline constexpr std::chrono::seconds HeartbeatInterval{ 1 };
+inline constexpr std::chrono::seconds HeartbeatTtl{ 3 };
+
+inline auto EndpointKey(const std::string& serverName) -> std::string
+{
+    return serverName + std::string{ EndpointSuffix };
+}
+inline auto PlayerCountKey(const std::string& serverName) -> std::string
+{
+    return serverName + std::string{ PlayerCountSuffix };
+}
+
+inline auto HeartbeatKey(const std::string& serverName) -> std::string
+{
+    return serverName + std::string{ HeartbeatSuffix };
+}
+
+// publishing { "target": "<ip>:<port>" } here moves the room to a standby
+// server listening there, its players follow without rejoining
+inline auto MigrationsChannel(const std::string& serverName) -> std::string
+{
+    return "smp.migrations." + serverName;
+}
+
+} // namespace smp::discovery
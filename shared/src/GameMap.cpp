@@ -0,0 +1,304 @@
+#include "GameMap.hpp"
+#include "Compression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace smp::game
+{
+
+static auto GetGridSize(float extent, float cellSize) -> uint32_t
+{
+    return std::max(1U, static_cast<uint32_t>(std::ceil(extent / cellSize)));
+}
+
+static auto ClampToGrid(float coord, float cellSize, uint32_t cells)
+    -> uint32_t
+{
+    auto cell{ std::floor(coord / cellSize) };
+    return static_cast<uint32_t>(
+        std::clamp(cell, 0.F, static_cast<float>(cells - 1)));
+}
+
+template <class T>
+static void Append(std::vector<std::byte>& bytes, const T* data, size_t count)
+{
+    auto offset{ bytes.size() };
+    bytes.resize(offset + sizeof(T) * count);
+    std::memcpy(bytes.data() + offset, data, sizeof(T) * count);
+}
+
+auto CompileMap(const nlohmann::json& mapJson, float cellSize,
+                std::span<const std::byte> dictionary)
+    -> std::vector<std::byte>
+{
+    if (cellSize <= 0)
+    {
+        throw std::invalid_argument{ "cell size must be positive" };
+    }
+
+    // same parsing as servers used to do, adds the bounding walls too
+    SessionOptions options{ mapJson };
+
+    mapformat::Header header{};
+    header.Magic = mapformat::Magic;
+    header.Version = mapformat::Version;
+    header.WorldWidth = options.WorldWidth;
+    header.WorldHeight = options.WorldHeight;
+    header.PlayerRadius = options.PlayerRadius;
+    header.PlayerSpeed = options.PlayerSpeed;
+    header.BulletRadius = options.BulletRadius;
+    header.BulletSpeed = options.BulletSpeed;
+    header.MaxPlayers = options.MaxPlayers;
+    header.WallCount = static_cast<uint32_t>(options.Walls.size());
+    header.CellSize = cellSize;
+    header.GridColumns = GetGridSize(options.WorldWidth, cellSize);
+    header.GridRows = GetGridSize(options.WorldHeight, cellSize);
+
+    std::vector<mapformat::Wall> walls;
+    walls.reserve(options.Walls.size());
+    for (const auto& wall : options.Walls)
+    {
+        walls.push_back({ wall.Collider.Start.x, wall.Collider.Start.y,
+                          wall.Collider.End.x, wall.Collider.End.y });
+    }
+
+    // walls go into every cell their bounding box touches, counted first so
+    // the cell lists can be packed into one array
+    auto cellCount{ header.GridColumns * header.GridRows };
+    std::vector<uint32_t> cellOffsets(cellCount + 1, 0);
+    auto forEachCell{ [&](const mapformat::Wall& wall, auto&& action)
+                      {
+                          auto firstColumn{ ClampToGrid(
+                              std::min(wall.StartX, wall.EndX), cellSize,
+                              header.GridColumns) };
+                          auto lastColumn{ ClampToGrid(
+                              std::max(wall.StartX, wall.EndX), cellSize,
+                              header.GridColumns) };
+                          auto firstRow{ ClampToGrid(
+                              std::min(wall.StartY, wall.EndY), cellSize,
+                              header.GridRows) };
+                          auto lastRow{ ClampToGrid(
+                              std::max(wall.StartY, wall.EndY), cellSize,
+                              header.GridRows) };
+                          for (auto row{ firstRow }; row <= lastRow; row++)
+                          {
+                              for (auto column{ firstColumn };
+                                   column <= lastColumn; column++)
+                              {
+                                  action(row * header.GridColumns + column);
+                              }
+                          }
+                      } };
+
+    for (const auto& wall : walls)
+    {
+        forEachCell(wall, [&](uint32_t cell) { cellOffsets[cell + 1]++; });
+    }
+    for (uint32_t cell{ 0 }; cell < cellCount; cell++)
+    {
+        cellOffsets[cell + 1] += cellOffsets[cell];
+    }
+
+    std::vector<uint32_t> cellWalls(cellOffsets.back());
+    auto cellFill{ cellOffsets };
+    for (uint32_t wallIdx{ 0 }; wallIdx < walls.size(); wallIdx++)
+    {
+        forEachCell(walls[wallIdx], [&](uint32_t cell)
+                    { cellWalls[cellFill[cell]++] = wallIdx; });
+    }
+    header.CellWallCount = static_cast<uint32_t>(cellWalls.size());
+    header.DictionarySize = static_cast<uint32_t>(dictionary.size());
+
+    std::vector<std::byte> bytes;
+    Append(bytes, &header, 1);
+    Append(bytes, walls.data(), walls.size());
+    Append(bytes, cellOffsets.data(), cellOffsets.size());
+    Append(bytes, cellWalls.data(), cellWalls.size());
+    Append(bytes, dictionary.data(), dictionary.size());
+    return bytes;
+}
+
+auto GameMap::Load(const std::string& path) -> GameMap
+{
+    auto fd{ open(path.c_str(), O_RDONLY) };
+    if (fd < 0)
+    {
+        throw std::runtime_error{ "Could not open map " + path };
+    }
+
+    struct stat fileStat
+    {
+    };
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error{ "Map " + path + " is empty" };
+    }
+
+    auto size{ static_cast<size_t>(fileStat.st_size) };
+    auto* mapping{ mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error{ "Could not map " + path };
+    }
+
+    GameMap map;
+    map.m_Mapping = mapping;
+    map.m_MappingSize = size;
+    map.Parse({ static_cast<const std::byte*>(mapping), size });
+    return map;
+}
+auto GameMap::FromBytes(std::vector<std::byte> bytes) -> GameMap
+{
+    GameMap map;
+    map.m_Bytes = std::move(bytes);
+    map.Parse(map.m_Bytes);
+    return map;
+}
+GameMap::GameMap(GameMap&& other) noexcept
+{
+    *this = std::move(other);
+}
+auto GameMap::operator=(GameMap&& other) noexcept -> GameMap&
+{
+    if (this != &other)
+    {
+        if (m_Mapping != nullptr)
+        {
+            munmap(m_Mapping, m_MappingSize);
+        }
+        // spans into a moved vector stay valid, its buffer moves with it
+        m_Mapping = std::exchange(other.m_Mapping, nullptr);
+        m_MappingSize = std::exchange(other.m_MappingSize, 0);
+        m_Bytes = std::move(other.m_Bytes);
+        m_Header = other.m_Header;
+        m_Walls = other.m_Walls;
+        m_CellOffsets = other.m_CellOffsets;
+        m_CellWalls = other.m_CellWalls;
+        m_Dictionary = other.m_Dictionary;
+        m_VisitStamps = std::move(other.m_VisitStamps);
+        m_Stamp = other.m_Stamp;
+    }
+    return *this;
+}
+GameMap::~GameMap()
+{
+    if (m_Mapping != nullptr)
+    {
+        munmap(m_Mapping, m_MappingSize);
+    }
+}
+
+template <class T>
+static auto TakeArray(std::span<const std::byte>& bytes, size_t count)
+    -> std::span<const T>
+{
+    if (bytes.size() / sizeof(T) < count)
+    {
+        throw std::runtime_error{ "Map is truncated" };
+    }
+    std::span<const T> array{ reinterpret_cast<const T*>(bytes.data()),
+                              count };
+    bytes = bytes.subspan(sizeof(T) * count);
+    return array;
+}
+
+void GameMap::Parse(std::span<const std::byte> bytes)
+{
+    m_Header = TakeArray<mapformat::Header>(bytes, 1).data();
+    if (m_Header->Magic != mapformat::Magic)
+    {
+        throw std::runtime_error{ "Not a compiled map" };
+    }
+    if (m_Header->Version != mapformat::Version)
+    {
+        throw std::runtime_error{ "Unsupported map version " +
+                                  std::to_string(m_Header->Version) +
+                                  ", recompile it with shooter-mapc" };
+    }
+    if (m_Header->GridColumns == 0 || m_Header->GridRows == 0 ||
+        !(m_Header->CellSize > 0))
+    {
+        throw std::runtime_error{ "Map has no collision grid" };
+    }
+
+    auto cellCount{ static_cast<size_t>(m_Header->GridColumns) *
+                    m_Header->GridRows };
+    m_Walls = TakeArray<mapformat::Wall>(bytes, m_Header->WallCount);
+    m_CellOffsets = TakeArray<uint32_t>(bytes, cellCount + 1);
+    m_CellWalls = TakeArray<uint32_t>(bytes, m_Header->CellWallCount);
+    m_Dictionary = TakeArray<std::byte>(bytes, m_Header->DictionarySize);
+
+    if (!std::is_sorted(m_CellOffsets.begin(), m_CellOffsets.end()) ||
+        m_CellOffsets.front() != 0 ||
+        m_CellOffsets.back() != m_Header->CellWallCount)
+    {
+        throw std::runtime_error{ "Map has broken cell offsets" };
+    }
+    if (std::any_of(m_CellWalls.begin(), m_CellWalls.end(),
+                    [this](uint32_t wall)
+                    { return wall >= m_Header->WallCount; }))
+    {
+        throw std::runtime_error{ "Map references unknown walls" };
+    }
+
+    m_VisitStamps.assign(m_Header->WallCount, 0);
+    m_Stamp = 0;
+}
+
+auto GameMap::GetCell(Vector2 point) const -> std::pair<uint32_t, uint32_t>
+{
+    return { ClampToGrid(point.x, m_Header->CellSize, m_Header->GridColumns),
+             ClampToGrid(point.y, m_Header->CellSize, m_Header->GridRows) };
+}
+
+auto GameMap::GetOptions() const -> SessionOptions
+{
+    SessionOptions options;
+    options.WorldWidth = m_Header->WorldWidth;
+    options.WorldHeight = m_Header->WorldHeight;
+    options.PlayerRadius = m_Header->PlayerRadius;
+    options.PlayerSpeed = m_Header->PlayerSpeed;
+    options.BulletRadius = m_Header->BulletRadius;
+    options.BulletSpeed = m_Header->BulletSpeed;
+    options.MaxPlayers = m_Header->MaxPlayers;
+    if (!m_Dictionary.empty())
+    {
+        options.Dictionary = compression::EncodeBase64(m_Dictionary);
+    }
+
+    options.Walls.reserve(m_Walls.size());
+    for (const auto& wall : m_Walls)
+    {
+        options.Walls.push_back({ LineCollider{
+            Vector2{ wall.StartX, wall.StartY },
+            Vector2{ wall.EndX, wall.EndY } } });
+    }
+    return options;
+}
+auto GameMap::GetWallCount() const -> uint32_t
+{
+    return m_Header->WallCount;
+}
+auto GameMap::GetBytes() const -> std::span<const std::byte>
+{
+    if (m_Mapping != nullptr)
+    {
+        return { static_cast<const std::byte*>(m_Mapping), m_MappingSize };
+    }
+    return m_Bytes;
+}
+auto GameMap::GetDictionary() const -> std::span<const std::byte>
+{
+    return m_Dictionary;
+}
+
+} // namespace smp::game
@@ -0,0 +1,156 @@
+#pragma once
+#include "SessionOptions.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <raylib.h>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace smp::game
+{
+
+// Compiled map file, produced by shooter-mapc. Everything is 4-byte
+// little-endian and laid out so it can be used straight from the mapping:
+//   Header
+//   Wall[WallCount]
+//   uint32_t CellOffsets[GridColumns * GridRows + 1]
+//   uint32_t CellWalls[CellWallCount]   (wall indices, per cell)
+//   std::byte Dictionary[DictionarySize] (zstd, see Compression.hpp)
+namespace mapformat
+{
+
+static_assert(std::endian::native == std::endian::little,
+              "compiled maps are little-endian only");
+
+inline constexpr uint32_t Magic{ 0x4D504D53 }; // "SMPM"
+// 2: message compression dictionary
+inline constexpr uint32_t Version{ 2 };
+inline constexpr float DefaultCellSize{ 64.F };
+
+struct Header
+{
+    uint32_t Magic;
+    uint32_t Version;
+    float WorldWidth;
+    float WorldHeight;
+    float PlayerRadius;
+    float PlayerSpeed;
+    float BulletRadius;
+    float BulletSpeed;
+    int32_t MaxPlayers;
+    uint32_t WallCount;
+    float CellSize;
+    uint32_t GridColumns;
+    uint32_t GridRows;
+    uint32_t CellWallCount;
+    // 0 for maps without one
+    uint32_t DictionarySize;
+};
+
+struct Wall
+{
+    float StartX;
+    float StartY;
+    float EndX;
+    float EndY;
+};
+
+} // namespace mapformat
+
+// turns a JSON map (the config file format) into a compiled map, bounding
+// walls included. The dictionary is stored as is.
+auto CompileMap(const nlohmann::json& mapJson,
+                float cellSize = mapformat::DefaultCellSize,
+                std::span<const std::byte> dictionary = {})
+    -> std::vector<std::byte>;
+
+// Read-only view of a compiled map, either memory-mapped from a file or
+// owning the bytes. Walls are indexed in file order, which is also the order
+// of SessionOptions::Walls returned by GetOptions.
+class GameMap
+{
+public:
+    // throws std::runtime_error if the file is missing or malformed
+    static auto Load(const std::string& path) -> GameMap;
+    static auto FromBytes(std::vector<std::byte> bytes) -> GameMap;
+
+    GameMap(GameMap&& other) noexcept;
+    auto operator=(GameMap&& other) noexcept -> GameMap&;
+    GameMap(const GameMap&) = delete;
+    auto operator=(const GameMap&) -> GameMap& = delete;
+    ~GameMap();
+
+    [[nodiscard]] auto GetOptions() const -> SessionOptions;
+    [[nodiscard]] auto GetWallCount() const -> uint32_t;
+    // the compiled map as loaded, FromBytes of a copy gives the same map
+    [[nodiscard]] auto GetBytes() const -> std::span<const std::byte>;
+    // zstd dictionary for this map's messages, empty if it has none
+    [[nodiscard]] auto GetDictionary() const -> std::span<const std::byte>;
+
+    // visits every wall whose cell overlaps the box once, stops early if the
+    // visitor returns true
+    template <class Visitor>
+    void ForEachWallNear(Vector2 min, Vector2 max, Visitor&& visit) const
+    {
+        auto [firstColumn, firstRow]{ GetCell(min) };
+        auto [lastColumn, lastRow]{ GetCell(max) };
+
+        if (++m_Stamp == 0)
+        {
+            std::fill(m_VisitStamps.begin(), m_VisitStamps.end(), 0);
+            m_Stamp = 1;
+        }
+        for (auto row{ firstRow }; row <= lastRow; row++)
+        {
+            for (auto column{ firstColumn }; column <= lastColumn; column++)
+            {
+                auto cell{ row * m_Header->GridColumns + column };
+                for (auto idx{ m_CellOffsets[cell] };
+                     idx < m_CellOffsets[cell + 1]; idx++)
+                {
+                    auto wall{ m_CellWalls[idx] };
+                    if (m_VisitStamps[wall] == m_Stamp)
+                    {
+                        continue;
+                    }
+                    m_VisitStamps[wall] = m_Stamp;
+                    if (visit(wall))
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    GameMap() = default;
+
+    // validates the whole layout once, so lookups don't have to
+    void Parse(std::span<const std::byte> bytes);
+    [[nodiscard]] auto GetCell(Vector2 point) const
+        -> std::pair<uint32_t, uint32_t>;
+
+private:
+    void* m_Mapping{ nullptr };
+    size_t m_MappingSize{ 0 };
+    std::vector<std::byte> m_Bytes;
+
+    const mapformat::Header* m_Header{ nullptr };
+    std::span<const mapformat::Wall> m_Walls;
+    std::span<const uint32_t> m_CellOffsets;
+    std::span<const uint32_t> m_CellWalls;
+    std::span<const std::byte> m_Dictionary;
+
+    // dedups walls spanning several cells without clearing anything per
+    // query
+    mutable std::vector<uint32_t> m_VisitStamps;
+    mutable uint32_t m_Stamp{ 0 };
+};
+
+} // namespace smp::game
@@ -0,0 +1,100 @@
+#include "Histogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace smp::metrics
+{
+
+void Histogram::Record(uint64_t value)
+{
+    m_Buckets[BucketIndex(value)]++;
+    m_Count++;
+    m_Sum += value;
+    m_Min = std::min(m_Min, value);
+    m_Max = std::max(m_Max, value);
+}
+void Histogram::Merge(const Histogram& other)
+{
+    for (std::size_t i{ 0 }; i < s_BucketCount; i++)
+    {
+        m_Buckets[i] += other.m_Buckets[i];
+    }
+    m_Count += other.m_Count;
+    m_Sum += other.m_Sum;
+    m_Min = std::min(m_Min, other.m_Min);
+    m_Max = std::max(m_Max, other.m_Max);
+}
+void Histogram::Reset()
+{
+    *this = Histogram{};
+}
+auto Histogram::GetCount() const -> uint64_t
+{
+    return m_Count;
+}
+auto Histogram::GetMin() const -> uint64_t
+{
+    return m_Count == 0 ? 0 : m_Min;
+}
+auto Histogram::GetMax() const -> uint64_t
+{
+    return m_Max;
+}
+auto Histogram::GetMean() const -> double
+{
+    if (m_Count == 0)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(m_Sum) / static_cast<double>(m_Count);
+}
+auto Histogram::GetPercentile(double percentile) const -> uint64_t
+{
+    if (m_Count == 0)
+    {
+        return 0;
+    }
+
+    auto rank{ static_cast<uint64_t>(
+        std::ceil(percentile / 100.0 * static_cast<double>(m_Count))) };
+    rank = std::clamp<uint64_t>(rank, 1, m_Count);
+
+    uint64_t seen{ 0 };
+    for (std::size_t i{ 0 }; i < s_BucketCount; i++)
+    {
+        seen += m_Buckets[i];
+        if (seen >= rank)
+        {
+            // report bucket middle, but never outside of what we have seen
+            auto low{ BucketLowerBound(i) };
+            auto high{ i + 1 < s_BucketCount ? BucketLowerBound(i + 1)
+                                             : m_Max };
+            return std::clamp(low + (high - low) / 2, GetMin(), m_Max);
+        }
+    }
+    return m_Max;
+}
+auto Histogram::BucketIndex(uint64_t value) -> std::size_t
+{
+    if (value < s_SubBucketCount)
+    {
+        return value;
+    }
+    auto exponent{ static_cast<uint32_t>(std::bit_width(value)) - 1 };
+    auto shift{ exponent - s_SubBucketBits };
+    auto sub{ (value >> shift) & (s_SubBucketCount - 1) };
+    return s_SubBucketCount + shift * s_SubBucketCount + sub;
+}
+auto Histogram::BucketLowerBound(std::size_t index) -> uint64_t
+{
+    if (index < s_SubBucketCount)
+    {
+        return index;
+    }
+    auto shift{ (index - s_SubBucketCount) / s_SubBucketCount };
+    auto sub{ (index - s_SubBucketCount) % s_SubBucketCount };
+    return (s_SubBucketCount + sub) << shift;
+}
+
+} // namespace smp::metrics
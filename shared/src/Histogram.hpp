@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace smp::metrics
+{
+
+// log-linear histogram for latency-like values (we feed it microseconds).
+// every power of two is split into 16 sub buckets, so any reported
+// percentile is within ~6% of the real value while the whole thing stays a
+// flat array that never allocates
+class Histogram
+{
+public:
+    void Record(uint64_t value);
+    void Merge(const Histogram& other);
+    void Reset();
+
+    [[nodiscard]] auto GetCount() const -> uint64_t;
+    [[nodiscard]] auto GetMin() const -> uint64_t;
+    [[nodiscard]] auto GetMax() const -> uint64_t;
+    [[nodiscard]] auto GetMean() const -> double;
+    // percentile in [0, 100]
+    [[nodiscard]] auto GetPercentile(double percentile) const -> uint64_t;
+
+private:
+    static constexpr uint32_t s_SubBucketBits{ 4 };
+    static constexpr uint32_t s_SubBucketCount{ 1U << s_SubBucketBits };
+    static constexpr std::size_t s_BucketCount{ s_SubBucketCount +
+                                                (64 - s_SubBucketBits) *
+                                                    s_SubBucketCount };
+
+    [[nodiscard]] static auto BucketIndex(uint64_t value) -> std::size_t;
+    [[nodiscard]] static auto BucketLowerBound(std::size_t index) -> uint64_t;
+
+    std::array<uint64_t, s_BucketCount> m_Buckets{};
+    uint64_t m_Count{ 0 };
+    uint64_t m_Sum{ 0 };
+    uint64_t m_Min{ UINT64_MAX };
+    uint64_t m_Max{ 0 };
+};
+
+} // namespace smp::metrics
@@ -0,0 +1,147 @@
+#include "LatencyTrace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace smp::trace
+{
+
+auto Now() -> int64_t
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void ClockOffset::AddSample(int64_t sentAt, int64_t serverTime,
+                            int64_t receivedAt)
+{
+    auto roundTrip{ std::max<int64_t>(receivedAt - sentAt, 0) };
+    m_Samples[m_NextSample] = { roundTrip,
+                                serverTime + roundTrip / 2 - receivedAt };
+    m_NextSample = (m_NextSample + 1) % s_Window;
+    m_SampleCount = std::min(m_SampleCount + 1, s_Window);
+
+    auto best{ std::min_element(
+        m_Samples.begin(), m_Samples.begin() + m_SampleCount,
+        [](const Sample& lhs, const Sample& rhs)
+        { return lhs.RoundTrip < rhs.RoundTrip; }) };
+    m_Offset.store(best->Offset, std::memory_order_relaxed);
+    m_RoundTrip.store(best->RoundTrip, std::memory_order_relaxed);
+    m_Valid.store(true, std::memory_order_release);
+}
+void ClockOffset::Reset()
+{
+    m_Valid.store(false, std::memory_order_release);
+    m_SampleCount = 0;
+    m_NextSample = 0;
+}
+auto ClockOffset::Get() const -> std::optional<int64_t>
+{
+    if (!m_Valid.load(std::memory_order_acquire))
+    {
+        return std::nullopt;
+    }
+    return m_Offset.load(std::memory_order_relaxed);
+}
+auto ClockOffset::GetRoundTrip() const -> int64_t
+{
+    return m_RoundTrip.load(std::memory_order_relaxed);
+}
+
+Sampler::Sampler(double rate)
+    : m_Rate{ std::clamp(rate, 0.0, 1.0) }
+{
+}
+void Sampler::SetRate(double rate)
+{
+    m_Rate = std::clamp(rate, 0.0, 1.0);
+}
+auto Sampler::Sample() -> bool
+{
+    m_Credit += m_Rate;
+    if (m_Credit < 1.0)
+    {
+        return false;
+    }
+    m_Credit -= 1.0;
+    return true;
+}
+
+auto ParseTimeSyncRequest(const nlohmann::json& payload)
+    -> std::optional<uint64_t>
+{
+    if (!payload.is_object())
+    {
+        return std::nullopt;
+    }
+    auto sentIt{ payload.find("c") };
+    if (sentIt == payload.end() || !sentIt->is_number_unsigned())
+    {
+        return std::nullopt;
+    }
+    return sentIt->template get<uint64_t>();
+}
+auto SanitizeTrace(const nlohmann::json& trace)
+    -> std::optional<nlohmann::json>
+{
+    if (!trace.is_object())
+    {
+        return std::nullopt;
+    }
+    auto sentIt{ trace.find("c_send") };
+    auto receivedIt{ trace.find("s_recv") };
+    if (sentIt == trace.end() || receivedIt == trace.end() ||
+        !sentIt->is_number_integer() || !receivedIt->is_number_integer())
+    {
+        return std::nullopt;
+    }
+    return nlohmann::json{
+        { "c_send", sentIt->template get<int64_t>() },
+        { "s_recv", receivedIt->template get<int64_t>() },
+    };
+}
+void RecordStages(metrics::Registry& registry, const nlohmann::json& trace,
+                  bool own)
+{
+    struct Stage
+    {
+        const char* Name;
+        const char* From;
+        const char* To;
+    };
+    static constexpr std::array<Stage, 6> stages{ {
+        { "trace.uplink_us", "c_send", "s_recv" },
+        { "trace.queue_us", "s_recv", "s_apply" },
+        { "trace.tick_us", "s_apply", "s_send" },
+        { "trace.downlink_us", "s_send", "c_recv" },
+        { "trace.client_us", "c_recv", "c_apply" },
+        { "trace.total_us", "c_send", "c_apply" },
+    } };
+
+    for (const auto& stage : stages)
+    {
+        auto fromIt{ trace.find(stage.From) };
+        auto toIt{ trace.find(stage.To) };
+        if (fromIt == trace.end() || toIt == trace.end() ||
+            !fromIt->is_number_integer() || !toIt->is_number_integer())
+        {
+            continue;
+        }
+        auto duration{ toIt->template get<int64_t>() -
+                       fromIt->template get<int64_t>() };
+        if (duration < 0)
+        {
+            registry.AddCounter("trace.clock_skew");
+            continue;
+        }
+        std::string name{ stage.Name };
+        if (own && name == "trace.total_us")
+        {
+            name = "trace.own_total_us";
+        }
+        registry.RecordValue(name, static_cast<uint64_t>(duration));
+    }
+}
+
+} // namespace smp::trace
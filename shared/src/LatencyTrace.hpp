@@ -0,0 +1,93 @@
+#pragma once
+#include "Metrics.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+
+// End-to-end latency of sampled inputs. A traced "coords" input carries a
+// "trace" object, the room adds to it and attaches it to the next position
+// update of that player, so everyone who sees the movement can tell how
+// long it took. All fields are microseconds of the room's clock, clients
+// convert theirs with a ClockOffset:
+//   c_send   client sent the input
+//   s_recv   room's network thread received it
+//   s_tick   tick that applied it (a tick number, not a time)
+//   s_apply  simulation applied it
+//   s_send   position update carrying it was built
+//   c_recv   a client received that update
+//   c_apply  and put it on screen
+namespace smp::trace
+{
+
+// steady clock microseconds, what traces are measured in before offsets
+auto Now() -> int64_t;
+
+// Room's clock minus ours, from time_sync round trips: we send our time as
+// "c", the room answers at once with it and its own time as "s". The
+// answer is taken to have spent half the round trip on the way back. Of
+// the recent samples, the one with the shortest round trip had the least
+// queueing in it and is used.
+class ClockOffset
+{
+public:
+    void AddSample(int64_t sentAt, int64_t serverTime, int64_t receivedAt);
+    // talking to another server now, its clock is not the old one's
+    void Reset();
+    // nullopt before the first sample, safe from any thread
+    [[nodiscard]] auto Get() const -> std::optional<int64_t>;
+    [[nodiscard]] auto GetRoundTrip() const -> int64_t;
+
+private:
+    struct Sample
+    {
+        int64_t RoundTrip;
+        int64_t Offset;
+    };
+
+    static constexpr std::size_t s_Window{ 8 };
+
+    std::array<Sample, s_Window> m_Samples{};
+    std::size_t m_SampleCount{ 0 };
+    std::size_t m_NextSample{ 0 };
+    std::atomic<int64_t> m_Offset{ 0 };
+    std::atomic<int64_t> m_RoundTrip{ 0 };
+    std::atomic<bool> m_Valid{ false };
+};
+
+// lets through the given share of events, evenly spaced rather than
+// random, so low rates are exact even over few events
+class Sampler
+{
+public:
+    explicit Sampler(double rate = 0.0);
+
+    void SetRate(double rate);
+    [[nodiscard]] auto Sample() -> bool;
+
+private:
+    double m_Rate;
+    double m_Credit{ 0.0 };
+};
+
+// "c" of a client's time_sync request, nullopt unless the payload is an
+// object with an unsigned integer there
+auto ParseTimeSyncRequest(const nlohmann::json& payload)
+    -> std::optional<uint64_t>;
+
+// the part of a client's trace the room passes on: c_send, and s_recv the
+// room's network thread added. Nullopt if either is missing or not an
+// integer. Whatever else the client put in stays out of broadcasts.
+auto SanitizeTrace(const nlohmann::json& trace)
+    -> std::optional<nlohmann::json>;
+
+// records every stage the trace has both ends of as "trace.<stage>_us":
+// uplink, queue, tick, downlink, client, and total (own_total for our own
+// inputs). Stages that come out negative are clock error, those are only
+// counted as "trace.clock_skew".
+void RecordStages(metrics::Registry& registry, const nlohmann::json& trace,
+                  bool own = false);
+
+} // namespace smp::trace
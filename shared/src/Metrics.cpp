@@ -0,0 +1,52 @@
+#include "Metrics.hpp"
+
+namespace smp::metrics
+{
+
+void Registry::AddCounter(const std::string& name, uint64_t delta)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    m_Counters[name] += delta;
+}
+void Registry::SetGauge(const std::string& name, double value)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    m_Gauges[name] = value;
+}
+void Registry::RecordValue(const std::string& name, uint64_t value)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    m_Histograms[name].Record(value);
+}
+void Registry::MergeHistogram(const std::string& name,
+                              const Histogram& histogram)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    m_Histograms[name].Merge(histogram);
+}
+auto Registry::Collect() -> nlohmann::json
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+
+    nlohmann::json result = nlohmann::json::object();
+    for (const auto& [name, value] : m_Counters)
+    {
+        result[name] = value;
+    }
+    for (const auto& [name, value] : m_Gauges)
+    {
+        result[name] = value;
+    }
+    for (auto& [name, histogram] : m_Histograms)
+    {
+        result[name] = { { "count", histogram.GetCount() },
+                         { "mean", histogram.GetMean() },
+                         { "p50", histogram.GetPercentile(50) },
+                         { "p99", histogram.GetPercentile(99) },
+                         { "max", histogram.GetMax() } };
+        histogram.Reset();
+    }
+    return result;
+}
+
+} // namespace smp::metrics
@@ -0,0 +1,34 @@
+#pragma once
+#include "Histogram.hpp"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+
+namespace smp::metrics
+{
+
+// Named counters, gauges and histograms of one process. Cheap enough for
+// per-event use off the tick path; exported as a single json object (we log
+// it periodically and game servers put it into their heartbeat).
+class Registry
+{
+public:
+    void AddCounter(const std::string& name, uint64_t delta = 1);
+    void SetGauge(const std::string& name, double value);
+    void RecordValue(const std::string& name, uint64_t value);
+    void MergeHistogram(const std::string& name, const Histogram& histogram);
+
+    // histograms are reported as count/mean/p50/p99/max and cleared, so
+    // every report describes one interval; counters and gauges persist
+    [[nodiscard]] auto Collect() -> nlohmann::json;
+
+private:
+    std::mutex m_Mutex;
+    std::map<std::string, uint64_t> m_Counters;
+    std::map<std::string, double> m_Gauges;
+    std::map<std::string, Histogram> m_Histograms;
+};
+
+} // namespace smp::metrics
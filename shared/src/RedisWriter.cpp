@@ -0,0 +1,195 @@
+#include "RedisWriter.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace smp::server
+{
+
+RedisWriter::RedisWriter(const redis::ConnectionOptions& options)
+    : m_Redis{ std::make_unique<redis::Redis>(options) }
+{
+    m_Thread = std::make_unique<std::thread>([this]() { Run(); });
+}
+RedisWriter::~RedisWriter()
+{
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        m_Stopping = true;
+    }
+    m_Condition.notify_one();
+    m_Thread->join();
+}
+void RedisWriter::Set(const std::string& key, std::string value,
+                      std::chrono::milliseconds ttl)
+{
+    Enqueue({ Command::Type::Set, key, std::move(value), "k:" + key, ttl });
+}
+void RedisWriter::Del(const std::string& key)
+{
+    Enqueue({ Command::Type::Del, key, {}, "k:" + key });
+}
+void RedisWriter::Publish(const std::string& channel, std::string message,
+                          const std::string& coalesceTag)
+{
+    Enqueue({ Command::Type::Publish, channel, std::move(message),
+              "p:" + channel + ":" + coalesceTag });
+}
+auto RedisWriter::Flush(std::chrono::milliseconds timeout) -> bool
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    return m_FlushedCondition.wait_for(
+        lock, timeout,
+        [this]() { return m_Pending.empty() && !m_Writing; });
+}
+auto RedisWriter::GetDroppedCount() const -> uint64_t
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    return m_Dropped;
+}
+void RedisWriter::Enqueue(Command command)
+{
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+
+        auto indexIt{ m_PendingIndex.find(command.CoalesceKey) };
+        if (indexIt != m_PendingIndex.end())
+        {
+            m_Pending[indexIt->second] = std::move(command);
+        }
+        else if (m_Pending.size() >= s_MaxPendingCommands)
+        {
+            // redis is down for long enough, better lose a write than grow
+            m_Dropped++;
+            return;
+        }
+        else
+        {
+            m_PendingIndex.emplace(command.CoalesceKey, m_Pending.size());
+            m_Pending.push_back(std::move(command));
+        }
+    }
+    m_Condition.notify_one();
+}
+auto RedisWriter::WaitForBatch(std::vector<Command>& batch) -> bool
+{
+    std::unique_lock<std::mutex> lock{ m_Mutex };
+    m_Condition.wait(lock,
+                     [this]() { return m_Stopping || !m_Pending.empty(); });
+
+    if (m_Pending.empty())
+    {
+        return false;
+    }
+    batch.swap(m_Pending);
+    m_PendingIndex.clear();
+    m_Writing = true;
+    return true;
+}
+void RedisWriter::Requeue(std::vector<Command>& batch)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+
+    std::vector<Command> merged;
+    std::unordered_map<std::string, std::size_t> mergedIndex;
+    for (auto& command : batch)
+    {
+        if (m_PendingIndex.count(command.CoalesceKey) != 0)
+        {
+            // newer value is already waiting
+            continue;
+        }
+        mergedIndex.emplace(command.CoalesceKey, merged.size());
+        merged.push_back(std::move(command));
+    }
+    for (auto& command : m_Pending)
+    {
+        if (merged.size() >= s_MaxPendingCommands)
+        {
+            m_Dropped++;
+            continue;
+        }
+        mergedIndex.emplace(command.CoalesceKey, merged.size());
+        merged.push_back(std::move(command));
+    }
+
+    m_Pending = std::move(merged);
+    m_PendingIndex = std::move(mergedIndex);
+    m_Writing = false;
+    batch.clear();
+}
+void RedisWriter::FinishBatch(std::vector<Command>& batch)
+{
+    batch.clear();
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        m_Writing = false;
+    }
+    m_FlushedCondition.notify_all();
+}
+void RedisWriter::Run()
+{
+    std::vector<Command> batch;
+    auto backoff{ s_MinBackoff };
+
+    while (true)
+    {
+        try
+        {
+            // one connection for all batches while it stays healthy. MULTI
+            // makes a batch atomic, a registration never shows half done.
+            auto pipeline{ m_Redis->transaction(true) };
+
+            while (WaitForBatch(batch))
+            {
+                for (const auto& command : batch)
+                {
+                    switch (command.CommandType)
+                    {
+                    case Command::Type::Set:
+                        pipeline.set(command.Target, command.Value,
+                                     command.Ttl);
+                        break;
+                    case Command::Type::Del:
+                        pipeline.del(command.Target);
+                        break;
+                    case Command::Type::Publish:
+                        pipeline.publish(command.Target, command.Value);
+                        break;
+                    }
+                }
+                pipeline.exec();
+                FinishBatch(batch);
+                backoff = s_MinBackoff;
+            }
+            return;
+        }
+        catch (const redis::ReplyError& error)
+        {
+            // redis understood and refused, retrying won't help
+            std::cerr << "Redis rejected write: " << error.what() << std::endl;
+            FinishBatch(batch);
+        }
+        catch (const redis::Error& error)
+        {
+            std::cerr << "Redis write failed, retrying in " << backoff.count()
+                      << "ms: " << error.what() << std::endl;
+
+            std::unique_lock<std::mutex> lock{ m_Mutex };
+            if (m_Stopping)
+            {
+                // don't hang shutdown on a dead redis
+                return;
+            }
+            lock.unlock();
+
+            Requeue(batch);
+
+            lock.lock();
+            m_Condition.wait_for(lock, backoff,
+                                 [this]() { return m_Stopping; });
+            backoff = std::min(backoff * 2, s_MaxBackoff);
+        }
+    }
+}
+
+} // namespace smp::server
@@ -0,0 +1,96 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sw/redis++/redis++.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace smp::server
+{
+
+using namespace sw;
+
+// Background writer for everything a game server tells redis. Calls only
+// queue a command and return, a dedicated thread sends them in pipelined
+// transactions, so whatever was queued together is applied together.
+// Commands on the same key (or publishes with the same tag) coalesce, so only
+// the latest value is ever written and the queue stays bounded by the number
+// of distinct keys.
+class RedisWriter
+{
+public:
+    explicit RedisWriter(const redis::ConnectionOptions& options);
+    // tries to flush what is still queued, gives up on the first failure
+    ~RedisWriter();
+
+    RedisWriter(const RedisWriter&) = delete;
+    auto operator=(const RedisWriter&) -> RedisWriter& = delete;
+
+    // zero ttl means no expiry
+    void Set(const std::string& key, std::string value,
+             std::chrono::milliseconds ttl = std::chrono::milliseconds{ 0 });
+    void Del(const std::string& key);
+    // publishes with the same channel and tag replace each other
+    void Publish(const std::string& channel, std::string message,
+                 const std::string& coalesceTag);
+
+    // blocks until everything queued so far reached redis, false on timeout
+    auto Flush(std::chrono::milliseconds timeout) -> bool;
+
+    [[nodiscard]] auto GetDroppedCount() const -> uint64_t;
+
+private:
+    struct Command
+    {
+        enum class Type
+        {
+            Set,
+            Del,
+            Publish,
+        };
+
+        Type CommandType;
+        // key for set/del, channel for publish
+        std::string Target;
+        std::string Value;
+        // commands with equal keys replace each other
+        std::string CoalesceKey;
+        std::chrono::milliseconds Ttl{ 0 };
+    };
+
+    void Enqueue(Command command);
+    // moves pending commands into batch, false when stopped and drained
+    auto WaitForBatch(std::vector<Command>& batch) -> bool;
+    // puts failed batch back, unless newer values were queued meanwhile
+    void Requeue(std::vector<Command>& batch);
+    // batch is written or given up, wakes whoever flushes
+    void FinishBatch(std::vector<Command>& batch);
+    void Run();
+
+private:
+    static constexpr std::size_t s_MaxPendingCommands{ 1024 };
+    static constexpr std::chrono::milliseconds s_MinBackoff{ 50 };
+    static constexpr std::chrono::milliseconds s_MaxBackoff{ 5000 };
+
+    std::unique_ptr<redis::Redis> m_Redis;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    std::condition_variable m_FlushedCondition;
+    // keeps first-queued order, coalesced commands are replaced in place
+    std::vector<Command> m_Pending;
+    std::unordered_map<std::string, std::size_t> m_PendingIndex;
+    bool m_Stopping{ false };
+    // a batch was taken and is not written yet
+    bool m_Writing{ false };
+    uint64_t m_Dropped{ 0 };
+
+    std::unique_ptr<std::thread> m_Thread{ nullptr };
+};
+
+} // namespace smp::server
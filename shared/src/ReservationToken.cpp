@@ -0,0 +1,200 @@
+#include "ReservationToken.hpp"
+#include <bit>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace smp::discovery
+{
+
+// SipHash-2-4, small keyed hash that is fine as a short-lived MAC
+static auto SipHash(const ReservationKey& key, std::string_view data)
+    -> uint64_t
+{
+    uint64_t v0{ 0x736f6d6570736575ULL ^ key[0] };
+    uint64_t v1{ 0x646f72616e646f6dULL ^ key[1] };
+    uint64_t v2{ 0x6c7967656e657261ULL ^ key[0] };
+    uint64_t v3{ 0x7465646279746573ULL ^ key[1] };
+
+    auto round{ [&]()
+                {
+                    v0 += v1;
+                    v1 = std::rotl(v1, 13);
+                    v1 ^= v0;
+                    v0 = std::rotl(v0, 32);
+                    v2 += v3;
+                    v3 = std::rotl(v3, 16);
+                    v3 ^= v2;
+                    v0 += v3;
+                    v3 = std::rotl(v3, 21);
+                    v3 ^= v0;
+                    v2 += v1;
+                    v1 = std::rotl(v1, 17);
+                    v1 ^= v2;
+                    v2 = std::rotl(v2, 32);
+                } };
+
+    auto compress{ [&](uint64_t word)
+                   {
+                       v3 ^= word;
+                       round();
+                       round();
+                       v0 ^= word;
+                   } };
+
+    std::size_t offset{ 0 };
+    for (; offset + 8 <= data.size(); offset += 8)
+    {
+        uint64_t word{ 0 };
+        std::memcpy(&word, data.data() + offset, 8);
+        compress(word);
+    }
+
+    uint64_t last{ static_cast<uint64_t>(data.size()) << 56 };
+    for (std::size_t i{ 0 }; offset + i < data.size(); i++)
+    {
+        last |= static_cast<uint64_t>(
+                    static_cast<unsigned char>(data[offset + i]))
+                << (8 * i);
+    }
+    compress(last);
+
+    v2 ^= 0xff;
+    for (auto i{ 0 }; i < 4; i++)
+    {
+        round();
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static auto MacInput(uint64_t slotId, int64_t expiresMs,
+                     TokenPurpose purpose, const std::string& serverName)
+    -> std::string
+{
+    return serverName + "|" + std::to_string(slotId) + "|" +
+           std::to_string(expiresMs) + "|" +
+           std::to_string(static_cast<uint32_t>(purpose));
+}
+
+static auto ToHex(uint64_t value) -> std::string
+{
+    std::array<char, 16> buffer{};
+    auto [end, ec]{ std::to_chars(buffer.data(),
+                                  buffer.data() + buffer.size(), value, 16) };
+    return { buffer.data(), end };
+}
+
+template <class T>
+static auto ParseNumber(std::string_view text, int base) -> std::optional<T>
+{
+    T value{};
+    auto [end, ec]{ std::from_chars(text.data(), text.data() + text.size(),
+                                    value, base) };
+    if (ec != std::errc{} || end != text.data() + text.size())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// set once from main, before any key is loaded
+static bool s_AllowDevSecret{ false };
+
+void AllowInsecureDevSecret()
+{
+    s_AllowDevSecret = true;
+}
+auto LoadReservationKey() -> ReservationKey
+{
+    const char* secret{ std::getenv("SMP_RESERVATION_SECRET") };
+    if ((secret == nullptr || *secret == '\0') && !s_AllowDevSecret)
+    {
+        throw std::runtime_error{ "SMP_RESERVATION_SECRET is not set" };
+    }
+    std::string_view secretView{ secret != nullptr && *secret != '\0'
+                                     ? secret
+                                     : "mypassword" };
+
+    // stretch whatever length the secret has into a 128 bit key
+    ReservationKey derivation{ 0x5eed5eed5eed5eedULL, 0x0ddba11c0ffee000ULL };
+    auto first{ SipHash(derivation, secretView) };
+    derivation[1]++;
+    auto second{ SipHash(derivation, secretView) };
+    return { first, second };
+}
+
+auto ComputeMac(std::string_view data, const ReservationKey& key)
+    -> uint64_t
+{
+    return SipHash(key, data);
+}
+
+auto MacEquals(uint64_t lhs, uint64_t rhs) -> bool
+{
+    // folds every differing bit into the lowest one, no early exit
+    auto diff{ lhs ^ rhs };
+    for (auto shift{ 32 }; shift > 0; shift /= 2)
+    {
+        diff |= diff >> shift;
+    }
+    return (diff & 1) == 0;
+}
+auto SignReservation(const Reservation& reservation, TokenPurpose purpose,
+                     const std::string& serverName,
+                     const ReservationKey& key) -> std::string
+{
+    auto expiresMs{ std::chrono::duration_cast<std::chrono::milliseconds>(
+                        reservation.ExpiresAt.time_since_epoch())
+                        .count() };
+    auto mac{ SipHash(
+        key, MacInput(reservation.SlotId, expiresMs, purpose, serverName)) };
+    return ToHex(reservation.SlotId) + "." + std::to_string(expiresMs) + "." +
+           ToHex(mac);
+}
+
+auto VerifyReservation(std::string_view token, TokenPurpose purpose,
+                       const std::string& serverName,
+                       const ReservationKey& key)
+    -> std::optional<Reservation>
+{
+    auto firstDot{ token.find('.') };
+    auto secondDot{ token.find('.', firstDot + 1) };
+    if (firstDot == std::string_view::npos ||
+        secondDot == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+
+    auto slotId{ ParseNumber<uint64_t>(token.substr(0, firstDot), 16) };
+    auto expiresMs{ ParseNumber<int64_t>(
+        token.substr(firstDot + 1, secondDot - firstDot - 1), 10) };
+    auto mac{ ParseNumber<uint64_t>(token.substr(secondDot + 1), 16) };
+    if (!slotId.has_value() || !expiresMs.has_value() || !mac.has_value())
+    {
+        return std::nullopt;
+    }
+
+    if (!MacEquals(
+            SipHash(key, MacInput(*slotId, *expiresMs, purpose, serverName)),
+            *mac))
+    {
+        return std::nullopt;
+    }
+
+    Reservation reservation{ *slotId,
+                             std::chrono::system_clock::time_point{
+                                 std::chrono::milliseconds{ *expiresMs } } };
+    if (reservation.ExpiresAt < std::chrono::system_clock::now())
+    {
+        return std::nullopt;
+    }
+    return reservation;
+}
+
+auto FormatSlotId(uint64_t slotId) -> std::string
+{
+    return ToHex(slotId);
+}
+
+} // namespace smp::discovery
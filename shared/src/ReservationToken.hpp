@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace smp::discovery
+{
+
+using ReservationKey = std::array<uint64_t, 2>;
+
+// Slot an entry point reserved in a room for one client. The client gets it
+// as a signed token and presents it when connecting; the room gets it ahead of
+// time (see ReservationsChannel) to prepare the player.
+struct Reservation
+{
+    uint64_t SlotId{ 0 };
+    // wall clock, so it means the same thing in every process
+    std::chrono::system_clock::time_point ExpiresAt;
+};
+
+// what a token may be used for. It is part of the signed data, so a token
+// handed out for one purpose doesn't verify as another.
+enum class TokenPurpose : uint8_t
+{
+    // entry point reservation, presented with a join
+    Join,
+    // lets a client come back as the player it was, after a crash or a
+    // migration of its room
+    Resume,
+};
+
+// rooms subscribe to their own channel, messages are { "token": <token> }
+inline auto ReservationsChannel(const std::string& serverName) -> std::string
+{
+    return "smp.reservations." + serverName;
+}
+
+// shared secret of entry points and rooms, SMP_RESERVATION_SECRET env var.
+// throws std::runtime_error when it is not set
+auto LoadReservationKey() -> ReservationKey;
+// makes LoadReservationKey fall back to a well known secret instead of
+// throwing. local runs only, anyone can forge tokens for such a setup
+void AllowInsecureDevSecret();
+
+// token is "<slot hex>.<expiry ms>.<mac hex>", mac also covers the room name
+// and the purpose, so a token can't be used for another room or another
+// purpose
+auto SignReservation(const Reservation& reservation, TokenPurpose purpose,
+                     const std::string& serverName,
+                     const ReservationKey& key) -> std::string;
+auto VerifyReservation(std::string_view token, TokenPurpose purpose,
+                       const std::string& serverName,
+                       const ReservationKey& key)
+    -> std::optional<Reservation>;
+
+auto FormatSlotId(uint64_t slotId) -> std::string;
+
+// keyed hash of arbitrary data, for other things handed between processes
+// that share the secret (room migrations)
+auto ComputeMac(std::string_view data, const ReservationKey& key)
+    -> uint64_t;
+// takes as long however many bits match, so a forger learns nothing from
+// how fast a guess was turned down
+auto MacEquals(uint64_t lhs, uint64_t rhs) -> bool;
+
+} // namespace smp::discovery
@@ -1,6 +1,8 @@
 #include "ServerBase.hpp"
 #include "steam/steamnetworkingtypes.h"
+#include <array>
 #include <iostream>
+#include <utility>
 
 namespace smp::server
 {
@@ -10,6 +12,11 @@ ServerBase* ServerBase::s_CallbackInstance{ nullptr };
 void ServerBase::InitConnection(const std::string& addrIpv4)
 {
     m_Interface = SteamNetworkingSockets();
+    if (m_ListenSocket != k_HSteamListenSocket_Invalid)
+    {
+        std::cout << "Listening on " << addrIpv4 << " (adopted)\n";
+        return;
+    }
 
     SteamNetworkingIPAddr serverLocalAddr{};
     serverLocalAddr.Clear();
@@ -31,13 +38,35 @@ void ServerBase::InitConnection(const std::string& addrIpv4)
     std::cout << "Listening on " << addrIpv4 << '\n';
 }
 
+auto ServerBase::FormatAddress(const SteamNetworkingIPAddr& addr)
+    -> std::string
+{
+    std::array<char, SteamNetworkingIPAddr::k_cchMaxString> buffer{};
+    addr.ToString(buffer.data(), buffer.size(), true);
+    return buffer.data();
+}
+
+auto ServerBase::ReleaseListenSocket() -> HSteamListenSocket
+{
+    return std::exchange(m_ListenSocket, k_HSteamListenSocket_Invalid);
+}
+void ServerBase::AdoptListenSocket(HSteamListenSocket listenSocket)
+{
+    m_ListenSocket = listenSocket;
+}
+
 void ServerBase::SendMessageToConnection(HSteamNetConnection connection,
                                          const json& message)
 {
-    auto messageString{ message.dump() };
-    m_Interface->SendMessageToConnection(
-        connection, messageString.c_str(), messageString.size(),
-        k_nSteamNetworkingSend_Reliable, nullptr);
+    SendMessageToConnection(connection, message.dump());
+}
+void ServerBase::SendMessageToConnection(HSteamNetConnection connection,
+                                         const std::string& message,
+                                         int32_t sendFlags)
+{
+    m_BytesSent.fetch_add(message.size(), std::memory_order_relaxed);
+    m_Interface->SendMessageToConnection(connection, message.c_str(),
+                                         message.size(), sendFlags, nullptr);
 }
 
 void ServerBase::SteamNetConnectionStatusChangedCallback(
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <nlohmann/json.hpp>
 #include <steam/isteamnetworkingutils.h>
 #include <steam/steamnetworkingsockets.h>
@@ -16,11 +17,22 @@ public:
 
     static constexpr int32_t TickTimeMicroseconds{ 16667 };
 
+    // hands the listen socket to another server of this process, so clients
+    // redirected to the address never find it closed. Its connection
+    // callbacks go to whichever server polls GNS next.
+    auto ReleaseListenSocket() -> HSteamListenSocket;
+    void AdoptListenSocket(HSteamListenSocket listenSocket);
+
 protected:
+    // listens on addrIpv4 unless a listen socket was adopted
     void InitConnection(const std::string& addrIpv4);
 
     void SendMessageToConnection(HSteamNetConnection connection,
                                  const json& message);
+    // for payloads that are already serialized
+    void SendMessageToConnection(
+        HSteamNetConnection connection, const std::string& message,
+        int32_t sendFlags = k_nSteamNetworkingSend_Reliable);
 
     virtual void OnConnectionStatusChanged(
         SteamNetConnectionStatusChangedCallback_t* info) = 0;
@@ -31,10 +43,18 @@ protected:
 
     void PollConnectionStateChanges();
 
+    // "<ip>:<port>", the same for every way of writing one address
+    [[nodiscard]] static auto FormatAddress(const SteamNetworkingIPAddr& addr)
+        -> std::string;
+
 protected:
     ISteamNetworkingSockets* m_Interface{ nullptr };
     HSteamListenSocket m_ListenSocket{ k_HSteamListenSocket_Invalid };
-    bool m_Alive{ true };
+    // cleared from signal handlers and read by every worker thread
+    std::atomic<bool> m_Alive{ true };
+    // payload bytes handed to GNS, for bandwidth reporting. Sent and read
+    // from different threads in GameServer.
+    std::atomic<uint64_t> m_BytesSent{ 0 };
 };
 
 } // namespace smp::server
@@ -0,0 +1,33 @@
+#include "SessionBlob.hpp"
+
+namespace smp::game
+{
+
+auto MakeSessionBlob(const SessionOptions& options) -> SessionBlob
+{
+    auto data{ options.ToJSON().dump() };
+    auto hash{ HashSessionData(data) };
+    return { std::move(data), std::move(hash) };
+}
+
+auto HashSessionData(std::string_view data) -> std::string
+{
+    // only has to tell maps apart, not to resist anyone
+    uint64_t hash{ 0xcbf29ce484222325ULL };
+    for (auto byte : data)
+    {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= 0x100000001b3ULL;
+    }
+
+    static constexpr std::string_view digits{ "0123456789abcdef" };
+    std::string hex(16, '0');
+    for (auto it{ hex.rbegin() }; it != hex.rend(); it++)
+    {
+        *it = digits[hash & 0xF];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+} // namespace smp::game
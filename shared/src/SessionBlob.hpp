@@ -0,0 +1,23 @@
+#pragma once
+#include "SessionOptions.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace smp::game
+{
+
+// Static part of a session (options and walls) serialized once per room.
+// Clients get only its hash on join and fetch the blob itself when they
+// don't have it cached.
+struct SessionBlob
+{
+    std::string Data;
+    // FNV-1a of Data, formatted as 16 hex digits
+    std::string Hash;
+};
+
+auto MakeSessionBlob(const SessionOptions& options) -> SessionBlob;
+auto HashSessionData(std::string_view data) -> std::string;
+
+} // namespace smp::game
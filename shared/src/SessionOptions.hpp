@@ -24,6 +24,12 @@ struct SessionOptions
           BulletRadius(json["bullet_radius"].template get<float>()),
           BulletSpeed(json["bullet_speed"].template get<float>())
     {
+        // optional ones, assigned here so defaults above are already in place
+        MaxPlayers = json.value("max_players", MaxPlayers);
+        WorldWidth = json.value("world_width", WorldWidth);
+        WorldHeight = json.value("world_height", WorldHeight);
+        Dictionary = json.value("dictionary", Dictionary);
+
         for (const auto& wall : json["walls"])
         {
             Walls.push_back({ LineCollider{ wall } });
@@ -45,7 +51,15 @@ struct SessionOptions
         nlohmann::json res = { { "player_radius", PlayerRadius },
                                { "player_speed", PlayerSpeed },
                                { "bullet_radius", BulletRadius },
-                               { "bullet_speed", BulletSpeed } };
+                               { "bullet_speed", BulletSpeed },
+                               { "max_players", MaxPlayers },
+                               { "world_width", WorldWidth },
+                               { "world_height", WorldHeight } };
+        // left out when empty, so maps without one keep their hash
+        if (!Dictionary.empty())
+        {
+            res["dictionary"] = Dictionary;
+        }
         for (auto wall : Walls)
         {
             nlohmann::json wallJson = { { "id", wall.Id },
@@ -66,12 +80,15 @@ struct SessionOptions
     float PlayerSpeed{ 300.F };
     float BulletRadius{ 5.F };
     float BulletSpeed{ 500.F };
+    // room capacity, entry points won't send more players here
+    int32_t MaxPlayers{ 16 };
+    // comes from the map, bounding walls are placed along it
+    float WorldWidth{ 860.F };
+    float WorldHeight{ 600.F };
     std::string Name;
     std::vector<WallEntitiy> Walls;
-
-public:
-    static constexpr uint32_t WorldWidth{ 860 };
-    static constexpr uint32_t WorldHeight{ 600 };
+    // zstd dictionary of the map's messages as base64, empty for none
+    std::string Dictionary;
 };
 
 } // namespace smp::game
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+
+namespace smp
+{
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two. Each side caches the
+// other side's index, so the shared cache lines are only touched when the
+// queue looks full (producer) or empty (consumer).
+template <class T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(std::size_t capacity)
+        : m_Capacity{ std::bit_ceil(capacity) },
+          m_Mask{ m_Capacity - 1 },
+          m_Slots{ std::make_unique<T[]>(m_Capacity) }
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    auto operator=(const SpscQueue&) -> SpscQueue& = delete;
+
+    // producer only, value is left untouched if the queue is full
+    [[nodiscard]] auto TryPush(T&& value) -> bool
+    {
+        auto tail{ m_Tail.load(std::memory_order_relaxed) };
+        if (tail - m_CachedHead == m_Capacity)
+        {
+            m_CachedHead = m_Head.load(std::memory_order_acquire);
+            if (tail - m_CachedHead == m_Capacity)
+            {
+                return false;
+            }
+        }
+
+        m_Slots[tail & m_Mask] = std::move(value);
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    [[nodiscard]] auto TryPop() -> std::optional<T>
+    {
+        auto head{ m_Head.load(std::memory_order_relaxed) };
+        if (head == m_CachedTail)
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head == m_CachedTail)
+            {
+                return std::nullopt;
+            }
+        }
+
+        std::optional<T> value{ std::move(m_Slots[head & m_Mask]) };
+        m_Head.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    // only a hint when called from a third thread
+    [[nodiscard]] auto IsEmpty() const -> bool
+    {
+        return m_Head.load(std::memory_order_acquire) ==
+               m_Tail.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr std::size_t s_CacheLine{ 64 };
+
+    const std::size_t m_Capacity;
+    const std::size_t m_Mask;
+    std::unique_ptr<T[]> m_Slots;
+
+    // consumer side
+    alignas(s_CacheLine) std::atomic<std::size_t> m_Head{ 0 };
+    std::size_t m_CachedTail{ 0 };
+    // producer side
+    alignas(s_CacheLine) std::atomic<std::size_t> m_Tail{ 0 };
+    std::size_t m_CachedHead{ 0 };
+};
+
+} // namespace smp
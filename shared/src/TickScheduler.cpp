@@ -0,0 +1,120 @@
+#include "TickScheduler.hpp"
+#include <cerrno>
+#include <ctime>
+
+namespace smp::server
+{
+
+TickScheduler::TickScheduler(std::chrono::nanoseconds period,
+                             OverrunPolicy policy,
+                             std::chrono::nanoseconds spinThreshold)
+    : m_Period{ period },
+      m_Policy{ policy },
+      m_SpinThreshold{ spinThreshold }
+{
+}
+void TickScheduler::Start()
+{
+    m_NextDeadline = Clock::now();
+    m_TickStart = m_NextDeadline;
+    m_CatchUpTicks = 0;
+}
+auto TickScheduler::BeginTick() -> float
+{
+    auto scheduledStart{ m_NextDeadline };
+    SleepUntil(scheduledStart, m_SpinThreshold);
+
+    auto now{ Clock::now() };
+    m_Stats.Jitter.Record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now -
+                                                              scheduledStart)
+            .count()));
+    m_Stats.Ticks++;
+
+    auto ticksAdvanced{ 1 };
+    m_NextDeadline += m_Period;
+
+    if (now >= m_NextDeadline)
+    {
+        // we are already late for the next tick as well
+        if (m_Policy == OverrunPolicy::CatchUp &&
+            m_CatchUpTicks < MaxCatchUpTicks)
+        {
+            m_CatchUpTicks++;
+        }
+        else
+        {
+            // stay on the grid, but only for deadlines in the future
+            auto behind{ (now - m_NextDeadline) / m_Period + 1 };
+            m_NextDeadline += behind * m_Period;
+            m_Stats.SkippedTicks += behind;
+            if (m_Policy == OverrunPolicy::Skip)
+            {
+                ticksAdvanced += static_cast<int>(behind);
+            }
+            m_CatchUpTicks = 0;
+        }
+    }
+    else
+    {
+        m_CatchUpTicks = 0;
+    }
+
+    m_TickStart = now;
+    return std::chrono::duration<float>{ m_Period * ticksAdvanced }.count();
+}
+void TickScheduler::EndTick()
+{
+    auto now{ Clock::now() };
+    auto tickTime{ now - m_TickStart };
+    m_Stats.TickTime.Record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(tickTime)
+            .count()));
+    if (tickTime > m_Period)
+    {
+        m_Stats.Overruns++;
+    }
+}
+auto TickScheduler::GetPeriod() const -> std::chrono::nanoseconds
+{
+    return m_Period;
+}
+auto TickScheduler::GetNextDeadline() const -> Clock::time_point
+{
+    return m_NextDeadline;
+}
+auto TickScheduler::GetStats() const -> const TickStats&
+{
+    return m_Stats;
+}
+void TickScheduler::ResetStats()
+{
+    m_Stats = TickStats{};
+}
+void TickScheduler::SleepUntil(Clock::time_point deadline,
+                               std::chrono::nanoseconds spinThreshold)
+{
+    // steady_clock is CLOCK_MONOTONIC on linux, so its epoch can be handed
+    // to clock_nanosleep directly
+    auto sleepDeadline{ deadline - spinThreshold };
+    if (sleepDeadline > Clock::now())
+    {
+        auto sinceEpoch{ std::chrono::duration_cast<std::chrono::nanoseconds>(
+            sleepDeadline.time_since_epoch()) };
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(sinceEpoch.count() / 1'000'000'000);
+        ts.tv_nsec = static_cast<long>(sinceEpoch.count() % 1'000'000'000);
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+               EINTR)
+        {
+        }
+    }
+
+    // final stretch is spun to hide scheduler wakeup latency
+    while (Clock::now() < deadline)
+    {
+    }
+}
+
+} // namespace smp::server
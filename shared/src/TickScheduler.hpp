@@ -0,0 +1,76 @@
+#pragma once
+#include "Histogram.hpp"
+#include <chrono>
+#include <cstdint>
+
+namespace smp::server
+{
+
+// what to do when a tick finished after the next one should have started
+enum class OverrunPolicy
+{
+    // run the missed ticks back to back (fixed dt) until we are on schedule
+    // again, gives up and resyncs after MaxCatchUpTicks
+    CatchUp,
+    // drop missed ticks and continue on the original grid, next tick gets a
+    // proportionally larger dt
+    Skip,
+};
+
+struct TickStats
+{
+    // actual tick start minus scheduled tick start, microseconds
+    metrics::Histogram Jitter;
+    // time between BeginTick and EndTick, microseconds
+    metrics::Histogram TickTime;
+    uint64_t Ticks{ 0 };
+    uint64_t Overruns{ 0 };
+    uint64_t SkippedTicks{ 0 };
+};
+
+// Sleeps to absolute deadlines on a fixed grid (start + n * period), so time
+// spent between ticks is never lost and overruns never turn into negative
+// sleeps.
+class TickScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t MaxCatchUpTicks{ 5 };
+
+    explicit TickScheduler(
+        std::chrono::nanoseconds period,
+        OverrunPolicy policy = OverrunPolicy::Skip,
+        std::chrono::nanoseconds spinThreshold = std::chrono::nanoseconds{ 0 });
+
+    // anchors the grid at now, call once right before the loop
+    void Start();
+
+    // blocks until the next deadline and returns scheduled time since the
+    // previous tick in seconds (independent of wakeup jitter)
+    auto BeginTick() -> float;
+    void EndTick();
+
+    [[nodiscard]] auto GetPeriod() const -> std::chrono::nanoseconds;
+    [[nodiscard]] auto GetNextDeadline() const -> Clock::time_point;
+    [[nodiscard]] auto GetStats() const -> const TickStats&;
+    void ResetStats();
+
+    // blocking sleep until the given point of steady_clock
+    static void SleepUntil(Clock::time_point deadline,
+                           std::chrono::nanoseconds spinThreshold =
+                               std::chrono::nanoseconds{ 0 });
+
+private:
+    std::chrono::nanoseconds m_Period;
+    OverrunPolicy m_Policy;
+    std::chrono::nanoseconds m_SpinThreshold;
+
+    Clock::time_point m_NextDeadline;
+    Clock::time_point m_TickStart;
+    uint32_t m_CatchUpTicks{ 0 };
+
+    TickStats m_Stats;
+};
+
+} // namespace smp::server
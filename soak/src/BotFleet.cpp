@@ -0,0 +1,464 @@
+#include "BotFleet.hpp"
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <raymath.h>
+
+namespace smp::soak
+{
+
+namespace
+{
+
+auto HistogramToJson(const metrics::Histogram& histogram, double scale)
+    -> json
+{
+    if (histogram.GetCount() == 0)
+    {
+        return { { "count", 0 } };
+    }
+    return { { "count", histogram.GetCount() },
+             { "p50", static_cast<double>(histogram.GetPercentile(50)) *
+                          scale },
+             { "p95", static_cast<double>(histogram.GetPercentile(95)) *
+                          scale },
+             { "p99", static_cast<double>(histogram.GetPercentile(99)) *
+                          scale },
+             { "max", static_cast<double>(histogram.GetMax()) * scale } };
+}
+
+} // namespace
+
+BotFleet* BotFleet::s_CallbackInstance{ nullptr };
+
+BotFleet::BotFleet(Options options)
+    : m_Options{ std::move(options) },
+      m_Interface{ SteamNetworkingSockets() },
+      m_Bots(static_cast<std::size_t>(m_Options.BotCount))
+{
+    auto now{ SteamNetworkingUtils()->GetLocalTimestamp() };
+    auto ramp{ std::chrono::duration_cast<std::chrono::microseconds>(
+                   m_Options.RampInterval)
+                   .count() };
+    for (std::size_t idx{ 0 }; idx < m_Bots.size(); idx++)
+    {
+        m_Bots[idx].StartAt =
+            now + static_cast<SteamNetworkingMicroseconds>(idx) * ramp;
+    }
+}
+BotFleet::~BotFleet()
+{
+    for (const auto& [connection, botIdx] : m_BotByConnection)
+    {
+        m_Interface->CloseConnection(connection, 0, nullptr, false);
+    }
+}
+
+void BotFleet::Poll()
+{
+    s_CallbackInstance = this;
+    m_Interface->RunCallbacks();
+
+    auto now{ SteamNetworkingUtils()->GetLocalTimestamp() };
+    for (auto& bot : m_Bots)
+    {
+        switch (bot.State)
+        {
+        case Bot::Phase::Waiting:
+        {
+            if (now >= bot.StartAt)
+            {
+                Start(bot, now);
+            }
+            break;
+        }
+        case Bot::Phase::Matching:
+        {
+            ReceiveAssignment(bot);
+            break;
+        }
+        case Bot::Phase::Joining:
+        case Bot::Phase::Playing:
+        {
+            ReceiveRoomMessages(bot);
+            if (bot.State != Bot::Phase::Playing)
+            {
+                break;
+            }
+            if (bot.TurnedAt.has_value() &&
+                now - *bot.TurnedAt > s_TurnTimeout)
+            {
+                m_TurnsLost++;
+                bot.TurnedAt.reset();
+            }
+            if (now >= bot.NextTurn)
+            {
+                Turn(bot, now);
+            }
+            if (now >= bot.NextShot)
+            {
+                Shoot(bot, now);
+            }
+            break;
+        }
+        case Bot::Phase::Failed:
+        {
+            break;
+        }
+        }
+    }
+}
+void BotFleet::SampleConnections()
+{
+    for (const auto& bot : m_Bots)
+    {
+        if (bot.State != Bot::Phase::Playing)
+        {
+            continue;
+        }
+        SteamNetConnectionRealTimeStatus_t status{};
+        if (m_Interface->GetConnectionRealTimeStatus(bot.Connection, &status,
+                                                     0, nullptr) !=
+            k_EResultOK)
+        {
+            continue;
+        }
+        m_WireInBytes.Record(
+            static_cast<uint64_t>(std::max(status.m_flInBytesPerSec, 0.0F)));
+        m_WireOutBytes.Record(
+            static_cast<uint64_t>(std::max(status.m_flOutBytesPerSec, 0.0F)));
+        m_Ping.Record(static_cast<uint64_t>(std::max(status.m_nPing, 0)));
+        m_SampledBotSeconds++;
+    }
+}
+
+auto BotFleet::GetReport() const -> json
+{
+    uint64_t playing{ 0 };
+    for (const auto& bot : m_Bots)
+    {
+        playing += bot.State == Bot::Phase::Playing ? 1 : 0;
+    }
+    auto botSeconds{ static_cast<double>(
+        std::max<uint64_t>(m_SampledBotSeconds, 1)) };
+
+    return {
+        { "bots", m_Bots.size() },
+        { "playing", playing },
+        { "join_failures", m_JoinFailures },
+        { "disconnects", m_Disconnects },
+        { "join_ms", HistogramToJson(m_JoinTime, 1e-3) },
+        // input sent until the room's echo of it arrived
+        { "move_latency_ms", HistogramToJson(m_MoveLatency, 1e-3) },
+        { "shot_latency_ms", HistogramToJson(m_ShotLatency, 1e-3) },
+        { "turns_lost", m_TurnsLost },
+        { "own_updates", m_OwnUpdates },
+        { "correction_rate",
+          m_OwnUpdates == 0 ? 0.0
+                            : static_cast<double>(m_Corrections) /
+                                  static_cast<double>(m_OwnUpdates) },
+        { "in_payload_bytes_per_sec",
+          static_cast<double>(m_BytesReceived) / botSeconds },
+        { "in_messages_per_sec",
+          static_cast<double>(m_MessagesReceived) / botSeconds },
+        { "in_wire_bytes_per_sec", HistogramToJson(m_WireInBytes, 1.0) },
+        { "out_wire_bytes_per_sec", HistogramToJson(m_WireOutBytes, 1.0) },
+        { "ping_ms", HistogramToJson(m_Ping, 1.0) },
+    };
+}
+
+void BotFleet::Start(Bot& bot, SteamNetworkingMicroseconds now)
+{
+    bot.JoinStartedAt = now;
+    bot.Connection = Connect(m_Options.EntryAddress);
+    if (bot.Connection == k_HSteamNetConnection_Invalid)
+    {
+        Fail(bot);
+        return;
+    }
+    m_BotByConnection.emplace(
+        bot.Connection, static_cast<std::size_t>(&bot - m_Bots.data()));
+    bot.State = Bot::Phase::Matching;
+}
+void BotFleet::ReceiveAssignment(Bot& bot)
+{
+    ISteamNetworkingMessage* message{ nullptr };
+    if (m_Interface->ReceiveMessagesOnConnection(bot.Connection, &message,
+                                                 1) <= 0)
+    {
+        return;
+    }
+    auto assignment{ json::parse(
+        std::string_view{ static_cast<const char*>(message->m_pData),
+                          static_cast<size_t>(message->m_cbSize) },
+        nullptr, false) };
+    message->Release();
+
+    m_BotByConnection.erase(bot.Connection);
+    m_Interface->CloseConnection(bot.Connection, 0, nullptr, false);
+    bot.Connection = k_HSteamNetConnection_Invalid;
+    if (assignment.is_discarded() || !assignment.contains("ip") ||
+        !assignment.contains("port"))
+    {
+        Fail(bot);
+        return;
+    }
+
+    bot.Connection =
+        Connect(assignment["ip"].template get<std::string>() + ":" +
+                std::to_string(assignment["port"].template get<int32_t>()));
+    if (bot.Connection == k_HSteamNetConnection_Invalid)
+    {
+        Fail(bot);
+        return;
+    }
+    m_BotByConnection.emplace(
+        bot.Connection, static_cast<std::size_t>(&bot - m_Bots.data()));
+
+    // queued until the connection is up, like the real client does
+    json joinPayload = json::object();
+    if (assignment.contains("token"))
+    {
+        joinPayload["token"] = assignment["token"];
+    }
+    Send(bot.Connection, { { "type", "join" }, { "payload", joinPayload } });
+    bot.State = Bot::Phase::Joining;
+}
+void BotFleet::ReceiveRoomMessages(Bot& bot)
+{
+    std::array<ISteamNetworkingMessage*, s_ReceiveBatchSize> messages{};
+    int32_t numMessages{ 0 };
+    do
+    {
+        numMessages = m_Interface->ReceiveMessagesOnConnection(
+            bot.Connection, messages.data(), s_ReceiveBatchSize);
+        for (int32_t idx{ 0 }; idx < numMessages; idx++)
+        {
+            auto* message{ messages[idx] };
+            m_BytesReceived += static_cast<uint64_t>(message->m_cbSize);
+            m_MessagesReceived++;
+            auto messageJson{ json::parse(
+                std::string_view{ static_cast<const char*>(message->m_pData),
+                                  static_cast<size_t>(message->m_cbSize) },
+                nullptr, false) };
+            auto receivedAt{ message->m_usecTimeReceived };
+            message->Release();
+
+            if (!messageJson.is_discarded() && messageJson.contains("type"))
+            {
+                HandleRoomMessage(bot, messageJson, receivedAt);
+            }
+        }
+    } while (numMessages == s_ReceiveBatchSize);
+}
+void BotFleet::HandleRoomMessage(Bot& bot, const json& message,
+                                 SteamNetworkingMicroseconds receivedAt)
+{
+    const auto& type{ message["type"].template get_ref<const std::string&>() };
+    const auto& payload{ message["payload"] };
+    if (bot.State == Bot::Phase::Joining)
+    {
+        if (type != "greeting")
+        {
+            return;
+        }
+        bot.PlayerId = payload["player_id"].template get<IdType>();
+        bot.LastPosition = Vector2{ payload["player_x"].template get<float>(),
+                                    payload["player_y"].template get<float>() };
+        bot.LastPositionAt = receivedAt;
+        bot.State = Bot::Phase::Playing;
+        m_JoinTime.Record(
+            static_cast<uint64_t>(receivedAt - bot.JoinStartedAt));
+
+        // spread out, so bots don't all turn and shoot on the same tick
+        auto now{ SteamNetworkingUtils()->GetLocalTimestamp() };
+        std::uniform_int_distribution<SteamNetworkingMicroseconds> offset{
+            0, std::chrono::duration_cast<std::chrono::microseconds>(
+                   m_Options.ShotInterval)
+                   .count()
+        };
+        bot.NextTurn = now;
+        bot.NextShot = now + offset(m_Random);
+        return;
+    }
+
+    if (type == "coords" &&
+        payload["id"].template get<IdType>() == bot.PlayerId)
+    {
+        HandleOwnPosition(bot,
+                          { payload["x"].template get<float>(),
+                            payload["y"].template get<float>() },
+                          receivedAt);
+    }
+    else if (type == "shoot" &&
+             payload["shooter_id"].template get<IdType>() == bot.PlayerId &&
+             !bot.PendingShots.empty())
+    {
+        m_ShotLatency.Record(
+            static_cast<uint64_t>(receivedAt - bot.PendingShots.front()));
+        bot.PendingShots.pop_front();
+    }
+}
+void BotFleet::HandleOwnPosition(Bot& bot, Vector2 position,
+                                 SteamNetworkingMicroseconds receivedAt)
+{
+    m_OwnUpdates++;
+    if (bot.LastPosition.has_value())
+    {
+        auto elapsed{ static_cast<float>(receivedAt - bot.LastPositionAt) *
+                      1e-6F };
+        auto predicted{ Vector2Add(
+            *bot.LastPosition,
+            Vector2Scale(bot.ConfirmedVelocity, elapsed)) };
+        if (Vector2Distance(predicted, position) >
+            m_Options.CorrectionThreshold)
+        {
+            m_Corrections++;
+        }
+
+        // the room moves us along the new direction, the turn has arrived
+        auto moved{ Vector2Subtract(position, *bot.LastPosition) };
+        auto distance{ Vector2Length(moved) };
+        if (bot.TurnedAt.has_value() && distance > 0.0F &&
+            Vector2DotProduct(moved, bot.Velocity) >
+                0.5F * distance * Vector2Length(bot.Velocity))
+        {
+            m_MoveLatency.Record(
+                static_cast<uint64_t>(receivedAt - *bot.TurnedAt));
+            bot.TurnedAt.reset();
+            bot.ConfirmedVelocity = bot.Velocity;
+        }
+    }
+    bot.LastPosition = position;
+    bot.LastPositionAt = receivedAt;
+}
+void BotFleet::Turn(Bot& bot, SteamNetworkingMicroseconds now)
+{
+    if (bot.TurnedAt.has_value())
+    {
+        // previous one still in flight, it would be confused with this one
+        bot.NextTurn = now + 1000;
+        return;
+    }
+
+    // roughly back where we came from, bots stay near the spawn and off the
+    // walls, and every turn is unmistakable in the positions we get back
+    std::uniform_real_distribution<float> angle{ -std::numbers::pi_v<float>,
+                                                 std::numbers::pi_v<float> };
+    std::uniform_real_distribution<float> deviation{ -0.5F, 0.5F };
+    auto heading{ Vector2Length(bot.Velocity) > 0.0F
+                      ? std::atan2(-bot.Velocity.y, -bot.Velocity.x) +
+                            deviation(m_Random)
+                      : angle(m_Random) };
+    bot.Velocity = { std::cos(heading) * m_Options.Speed,
+                     std::sin(heading) * m_Options.Speed };
+    Send(bot.Connection, { { "type", "coords" },
+                           { "payload",
+                             { { "id", bot.PlayerId },
+                               { "x", bot.Velocity.x },
+                               { "y", bot.Velocity.y } } } });
+    bot.TurnedAt = now;
+    bot.NextTurn =
+        now + std::chrono::duration_cast<std::chrono::microseconds>(
+                  m_Options.TurnInterval)
+                  .count();
+}
+void BotFleet::Shoot(Bot& bot, SteamNetworkingMicroseconds now)
+{
+    std::uniform_real_distribution<float> angle{ -std::numbers::pi_v<float>,
+                                                 std::numbers::pi_v<float> };
+    auto heading{ angle(m_Random) };
+    Send(bot.Connection, { { "type", "shoot" },
+                           { "payload",
+                             { { "shooter_id", bot.PlayerId },
+                               { "target_x", std::cos(heading) },
+                               { "target_y", std::sin(heading) } } } });
+    bot.PendingShots.push_back(now);
+    bot.NextShot =
+        now + std::chrono::duration_cast<std::chrono::microseconds>(
+                  m_Options.ShotInterval)
+                  .count();
+}
+void BotFleet::Fail(Bot& bot)
+{
+    if (bot.State == Bot::Phase::Playing)
+    {
+        m_Disconnects++;
+    }
+    else
+    {
+        m_JoinFailures++;
+    }
+    if (bot.Connection != k_HSteamNetConnection_Invalid)
+    {
+        m_BotByConnection.erase(bot.Connection);
+        m_Interface->CloseConnection(bot.Connection, 0, nullptr, false);
+        bot.Connection = k_HSteamNetConnection_Invalid;
+    }
+    bot.State = Bot::Phase::Failed;
+}
+
+auto BotFleet::Connect(const std::string& address) -> HSteamNetConnection
+{
+    SteamNetworkingConfigValue_t opt{};
+    opt.SetPtr(
+        k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged,
+        reinterpret_cast<void*>(SteamNetConnectionStatusChangedCallback));
+
+    SteamNetworkingIPAddr serverAddr{};
+    serverAddr.Clear();
+    serverAddr.ParseString(address.c_str());
+    return m_Interface->ConnectByIPAddress(serverAddr, 1, &opt);
+}
+void BotFleet::Send(HSteamNetConnection connection, const json& message)
+{
+    auto data{ message.dump() };
+    m_Interface->SendMessageToConnection(connection, data.data(),
+                                         static_cast<uint32_t>(data.size()),
+                                         k_nSteamNetworkingSend_Reliable,
+                                         nullptr);
+}
+
+void BotFleet::OnConnectionStatusChanged(
+    SteamNetConnectionStatusChangedCallback_t* info)
+{
+    auto botIt{ m_BotByConnection.find(info->m_hConn) };
+    if (botIt == m_BotByConnection.end())
+    {
+        return;
+    }
+    auto& bot{ m_Bots[botIt->second] };
+    switch (info->m_info.m_eState)
+    {
+    case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
+    case k_ESteamNetworkingConnectionState_ClosedByPeer:
+    {
+        if (bot.State == Bot::Phase::Matching)
+        {
+            // the assignment may still be waiting to be read
+            ReceiveAssignment(bot);
+            if (bot.State != Bot::Phase::Matching)
+            {
+                break;
+            }
+        }
+        std::cerr << "Bot " << botIt->second
+                  << " lost its connection: " << info->m_info.m_szEndDebug
+                  << '\n';
+        Fail(bot);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+}
+void BotFleet::SteamNetConnectionStatusChangedCallback(
+    SteamNetConnectionStatusChangedCallback_t* info)
+{
+    s_CallbackInstance->OnConnectionStatusChanged(info);
+}
+
+} // namespace smp::soak
@@ -0,0 +1,140 @@
+#pragma once
+#include "Histogram.hpp"
+#include "Typedefs.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <raylib.h>
+#include <steam/isteamnetworkingutils.h>
+#include <steam/steamnetworkingsockets.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace smp::soak
+{
+
+// Headless players for soak runs. Each one gets its room from the entry
+// point like the real client, then keeps turning and shooting while it
+// measures what a player would see: how long until its own input shows up
+// in what the room sends back, and how often its own position would have
+// to snap.
+class BotFleet
+{
+public:
+    struct Options
+    {
+        std::string EntryAddress;
+        int32_t BotCount{ 0 };
+        // between bot starts, so the entry point isn't hit all at once
+        std::chrono::milliseconds RampInterval{ 0 };
+        // velocity the bots send, units per second
+        float Speed{ 0.0F };
+        std::chrono::milliseconds TurnInterval{ 0 };
+        std::chrono::milliseconds ShotInterval{ 0 };
+        // own positions further than this from where extrapolating the
+        // previous one put them count as corrections
+        float CorrectionThreshold{ 0.0F };
+    };
+
+    explicit BotFleet(Options options);
+    ~BotFleet();
+
+    BotFleet(const BotFleet&) = delete;
+    auto operator=(const BotFleet&) -> BotFleet& = delete;
+
+    // one step of every bot, call it every millisecond or so
+    void Poll();
+    // once a second, samples the connections' wire rates
+    void SampleConnections();
+
+    [[nodiscard]] auto GetReport() const -> json;
+
+private:
+    struct Bot
+    {
+        enum class Phase
+        {
+            Waiting,
+            Matching,
+            Joining,
+            Playing,
+            Failed
+        };
+
+        Phase State{ Phase::Waiting };
+        SteamNetworkingMicroseconds StartAt{ 0 };
+        SteamNetworkingMicroseconds JoinStartedAt{ 0 };
+        HSteamNetConnection Connection{ k_HSteamNetConnection_Invalid };
+        IdType PlayerId{ 0 };
+
+        // last sent, and what the room is believed to apply
+        Vector2 Velocity{ 0.0F, 0.0F };
+        Vector2 ConfirmedVelocity{ 0.0F, 0.0F };
+        // turn not seen in our position yet
+        std::optional<SteamNetworkingMicroseconds> TurnedAt;
+        SteamNetworkingMicroseconds NextTurn{ 0 };
+        SteamNetworkingMicroseconds NextShot{ 0 };
+        // shots are reliable and echoed in order
+        std::deque<SteamNetworkingMicroseconds> PendingShots;
+
+        std::optional<Vector2> LastPosition;
+        SteamNetworkingMicroseconds LastPositionAt{ 0 };
+    };
+
+    void Start(Bot& bot, SteamNetworkingMicroseconds now);
+    void ReceiveAssignment(Bot& bot);
+    void ReceiveRoomMessages(Bot& bot);
+    void HandleRoomMessage(Bot& bot, const json& message,
+                           SteamNetworkingMicroseconds receivedAt);
+    void HandleOwnPosition(Bot& bot, Vector2 position,
+                           SteamNetworkingMicroseconds receivedAt);
+    void Turn(Bot& bot, SteamNetworkingMicroseconds now);
+    void Shoot(Bot& bot, SteamNetworkingMicroseconds now);
+    void Fail(Bot& bot);
+
+    auto Connect(const std::string& address) -> HSteamNetConnection;
+    void Send(HSteamNetConnection connection, const json& message);
+
+    void
+    OnConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t* info);
+
+    static BotFleet* s_CallbackInstance;
+    static void SteamNetConnectionStatusChangedCallback(
+        SteamNetConnectionStatusChangedCallback_t* info);
+
+private:
+    static constexpr int32_t s_ReceiveBatchSize{ 64 };
+    // a turn not seen by then was lost (or ran into a wall)
+    static constexpr SteamNetworkingMicroseconds s_TurnTimeout{ 5'000'000 };
+
+    Options m_Options;
+    ISteamNetworkingSockets* m_Interface{ nullptr };
+    std::vector<Bot> m_Bots;
+    std::unordered_map<HSteamNetConnection, std::size_t> m_BotByConnection;
+    std::mt19937 m_Random{ std::random_device{}() };
+
+    metrics::Histogram m_JoinTime;
+    metrics::Histogram m_MoveLatency;
+    metrics::Histogram m_ShotLatency;
+    uint64_t m_TurnsLost{ 0 };
+    uint64_t m_OwnUpdates{ 0 };
+    uint64_t m_Corrections{ 0 };
+    uint64_t m_BytesReceived{ 0 };
+    uint64_t m_MessagesReceived{ 0 };
+    uint64_t m_JoinFailures{ 0 };
+    uint64_t m_Disconnects{ 0 };
+
+    // per bot and second, from the connections' own status
+    metrics::Histogram m_WireInBytes;
+    metrics::Histogram m_WireOutBytes;
+    metrics::Histogram m_Ping;
+    uint64_t m_SampledBotSeconds{ 0 };
+};
+
+} // namespace smp::soak
@@ -0,0 +1,83 @@
+#include "Impairment.hpp"
+#include <steam/isteamnetworkingutils.h>
+#include <steam/steamnetworkingsockets.h>
+#include <tuple>
+
+namespace smp::soak
+{
+
+auto FindImpairmentProfile(std::string_view name) -> std::optional<Impairment>
+{
+    if (name == "clean")
+    {
+        return Impairment{};
+    }
+    // busy home network
+    if (name == "wifi")
+    {
+        return Impairment{ .LagMs = 10,
+                           .LossPercent = 1.0F,
+                           .ReorderPercent = 2.0F,
+                           .ReorderMs = 10,
+                           .DuplicatePercent = 0.0F,
+                           .DuplicateMs = 0 };
+    }
+    if (name == "mobile")
+    {
+        return Impairment{ .LagMs = 40,
+                           .LossPercent = 3.0F,
+                           .ReorderPercent = 5.0F,
+                           .ReorderMs = 30,
+                           .DuplicatePercent = 1.0F,
+                           .DuplicateMs = 20 };
+    }
+    // worst we still want to be playable on
+    if (name == "awful")
+    {
+        return Impairment{ .LagMs = 120,
+                           .LossPercent = 10.0F,
+                           .ReorderPercent = 10.0F,
+                           .ReorderMs = 80,
+                           .DuplicatePercent = 3.0F,
+                           .DuplicateMs = 50 };
+    }
+    return std::nullopt;
+}
+
+void ApplyImpairment(const Impairment& impairment)
+{
+    auto* utils{ SteamNetworkingUtils() };
+    for (auto [lag, loss, reorder, duplicate] :
+         { std::tuple{ k_ESteamNetworkingConfig_FakePacketLag_Send,
+                       k_ESteamNetworkingConfig_FakePacketLoss_Send,
+                       k_ESteamNetworkingConfig_FakePacketReorder_Send,
+                       k_ESteamNetworkingConfig_FakePacketDup_Send },
+           std::tuple{ k_ESteamNetworkingConfig_FakePacketLag_Recv,
+                       k_ESteamNetworkingConfig_FakePacketLoss_Recv,
+                       k_ESteamNetworkingConfig_FakePacketReorder_Recv,
+                       k_ESteamNetworkingConfig_FakePacketDup_Recv } })
+    {
+        utils->SetGlobalConfigValueInt32(lag, impairment.LagMs);
+        utils->SetGlobalConfigValueFloat(loss, impairment.LossPercent);
+        utils->SetGlobalConfigValueFloat(reorder, impairment.ReorderPercent);
+        utils->SetGlobalConfigValueFloat(duplicate,
+                                         impairment.DuplicatePercent);
+    }
+    utils->SetGlobalConfigValueInt32(
+        k_ESteamNetworkingConfig_FakePacketReorder_Time, impairment.ReorderMs);
+    utils->SetGlobalConfigValueInt32(
+        k_ESteamNetworkingConfig_FakePacketDup_TimeMax,
+        impairment.DuplicateMs);
+}
+
+auto ImpairmentToJson(const Impairment& impairment) -> nlohmann::json
+{
+    return { { "lag_ms", impairment.LagMs },
+             { "loss_percent", impairment.LossPercent },
+             { "reorder_percent", impairment.ReorderPercent },
+             { "reorder_ms", impairment.ReorderMs },
+             { "duplicate_percent", impairment.DuplicatePercent },
+             { "duplicate_ms", impairment.DuplicateMs } };
+}
+
+} // namespace smp::soak
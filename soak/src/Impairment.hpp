@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string_view>
+
+namespace smp::soak
+{
+
+// Network conditions forced onto the bots' connections. Every value applies
+// to each direction, so the round trip grows by twice the lag.
+struct Impairment
+{
+    int32_t LagMs{ 0 };
+    float LossPercent{ 0.0F };
+    // delayed by ReorderMs on top of the lag, so later packets overtake
+    float ReorderPercent{ 0.0F };
+    int32_t ReorderMs{ 0 };
+    // the copy arrives up to DuplicateMs later
+    float DuplicatePercent{ 0.0F };
+    int32_t DuplicateMs{ 0 };
+};
+
+// clean, wifi, mobile or awful
+auto FindImpairmentProfile(std::string_view name) -> std::optional<Impairment>;
+
+// set through GameNetworkingSockets' fake packet config, which is global to
+// a process: the servers under test keep a clean stack, all the bad network
+// is on the bots' side
+void ApplyImpairment(const Impairment& impairment);
+
+auto ImpairmentToJson(const Impairment& impairment) -> nlohmann::json;
+
+} // namespace smp::soak
@@ -0,0 +1,529 @@
+#include "RedisStandIn.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace smp::soak
+{
+
+namespace
+{
+
+auto Simple(std::string_view status) -> std::string
+{
+    return "+" + std::string{ status } + "\r\n";
+}
+auto Error(std::string_view what) -> std::string
+{
+    return "-ERR " + std::string{ what } + "\r\n";
+}
+auto Integer(int64_t value) -> std::string
+{
+    return ":" + std::to_string(value) + "\r\n";
+}
+auto Bulk(const std::optional<std::string>& value) -> std::string
+{
+    if (!value.has_value())
+    {
+        return "$-1\r\n";
+    }
+    return "$" + std::to_string(value->size()) + "\r\n" + *value + "\r\n";
+}
+// items are already encoded
+auto Array(const std::vector<std::string>& items) -> std::string
+{
+    auto reply{ "*" + std::to_string(items.size()) + "\r\n" };
+    for (const auto& item : items)
+    {
+        reply += item;
+    }
+    return reply;
+}
+
+auto ToUpper(std::string text) -> std::string
+{
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    return text;
+}
+auto ParseInteger(std::string_view text) -> std::optional<int64_t>
+{
+    int64_t value{ 0 };
+    auto [end, error]{ std::from_chars(text.data(), text.data() + text.size(),
+                                       value) };
+    if (error != std::errc{} || end != text.data() + text.size())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+} // namespace
+
+RedisStandIn::RedisStandIn(uint16_t port)
+{
+    m_ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_ListenFd < 0)
+    {
+        throw std::runtime_error{ "Could not create redis stand-in socket" };
+    }
+    int reuse{ 1 };
+    setsockopt(m_ListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(m_ListenFd, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+        listen(m_ListenFd, SOMAXCONN) != 0)
+    {
+        close(m_ListenFd);
+        throw std::runtime_error{ "Redis stand-in could not listen on port " +
+                                  std::to_string(port) + ": " +
+                                  std::strerror(errno) };
+    }
+
+    m_AcceptThread = std::make_unique<std::thread>([this]() { Accept(); });
+}
+RedisStandIn::~RedisStandIn()
+{
+    m_Alive = false;
+    // wakes the blocking accept and reads
+    shutdown(m_ListenFd, SHUT_RDWR);
+    m_AcceptThread->join();
+    close(m_ListenFd);
+
+    std::lock_guard<std::mutex> clientsLock{ m_ClientsMutex };
+    for (const auto& client : m_Clients)
+    {
+        shutdown(client->Fd, SHUT_RDWR);
+    }
+    for (auto& thread : m_ClientThreads)
+    {
+        thread.join();
+    }
+    for (const auto& client : m_Clients)
+    {
+        close(client->Fd);
+    }
+}
+
+auto RedisStandIn::Get(const std::string& key) -> std::optional<std::string>
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    auto* value{ FindLocked(key) };
+    if (value == nullptr)
+    {
+        return std::nullopt;
+    }
+    return value->Data;
+}
+
+void RedisStandIn::Accept()
+{
+    while (m_Alive)
+    {
+        auto fd{ accept(m_ListenFd, nullptr, nullptr) };
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        auto client{ std::make_shared<Client>() };
+        client->Fd = fd;
+        std::lock_guard<std::mutex> clientsLock{ m_ClientsMutex };
+        if (!m_Alive)
+        {
+            close(fd);
+            return;
+        }
+        m_Clients.push_back(client);
+        m_ClientThreads.emplace_back([this, client]() { Serve(client); });
+    }
+}
+void RedisStandIn::Serve(const std::shared_ptr<Client>& client)
+{
+    std::string buffer;
+    char chunk[s_ReadSize];
+    try
+    {
+        while (m_Alive)
+        {
+            auto command{ ParseCommand(buffer) };
+            if (!command.has_value())
+            {
+                auto received{ read(client->Fd, chunk, sizeof(chunk)) };
+                if (received < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (received <= 0)
+                {
+                    break;
+                }
+                buffer.append(chunk, static_cast<size_t>(received));
+                continue;
+            }
+            if (command->empty())
+            {
+                continue;
+            }
+            Write(*client, Execute(client, *command));
+        }
+    }
+    catch (const std::runtime_error& error)
+    {
+        std::cerr << "Redis stand-in dropped a client: " << error.what()
+                  << '\n';
+    }
+    Unsubscribe(client);
+    // fd is closed by the destructor, it may still be shut down from there
+    shutdown(client->Fd, SHUT_RDWR);
+}
+
+auto RedisStandIn::Execute(const std::shared_ptr<Client>& client,
+                           const Command& command) -> std::string
+{
+    auto name{ ToUpper(command[0]) };
+    if (client->InTransaction && name != "EXEC" && name != "DISCARD" &&
+        name != "MULTI")
+    {
+        client->Queued.push_back(command);
+        return Simple("QUEUED");
+    }
+
+    if (name == "AUTH" || name == "SELECT" || name == "CLIENT")
+    {
+        return Simple("OK");
+    }
+    if (name == "PING")
+    {
+        return Simple("PONG");
+    }
+    if (name == "MULTI")
+    {
+        client->InTransaction = true;
+        return Simple("OK");
+    }
+    if (name == "DISCARD")
+    {
+        client->InTransaction = false;
+        client->Queued.clear();
+        return Simple("OK");
+    }
+    if (name == "EXEC")
+    {
+        client->InTransaction = false;
+        std::vector<std::string> replies;
+        for (const auto& queued : client->Queued)
+        {
+            replies.push_back(Execute(client, queued));
+        }
+        client->Queued.clear();
+        return Array(replies);
+    }
+    if (name == "SET" && command.size() >= 3)
+    {
+        return Set(command);
+    }
+    if (name == "GET" && command.size() == 2)
+    {
+        return Bulk(Get(command[1]));
+    }
+    if (name == "MGET" && command.size() >= 2)
+    {
+        std::vector<std::string> values;
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        for (std::size_t idx{ 1 }; idx < command.size(); idx++)
+        {
+            auto* value{ FindLocked(command[idx]) };
+            values.push_back(value != nullptr ? Bulk(value->Data)
+                                              : Bulk(std::nullopt));
+        }
+        return Array(values);
+    }
+    if (name == "DEL" && command.size() >= 2)
+    {
+        int64_t removed{ 0 };
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        for (std::size_t idx{ 1 }; idx < command.size(); idx++)
+        {
+            removed += static_cast<int64_t>(m_Values.erase(command[idx]));
+        }
+        return Integer(removed);
+    }
+    if (name == "SCAN" && command.size() >= 2)
+    {
+        return Scan(command);
+    }
+    if (name == "PUBLISH" && command.size() == 3)
+    {
+        return Integer(Publish(command[1], command[2]));
+    }
+    if (name == "SUBSCRIBE" && command.size() >= 2)
+    {
+        return Subscribe(client, command);
+    }
+    if (name == "UNSUBSCRIBE")
+    {
+        auto channels{ client->Channels };
+        Unsubscribe(client);
+        std::string replies;
+        for (const auto& channel : channels)
+        {
+            replies += Array({ Bulk("unsubscribe"), Bulk(channel),
+                               Integer(0) });
+        }
+        return replies;
+    }
+    return Error("unsupported command '" + command[0] + "'");
+}
+auto RedisStandIn::Set(const Command& command) -> std::string
+{
+    Value value{ command[2], std::nullopt };
+    auto onlyIfMissing{ false };
+    auto onlyIfPresent{ false };
+    for (std::size_t idx{ 3 }; idx < command.size(); idx++)
+    {
+        auto option{ ToUpper(command[idx]) };
+        if ((option == "EX" || option == "PX") && idx + 1 < command.size())
+        {
+            auto amount{ ParseInteger(command[++idx]) };
+            if (!amount.has_value() || *amount <= 0)
+            {
+                return Error("invalid expire time in 'set' command");
+            }
+            value.ExpiresAt =
+                Clock::now() + (option == "EX"
+                                    ? std::chrono::milliseconds{ *amount *
+                                                                 1000 }
+                                    : std::chrono::milliseconds{ *amount });
+        }
+        else if (option == "NX")
+        {
+            onlyIfMissing = true;
+        }
+        else if (option == "XX")
+        {
+            onlyIfPresent = true;
+        }
+        else
+        {
+            return Error("syntax error");
+        }
+    }
+
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    auto exists{ FindLocked(command[1]) != nullptr };
+    if ((onlyIfMissing && exists) || (onlyIfPresent && !exists))
+    {
+        return Bulk(std::nullopt);
+    }
+    m_Values[command[1]] = std::move(value);
+    return Simple("OK");
+}
+auto RedisStandIn::Scan(const Command& command) -> std::string
+{
+    std::string pattern{ "*" };
+    for (std::size_t idx{ 2 }; idx + 1 < command.size(); idx += 2)
+    {
+        if (ToUpper(command[idx]) == "MATCH")
+        {
+            pattern = command[idx + 1];
+        }
+    }
+
+    // the whole keyspace in one go, cursor is always done
+    std::vector<std::string> keys;
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    auto now{ Clock::now() };
+    std::erase_if(m_Values,
+                  [now](const auto& entry)
+                  {
+                      return entry.second.ExpiresAt.has_value() &&
+                             *entry.second.ExpiresAt <= now;
+                  });
+    for (const auto& [key, value] : m_Values)
+    {
+        if (Matches(pattern, key))
+        {
+            keys.push_back(Bulk(key));
+        }
+    }
+    return Array({ Bulk("0"), Array(keys) });
+}
+auto RedisStandIn::Publish(const std::string& channel,
+                           const std::string& message) -> int64_t
+{
+    std::vector<std::shared_ptr<Client>> subscribers;
+    {
+        std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+        auto channelIt{ m_Channels.find(channel) };
+        if (channelIt != m_Channels.end())
+        {
+            subscribers = channelIt->second;
+        }
+    }
+
+    auto frame{ Array({ Bulk("message"), Bulk(channel), Bulk(message) }) };
+    for (const auto& subscriber : subscribers)
+    {
+        try
+        {
+            Write(*subscriber, frame);
+        }
+        catch (const std::runtime_error&)
+        {
+            // it is going away, its own thread cleans up
+        }
+    }
+    return static_cast<int64_t>(subscribers.size());
+}
+auto RedisStandIn::Subscribe(const std::shared_ptr<Client>& client,
+                             const Command& command) -> std::string
+{
+    std::string replies;
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    for (std::size_t idx{ 1 }; idx < command.size(); idx++)
+    {
+        const auto& channel{ command[idx] };
+        if (std::find(client->Channels.begin(), client->Channels.end(),
+                      channel) == client->Channels.end())
+        {
+            client->Channels.push_back(channel);
+            m_Channels[channel].push_back(client);
+        }
+        replies +=
+            Array({ Bulk("subscribe"), Bulk(channel),
+                    Integer(static_cast<int64_t>(client->Channels.size())) });
+    }
+    return replies;
+}
+void RedisStandIn::Unsubscribe(const std::shared_ptr<Client>& client)
+{
+    std::lock_guard<std::mutex> mtxLock{ m_Mutex };
+    for (const auto& channel : client->Channels)
+    {
+        std::erase(m_Channels[channel], client);
+    }
+    client->Channels.clear();
+}
+
+auto RedisStandIn::FindLocked(const std::string& key) -> Value*
+{
+    auto valueIt{ m_Values.find(key) };
+    if (valueIt == m_Values.end())
+    {
+        return nullptr;
+    }
+    if (valueIt->second.ExpiresAt.has_value() &&
+        *valueIt->second.ExpiresAt <= Clock::now())
+    {
+        m_Values.erase(valueIt);
+        return nullptr;
+    }
+    return &valueIt->second;
+}
+
+auto RedisStandIn::ParseCommand(std::string& buffer) -> std::optional<Command>
+{
+    std::size_t offset{ 0 };
+    auto readLine{ [&buffer, &offset](char prefix) -> std::optional<int64_t>
+                   {
+                       auto end{ buffer.find("\r\n", offset) };
+                       if (end == std::string::npos)
+                       {
+                           return std::nullopt;
+                       }
+                       if (buffer[offset] != prefix)
+                       {
+                           throw std::runtime_error{ "malformed request" };
+                       }
+                       auto value{ ParseInteger(std::string_view{ buffer }
+                                                    .substr(offset + 1,
+                                                            end - offset -
+                                                                1)) };
+                       if (!value.has_value() || *value < 0)
+                       {
+                           throw std::runtime_error{ "malformed length" };
+                       }
+                       offset = end + 2;
+                       return value;
+                   } };
+
+    auto count{ readLine('*') };
+    if (!count.has_value())
+    {
+        return std::nullopt;
+    }
+    Command command;
+    for (int64_t idx{ 0 }; idx < *count; idx++)
+    {
+        auto length{ readLine('$') };
+        auto size{ static_cast<std::size_t>(length.value_or(0)) };
+        if (!length.has_value() || buffer.size() < offset + size + 2)
+        {
+            return std::nullopt;
+        }
+        command.emplace_back(buffer, offset, size);
+        offset += size + 2;
+    }
+    buffer.erase(0, offset);
+    return command;
+}
+void RedisStandIn::Write(Client& client, std::string_view data)
+{
+    std::lock_guard<std::mutex> writeLock{ client.WriteMutex };
+    while (!data.empty())
+    {
+        auto sent{ send(client.Fd, data.data(), data.size(), MSG_NOSIGNAL) };
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error{ std::strerror(errno) };
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+auto RedisStandIn::Matches(std::string_view pattern, std::string_view key)
+    -> bool
+{
+    if (pattern.empty())
+    {
+        return key.empty();
+    }
+    if (pattern.front() == '*')
+    {
+        for (std::size_t skip{ 0 }; skip <= key.size(); skip++)
+        {
+            if (Matches(pattern.substr(1), key.substr(skip)))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (key.empty() || (pattern.front() != '?' && pattern.front() != key[0]))
+    {
+        return false;
+    }
+    return Matches(pattern.substr(1), key.substr(1));
+}
+
+} // namespace smp::soak
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace smp::soak
+{
+
+// Just enough of a redis server for entry points and game servers: AUTH,
+// GET/SET with expiry, DEL, MGET, SCAN, PUBLISH/SUBSCRIBE and MULTI/EXEC
+// over RESP2 on loopback. A soak run needs no real redis this way, and the
+// harness reads the rooms' heartbeats straight from the store.
+class RedisStandIn
+{
+public:
+    // throws std::runtime_error if the port can't be bound
+    explicit RedisStandIn(uint16_t port);
+    ~RedisStandIn();
+
+    RedisStandIn(const RedisStandIn&) = delete;
+    auto operator=(const RedisStandIn&) -> RedisStandIn& = delete;
+
+    [[nodiscard]] auto Get(const std::string& key)
+        -> std::optional<std::string>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Command = std::vector<std::string>;
+
+    struct Value
+    {
+        std::string Data;
+        std::optional<Clock::time_point> ExpiresAt;
+    };
+
+    struct Client
+    {
+        int Fd{ -1 };
+        // publishes from other connections write here too
+        std::mutex WriteMutex;
+        bool InTransaction{ false };
+        std::vector<Command> Queued;
+        std::vector<std::string> Channels;
+    };
+
+    void Accept();
+    void Serve(const std::shared_ptr<Client>& client);
+    // encoded reply
+    auto Execute(const std::shared_ptr<Client>& client, const Command& command)
+        -> std::string;
+    auto Set(const Command& command) -> std::string;
+    auto Scan(const Command& command) -> std::string;
+    auto Publish(const std::string& channel, const std::string& message)
+        -> int64_t;
+    auto Subscribe(const std::shared_ptr<Client>& client,
+                   const Command& command) -> std::string;
+    void Unsubscribe(const std::shared_ptr<Client>& client);
+
+    // m_Mutex held, drops the value if it has expired
+    auto FindLocked(const std::string& key) -> Value*;
+
+    // nullopt until buffer holds a whole command, consumed from it then
+    static auto ParseCommand(std::string& buffer) -> std::optional<Command>;
+    static void Write(Client& client, std::string_view data);
+    // redis glob subset: '*' and '?'
+    static auto Matches(std::string_view pattern, std::string_view key)
+        -> bool;
+
+private:
+    static constexpr std::size_t s_ReadSize{ 4096 };
+
+    int m_ListenFd{ -1 };
+    std::atomic<bool> m_Alive{ true };
+    std::unique_ptr<std::thread> m_AcceptThread{ nullptr };
+
+    std::mutex m_ClientsMutex;
+    std::vector<std::shared_ptr<Client>> m_Clients;
+    std::vector<std::thread> m_ClientThreads;
+
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, Value> m_Values;
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Client>>>
+        m_Channels;
+};
+
+} // namespace smp::soak
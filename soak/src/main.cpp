@@ -0,0 +1,535 @@
+#include "BotFleet.hpp"
+#include "DebugOutput.hpp"
+#include "Discovery.hpp"
+#include "Histogram.hpp"
+#include "Impairment.hpp"
+#include "RedisStandIn.hpp"
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <steam/isteamnetworkingutils.h>
+#include <steam/steamnetworkingsockets.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+struct Process
+{
+    std::string Name;
+    pid_t Pid{ -1 };
+    bool Exited{ false };
+    int32_t Status{ 0 };
+};
+
+// game server seen through its heartbeats, see GameServer::SendHeartbeat
+struct ServerSamples
+{
+    Process Child;
+    std::string LastHeartbeat;
+    smp::metrics::Histogram TickP99;
+    smp::metrics::Histogram JitterP99;
+    double MaxOverrunRate{ 0.0 };
+    double OutBytesPerSecond{ 0.0 };
+    double CpuShare{ 0.0 };
+    uint64_t Samples{ 0 };
+};
+
+std::function<void(int)> ShutdownHandler = [](int) {};
+
+void SignalHandler(int sig)
+{
+    ShutdownHandler(sig);
+}
+
+// output goes to <logDir>/<name>.log, it would drown the report otherwise
+auto Spawn(const std::string& name, const std::string& binary,
+           std::vector<std::string> args, const std::filesystem::path& logDir)
+    -> Process
+{
+    auto logPath{ (logDir / (name + ".log")).string() };
+    args.insert(args.begin(), binary);
+
+    // everything the child needs is prepared here, after fork it may only
+    // make async-signal-safe calls (we have threads)
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (auto& arg : args)
+    {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    auto failure{ "Could not start " + binary + '\n' };
+
+    auto pid{ fork() };
+    if (pid == 0)
+    {
+        auto logFd{ open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                         0644) };
+        if (logFd >= 0)
+        {
+            dup2(logFd, STDOUT_FILENO);
+            dup2(logFd, STDERR_FILENO);
+            close(logFd);
+        }
+        execv(binary.c_str(), argv.data());
+        [[maybe_unused]] auto written{ write(STDERR_FILENO, failure.data(),
+                                             failure.size()) };
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        throw std::runtime_error{ "Could not fork for " + name };
+    }
+    return { name, pid };
+}
+// true if it is gone, exit status recorded
+auto Reap(Process& process) -> bool
+{
+    if (process.Exited)
+    {
+        return true;
+    }
+    int status{ 0 };
+    if (waitpid(process.Pid, &status, WNOHANG) != process.Pid)
+    {
+        return false;
+    }
+    process.Exited = true;
+    process.Status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                       : 128 + WTERMSIG(status);
+    return true;
+}
+void Terminate(std::vector<Process*> processes)
+{
+    for (auto* process : processes)
+    {
+        if (!Reap(*process))
+        {
+            kill(process->Pid, SIGTERM);
+        }
+    }
+    // rooms deregister and close their clients on the way out
+    auto deadline{ std::chrono::steady_clock::now() +
+                   std::chrono::seconds{ 5 } };
+    for (auto* process : processes)
+    {
+        while (!Reap(*process) && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+        }
+        if (!process->Exited)
+        {
+            std::cerr << process->Name << " ignored SIGTERM, killing it\n";
+            kill(process->Pid, SIGKILL);
+            waitpid(process->Pid, nullptr, 0);
+        }
+    }
+}
+
+void SampleHeartbeat(smp::soak::RedisStandIn& redis, ServerSamples& server)
+{
+    auto heartbeatData{ redis.Get(
+        smp::discovery::HeartbeatKey(server.Child.Name)) };
+    if (!heartbeatData.has_value() || *heartbeatData == server.LastHeartbeat)
+    {
+        return;
+    }
+    server.LastHeartbeat = *heartbeatData;
+
+    auto heartbeat{ nlohmann::json::parse(*heartbeatData, nullptr, false) };
+    if (heartbeat.is_discarded())
+    {
+        return;
+    }
+    server.TickP99.Record(heartbeat.value("tick_p99_us", uint64_t{ 0 }));
+    server.JitterP99.Record(
+        heartbeat.value("tick_jitter_p99_us", uint64_t{ 0 }));
+    server.MaxOverrunRate = std::max(
+        server.MaxOverrunRate, heartbeat.value("tick_overrun_rate", 0.0));
+    server.OutBytesPerSecond += heartbeat.value("out_bytes_per_sec", 0.0);
+    server.CpuShare += heartbeat.value("cpu_share", 0.0);
+    server.Samples++;
+}
+auto ServerReport(const ServerSamples& server) -> nlohmann::json
+{
+    auto samples{ static_cast<double>(
+        std::max<uint64_t>(server.Samples, 1)) };
+    nlohmann::json report = {
+        { "name", server.Child.Name },
+        { "heartbeats", server.Samples },
+        // every heartbeat reports the p99 of its own second
+        { "tick_p99_us_median", server.TickP99.GetPercentile(50) },
+        { "tick_p99_us_max", server.TickP99.GetMax() },
+        { "tick_jitter_p99_us_max", server.JitterP99.GetMax() },
+        { "tick_overrun_rate_max", server.MaxOverrunRate },
+        { "out_bytes_per_sec", server.OutBytesPerSecond / samples },
+        { "cpu_share", server.CpuShare / samples },
+    };
+    if (server.Child.Exited)
+    {
+        report["exit_status"] = server.Child.Status;
+    }
+    return report;
+}
+
+void PrintLatency(const std::string& label, const nlohmann::json& latency)
+{
+    std::cout << "  " << std::left << std::setw(16) << label;
+    if (latency["count"] == 0)
+    {
+        std::cout << "no samples\n";
+        return;
+    }
+    std::cout << "p50 " << latency["p50"].get<double>() << "  p95 "
+              << latency["p95"].get<double>() << "  p99 "
+              << latency["p99"].get<double>() << "  max "
+              << latency["max"].get<double>() << "  ("
+              << latency["count"] << " samples)\n";
+}
+void PrintReport(const nlohmann::json& report)
+{
+    const auto& bots{ report["bots"] };
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "\nSoak report, profile " << report["profile"] << " "
+              << report["impairment"].dump() << ", "
+              << report["duration_s"] << "s\n";
+    std::cout << "Bots: " << bots["playing"] << " of " << bots["bots"]
+              << " playing, " << bots["join_failures"]
+              << " failed to join, " << bots["disconnects"]
+              << " disconnected\n";
+    std::cout << "Input to display (ms):\n";
+    PrintLatency("movement", bots["move_latency_ms"]);
+    PrintLatency("shots", bots["shot_latency_ms"]);
+    PrintLatency("join", bots["join_ms"]);
+    std::cout << "Corrections: "
+              << bots["correction_rate"].get<double>() * 100.0 << "% of "
+              << bots["own_updates"] << " own position updates, "
+              << bots["turns_lost"] << " turns never seen\n";
+    std::cout << "Per bot in: "
+              << bots["in_payload_bytes_per_sec"].get<double>()
+              << " payload B/s, "
+              << bots["in_messages_per_sec"].get<double>() << " messages/s\n";
+    PrintLatency("wire in B/s", bots["in_wire_bytes_per_sec"]);
+    PrintLatency("wire out B/s", bots["out_wire_bytes_per_sec"]);
+    PrintLatency("ping ms", bots["ping_ms"]);
+
+    std::cout << "Servers:\n";
+    for (const auto& server : report["servers"])
+    {
+        std::cout << "  " << server["name"].get<std::string>()
+                  << ": tick p99 " << server["tick_p99_us_median"]
+                  << "us (max " << server["tick_p99_us_max"]
+                  << "us), jitter p99 max "
+                  << server["tick_jitter_p99_us_max"] << "us, overruns max "
+                  << server["tick_overrun_rate_max"].get<double>() * 100.0
+                  << "%, out " << server["out_bytes_per_sec"].get<double>()
+                  << " B/s, cpu "
+                  << server["cpu_share"].get<double>() * 100.0 << "%";
+        if (server.contains("exit_status"))
+        {
+            std::cout << ", EXITED with " << server["exit_status"];
+        }
+        std::cout << '\n';
+    }
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    namespace opts = boost::program_options;
+    int32_t serverCount{};
+    smp::soak::BotFleet::Options fleetOptions{};
+    int32_t durationSeconds{};
+    std::string profileName{};
+    std::string serverBinary{};
+    std::string entryBinary{};
+    std::string configPath{};
+    std::string mapPath{};
+    int32_t basePort{};
+    uint16_t redisPort{};
+    std::string logDir{};
+    std::string reportPath{};
+    int32_t rampMs{};
+    int32_t turnMs{};
+    int32_t shotMs{};
+
+    opts::options_description optsDescription{ "Allowed options" };
+    // clang-format off
+    optsDescription.add_options()
+		("help,h", "display help")
+		("servers,s",
+		 opts::value<int32_t>(&serverCount)->default_value(2),
+		 "game servers to start")
+		("bots,b",
+		 opts::value<int32_t>(&fleetOptions.BotCount)->default_value(16),
+		 "bot players, spread over the servers by the entry point")
+		("duration,d",
+		 opts::value<int32_t>(&durationSeconds)->default_value(60),
+		 "seconds to run")
+		("profile",
+		 opts::value<std::string>(&profileName)->default_value("clean"),
+		 "bots' network: clean, wifi, mobile or awful")
+		("lag-ms", opts::value<int32_t>(),
+		 "overrides the profile's lag, each direction")
+		("loss", opts::value<float>(),
+		 "overrides the profile's loss percent, each direction")
+		("reorder", opts::value<float>(),
+		 "overrides the profile's reordered percent, each direction")
+		("reorder-ms", opts::value<int32_t>(),
+		 "overrides the profile's extra delay of reordered packets")
+		("duplicate", opts::value<float>(),
+		 "overrides the profile's duplicated percent, each direction")
+		("server-bin",
+		 opts::value<std::string>(&serverBinary)
+			 ->default_value("./server/shooter-server"),
+		 "shooter-server executable")
+		("entry-bin",
+		 opts::value<std::string>(&entryBinary)
+			 ->default_value("./entrypoint/shooter-entrypoint"),
+		 "shooter-entrypoint executable")
+		("config,c",
+		 opts::value<std::string>(&configPath)->default_value("./config.json"),
+		 "server config (JSON map) the rooms run")
+		("map,m",
+		 opts::value<std::string>(&mapPath),
+		 "compiled map the rooms run, used instead of config")
+		("base-port",
+		 opts::value<int32_t>(&basePort)->default_value(42000),
+		 "entry point port, game servers take the ones after it")
+		("redis-port",
+		 opts::value<uint16_t>(&redisPort)->default_value(16379),
+		 "port of the redis stand-in")
+		("log-dir",
+		 opts::value<std::string>(&logDir)->default_value("./soak-logs"),
+		 "where the servers' output goes")
+		("report,r",
+		 opts::value<std::string>(&reportPath),
+		 "also write the report to this file as JSON")
+		("ramp-ms",
+		 opts::value<int32_t>(&rampMs)->default_value(50),
+		 "delay between bot starts")
+		("speed",
+		 opts::value<float>(&fleetOptions.Speed)->default_value(150.0F),
+		 "bots' velocity, units per second")
+		("turn-ms",
+		 opts::value<int32_t>(&turnMs)->default_value(1000),
+		 "how often bots change direction")
+		("shot-ms",
+		 opts::value<int32_t>(&shotMs)->default_value(500),
+		 "how often bots shoot")
+		("correction-threshold",
+		 opts::value<float>(&fleetOptions.CorrectionThreshold)
+			 ->default_value(5.0F),
+		 "distance an own position may be off before it counts as a "
+		 "correction");
+    // clang-format on
+
+    opts::variables_map vm;
+    try
+    {
+        opts::store(opts::parse_command_line(argc, argv, optsDescription), vm);
+        opts::notify(vm);
+    }
+    catch (const opts::error& e)
+    {
+        std::cout << optsDescription << std::endl;
+        std::cout << e.what() << std::endl;
+        return 0;
+    }
+
+    if (vm.count("help"))
+    {
+        std::cout << optsDescription << std::endl;
+        return 0;
+    }
+
+    auto impairment{ smp::soak::FindImpairmentProfile(profileName) };
+    if (!impairment.has_value())
+    {
+        std::cerr << "Unknown profile " << profileName << '\n';
+        return 1;
+    }
+    if (vm.count("lag-ms"))
+    {
+        impairment->LagMs = vm["lag-ms"].as<int32_t>();
+    }
+    if (vm.count("loss"))
+    {
+        impairment->LossPercent = vm["loss"].as<float>();
+    }
+    if (vm.count("reorder"))
+    {
+        impairment->ReorderPercent = vm["reorder"].as<float>();
+    }
+    if (vm.count("reorder-ms"))
+    {
+        impairment->ReorderMs = vm["reorder-ms"].as<int32_t>();
+    }
+    if (vm.count("duplicate"))
+    {
+        impairment->DuplicatePercent = vm["duplicate"].as<float>();
+    }
+
+    SteamDatagramErrMsg errMsg;
+    if (!GameNetworkingSockets_Init(nullptr, errMsg))
+    {
+        std::cerr << "GameNetworkingSockets_Init failed.  " << errMsg << '\n';
+        return 1;
+    }
+    smp::network::InstallDebugOutput(
+        k_ESteamNetworkingSocketsDebugOutputType_Warning);
+    smp::soak::ApplyImpairment(*impairment);
+
+    std::atomic<bool> alive{ true };
+    ShutdownHandler = [&alive](int) { alive = false; };
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
+
+    std::optional<smp::soak::RedisStandIn> redis;
+    try
+    {
+        redis.emplace(redisPort);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    std::filesystem::create_directories(logDir);
+    // rooms and entry point refuse to start without a shared secret, the
+    // children inherit a fresh one unless the caller brought their own
+    setenv("SMP_RESERVATION_SECRET",
+           std::to_string(std::random_device{}()).c_str(), 0);
+
+    std::vector<ServerSamples> servers(static_cast<std::size_t>(serverCount));
+    std::vector<Process*> processes;
+    for (int32_t idx{ 0 }; idx < serverCount; idx++)
+    {
+        auto name{ "soak-" + std::to_string(idx + 1) };
+        std::vector<std::string> args{
+            "--name",       name,
+            "--port",       std::to_string(basePort + idx + 1),
+            "--redis-port", std::to_string(redisPort),
+        };
+        if (!mapPath.empty())
+        {
+            args.insert(args.end(), { "--map", mapPath });
+        }
+        else
+        {
+            args.insert(args.end(), { "--config", configPath });
+        }
+        servers[idx].Child = Spawn(name, serverBinary, args, logDir);
+        processes.push_back(&servers[idx].Child);
+    }
+
+    // entry point only assigns rooms it has heard from
+    std::cout << "Waiting for " << serverCount << " rooms\n";
+    auto readyDeadline{ std::chrono::steady_clock::now() +
+                        std::chrono::seconds{ 15 } };
+    auto roomsReady{ [&]()
+                     {
+                         for (const auto& server : servers)
+                         {
+                             if (!redis->Get(smp::discovery::HeartbeatKey(
+                                     server.Child.Name)))
+                             {
+                                 return false;
+                             }
+                         }
+                         return true;
+                     } };
+    while (alive && !roomsReady())
+    {
+        if (std::chrono::steady_clock::now() >= readyDeadline)
+        {
+            std::cerr << "Rooms did not come up, see " << logDir << '\n';
+            Terminate(processes);
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 100 });
+    }
+
+    auto entry{ Spawn("entry", entryBinary,
+                      { "--port", std::to_string(basePort), "--redis-port",
+                        std::to_string(redisPort), "--placement", "spread" },
+                      logDir) };
+    processes.push_back(&entry);
+    // its first snapshot of the rooms
+    std::this_thread::sleep_for(std::chrono::seconds{ 1 });
+
+    fleetOptions.EntryAddress = "127.0.0.1:" + std::to_string(basePort);
+    fleetOptions.RampInterval = std::chrono::milliseconds{ rampMs };
+    fleetOptions.TurnInterval = std::chrono::milliseconds{ turnMs };
+    fleetOptions.ShotInterval = std::chrono::milliseconds{ shotMs };
+    std::optional<smp::soak::BotFleet> fleet{ std::in_place, fleetOptions };
+
+    std::cout << "Soaking " << fleetOptions.BotCount << " bots on "
+              << serverCount << " rooms for " << durationSeconds
+              << "s, profile " << profileName << '\n';
+    auto start{ std::chrono::steady_clock::now() };
+    auto end{ start + std::chrono::seconds{ durationSeconds } };
+    auto nextSample{ start + std::chrono::seconds{ 1 } };
+    while (alive && std::chrono::steady_clock::now() < end)
+    {
+        fleet->Poll();
+
+        auto now{ std::chrono::steady_clock::now() };
+        if (now >= nextSample)
+        {
+            fleet->SampleConnections();
+            for (auto& server : servers)
+            {
+                SampleHeartbeat(*redis, server);
+                if (!server.Child.Exited && Reap(server.Child))
+                {
+                    std::cerr << server.Child.Name << " exited with "
+                              << server.Child.Status << '\n';
+                }
+            }
+            nextSample += std::chrono::seconds{ 1 };
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+
+    nlohmann::json report = {
+        { "profile", profileName },
+        { "impairment", smp::soak::ImpairmentToJson(*impairment) },
+        { "duration_s", std::chrono::duration<double>{
+                            std::chrono::steady_clock::now() - start }
+                            .count() },
+        { "bots", fleet->GetReport() },
+        { "servers", nlohmann::json::array() },
+    };
+    for (const auto& server : servers)
+    {
+        report["servers"].push_back(ServerReport(server));
+    }
+
+    fleet.reset();
+    Terminate(processes);
+    GameNetworkingSockets_Kill();
+
+    PrintReport(report);
+    if (!reportPath.empty())
+    {
+        std::ofstream reportFile{ reportPath };
+        reportFile << report.dump(2) << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "LatencyTrace.hpp"
+#include <iostream>
+#include <string_view>
+
+using nlohmann::json;
+
+static auto Check(bool condition, const char* what) -> bool
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+    }
+    return condition;
+}
+
+// payload as the room's network thread sees it, parsed from the wire
+static auto Payload(std::string_view message) -> json
+{
+    return json::parse(message)["payload"];
+}
+
+static auto TimeSyncRejectsMalformedPayloads() -> bool
+{
+    using smp::trace::ParseTimeSyncRequest;
+
+    auto ok{ Check(
+        ParseTimeSyncRequest(Payload(R"({"type":"time_sync","payload":[]})")) ==
+            std::nullopt,
+        "array payload is dropped") };
+    ok &= Check(ParseTimeSyncRequest(Payload(
+                    R"({"type":"time_sync","payload":"c"})")) == std::nullopt,
+                "string payload is dropped");
+    ok &= Check(ParseTimeSyncRequest(Payload(
+                    R"({"type":"time_sync","payload":{}})")) == std::nullopt,
+                "payload without c is dropped");
+    ok &= Check(ParseTimeSyncRequest(Payload(
+                    R"({"type":"time_sync","payload":{"c":-5}})")) ==
+                    std::nullopt,
+                "negative c is dropped");
+    ok &= Check(ParseTimeSyncRequest(Payload(
+                    R"({"type":"time_sync","payload":{"c":"12"}})")) ==
+                    std::nullopt,
+                "string c is dropped");
+    ok &= Check(ParseTimeSyncRequest(Payload(
+                    R"({"type":"time_sync","payload":{"c":1234}})")) == 1234U,
+                "valid request is answered");
+    return ok;
+}
+
+static auto TraceKeepsOnlyRelayedFields() -> bool
+{
+    using smp::trace::SanitizeTrace;
+
+    auto sanitized{ SanitizeTrace(
+        json{ { "c_send", 10 }, { "s_recv", 20 }, { "junk", "x" } }) };
+    auto ok{ Check(sanitized.has_value(), "valid trace is kept") };
+    ok &= Check(sanitized.has_value() &&
+                    *sanitized == json{ { "c_send", 10 }, { "s_recv", 20 } },
+                "unknown fields are stripped");
+
+    ok &= Check(!SanitizeTrace(json::array()).has_value(),
+                "array trace is dropped");
+    ok &= Check(!SanitizeTrace(json{ { "s_recv", 20 } }).has_value(),
+                "trace without c_send is dropped");
+    ok &= Check(!SanitizeTrace(json{ { "c_send", "10" }, { "s_recv", 20 } })
+                     .has_value(),
+                "string c_send is dropped");
+    ok &= Check(!SanitizeTrace(json{ { "c_send", 10 }, { "s_recv", 2.5 } })
+                     .has_value(),
+                "fractional s_recv is dropped");
+    return ok;
+}
+
+auto main() -> int
+{
+    auto ok{ true };
+    ok &= TimeSyncRejectsMalformedPayloads();
+    ok &= TraceKeepsOnlyRelayedFields();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "Placement.hpp"
+#include <array>
+#include <iostream>
+
+using smp::server::PlacementEngine;
+using smp::server::RoomLoad;
+
+static auto Check(bool condition, const char* what) -> bool
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+    }
+    return condition;
+}
+
+// a burst of joins between two discovery updates must not all land on the
+// room that was fullest when the burst started
+static auto BurstSpreadsOverFilledRooms() -> bool
+{
+    std::array<std::string, 3> names{ "a", "b", "c" };
+    std::array<RoomLoad, 3> loads{
+        RoomLoad{ .Host = "h1", .PlayerCount = 8, .Capacity = 16 },
+        RoomLoad{ .Host = "h2", .PlayerCount = 6, .Capacity = 16 },
+        RoomLoad{ .Host = "h3", .PlayerCount = 0, .Capacity = 16 },
+    };
+
+    std::vector<std::pair<const std::string*, const RoomLoad*>> rooms;
+    for (std::size_t i{ 0 }; i < names.size(); i++)
+    {
+        rooms.emplace_back(&names[i], &loads[i]);
+    }
+
+    PlacementEngine engine;
+    engine.Update(rooms);
+
+    constexpr int burst{ 8 };
+    std::array<int, 3> placed{};
+    auto now{ PlacementEngine::Clock::now() };
+    for (int i{ 0 }; i < burst; i++)
+    {
+        auto room{ engine.Place(now) };
+        if (!Check(room.has_value(), "every join gets a room"))
+        {
+            return false;
+        }
+        placed[*room]++;
+    }
+
+    auto ok{ true };
+    ok &= Check(placed[0] < burst, "burst does not all go to one room");
+    ok &= Check(placed[1] > 0, "second fullest room takes part of burst");
+    ok &= Check(placed[2] == 0, "empty room stays empty");
+    return ok;
+}
+
+// joins that arrived reset the window, so the fullest room wins again
+static auto WindowResetsOnUpdate() -> bool
+{
+    std::string name{ "a" };
+    std::string otherName{ "b" };
+    RoomLoad load{ .Host = "h1", .PlayerCount = 8, .Capacity = 16 };
+    RoomLoad other{ .Host = "h2", .PlayerCount = 7, .Capacity = 16 };
+
+    PlacementEngine engine;
+    engine.Update({ { &name, &load }, { &otherName, &other } });
+
+    auto now{ PlacementEngine::Clock::now() };
+    auto ok{ Check(engine.Place(now) == 0, "fullest room first") };
+    // a tie goes to the first room, the third join has to move on
+    ok &= Check(engine.Place(now) == 0, "tie keeps the first room");
+    ok &= Check(engine.Place(now) == 1, "burst moves to next room");
+
+    load.PlayerCount = 10;
+    load.Revision++;
+    other.PlayerCount = 8;
+    other.Revision++;
+    engine.Update({ { &name, &load }, { &otherName, &other } });
+    ok &= Check(engine.Place(now) == 0, "fullest room again after update");
+    return ok;
+}
+
+auto main() -> int
+{
+    auto ok{ true };
+    ok &= BurstSpreadsOverFilledRooms();
+    ok &= WindowResetsOnUpdate();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include "ReservationToken.hpp"
+#include <array>
+#include <iostream>
+
+using smp::discovery::Reservation;
+using smp::discovery::ReservationKey;
+using smp::discovery::TokenPurpose;
+
+static auto Check(bool condition, const char* what) -> bool
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+    }
+    return condition;
+}
+
+static constexpr ReservationKey s_Key{ 0x1111, 0x2222 };
+
+// whatever a client presents, only a fresh token signed for this room and
+// this purpose gets through
+static auto VerifyRejectsForeignTokens() -> bool
+{
+    auto now{ std::chrono::system_clock::now() };
+    Reservation fresh{ 0xabc, now + std::chrono::seconds{ 10 } };
+    Reservation expired{ 0xabc, now - std::chrono::seconds{ 1 } };
+
+    auto join{ SignReservation(fresh, TokenPurpose::Join, "room", s_Key) };
+    auto resume{ SignReservation(fresh, TokenPurpose::Resume, "room", s_Key) };
+    auto stale{ SignReservation(expired, TokenPurpose::Join, "room", s_Key) };
+    auto forged{ SignReservation(fresh, TokenPurpose::Join, "room",
+                                 ReservationKey{ 0x1111, 0x2223 }) };
+    auto tampered{ join };
+    tampered.back() = tampered.back() == '0' ? '1' : '0';
+
+    struct Case
+    {
+        const char* What;
+        std::string Token;
+        TokenPurpose Purpose;
+        std::string Room;
+        bool Accepted;
+    };
+    std::array cases{
+        Case{ "valid join token is accepted", join, TokenPurpose::Join,
+              "room", true },
+        Case{ "valid resume token is accepted", resume, TokenPurpose::Resume,
+              "room", true },
+        Case{ "join token can't resume", join, TokenPurpose::Resume, "room",
+              false },
+        Case{ "resume token can't join", resume, TokenPurpose::Join, "room",
+              false },
+        Case{ "token of another room is rejected", join, TokenPurpose::Join,
+              "other", false },
+        Case{ "expired token is rejected", stale, TokenPurpose::Join, "room",
+              false },
+        Case{ "token of another secret is rejected", forged,
+              TokenPurpose::Join, "room", false },
+        Case{ "tampered mac is rejected", tampered, TokenPurpose::Join,
+              "room", false },
+        Case{ "empty token is rejected", "", TokenPurpose::Join, "room",
+              false },
+        Case{ "token without dots is rejected", "abc", TokenPurpose::Join,
+              "room", false },
+        Case{ "token without mac is rejected", "abc.1.", TokenPurpose::Join,
+              "room", false },
+        Case{ "non-hex slot is rejected", "xyz.1.1", TokenPurpose::Join,
+              "room", false },
+    };
+
+    auto ok{ true };
+    for (const auto& testCase : cases)
+    {
+        auto verified{ VerifyReservation(testCase.Token, testCase.Purpose,
+                                         testCase.Room, s_Key) };
+        ok &= Check(verified.has_value() == testCase.Accepted, testCase.What);
+    }
+
+    auto verified{ VerifyReservation(join, TokenPurpose::Join, "room",
+                                     s_Key) };
+    ok &= Check(verified.has_value() && verified->SlotId == fresh.SlotId,
+                "slot id survives the round trip");
+    return ok;
+}
+
+auto main() -> int
+{
+    auto ok{ true };
+    ok &= VerifyRejectsForeignTokens();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include "RoomState.hpp"
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using smp::server::RoomState;
+namespace roomformat = smp::server::roomformat;
+
+static auto Check(bool condition, const char* what) -> bool
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+    }
+    return condition;
+}
+
+static constexpr smp::discovery::ReservationKey s_Key{ 0x1111, 0x2222 };
+static constexpr std::string_view s_Target{ "10.0.0.2:27020" };
+
+static auto SampleState() -> RoomState
+{
+    RoomState state;
+    state.Name = "room";
+    state.Tick = 42;
+    state.CapturedAtMs = 1000;
+    state.Map = { std::byte{ 1 }, std::byte{ 2 }, std::byte{ 3 } };
+    state.Players.push_back({ 7, { 1.F, 2.F }, { 0.F, 1.F } });
+    state.Bullets.push_back({ 3, 7, { 4.F, 5.F }, { 1.F, 0.F } });
+    return state;
+}
+
+// header field overwritten in place, the rest of the data stays as it is
+static auto WithHeaderField(std::string data, std::size_t offset,
+                            uint32_t value) -> std::string
+{
+    std::memcpy(data.data() + offset, &value, sizeof(value));
+    return data;
+}
+
+enum class Outcome
+{
+    Accepted,
+    Rejected,
+    Throws
+};
+
+static auto Deserialize(std::string_view data) -> Outcome
+{
+    try
+    {
+        static_cast<void>(smp::server::DeserializeRoomState(data));
+        return Outcome::Accepted;
+    }
+    catch (const std::runtime_error&)
+    {
+        return Outcome::Throws;
+    }
+}
+static auto Verify(std::string_view data, std::string_view target)
+    -> Outcome
+{
+    try
+    {
+        return smp::server::VerifyRoomState(data, target, s_Key).has_value()
+                   ? Outcome::Accepted
+                   : Outcome::Rejected;
+    }
+    catch (const std::runtime_error&)
+    {
+        return Outcome::Throws;
+    }
+}
+
+// sizes in the header are never trusted, nothing is allocated for more
+// than the data holds
+static auto DeserializeRejectsMalformedStates() -> bool
+{
+    auto valid{ smp::server::SerializeRoomState(SampleState()) };
+
+    struct Case
+    {
+        const char* What;
+        std::string Data;
+        Outcome Expected;
+    };
+    std::array cases{
+        Case{ "valid state is read", valid, Outcome::Accepted },
+        Case{ "empty data throws", "", Outcome::Throws },
+        Case{ "truncated header throws",
+              valid.substr(0, sizeof(roomformat::Header) - 1),
+              Outcome::Throws },
+        Case{ "truncated bullets throw", valid.substr(0, valid.size() - 1),
+              Outcome::Throws },
+        Case{ "trailing bytes throw", valid + '\0', Outcome::Throws },
+        Case{ "wrong magic throws",
+              WithHeaderField(valid, offsetof(roomformat::Header, Magic), 0),
+              Outcome::Throws },
+        Case{ "unknown version throws",
+              WithHeaderField(valid, offsetof(roomformat::Header, Version),
+                              roomformat::Version + 1),
+              Outcome::Throws },
+        Case{ "oversized name throws",
+              WithHeaderField(valid,
+                              offsetof(roomformat::Header, NameLength),
+                              0xFFFFFFFF),
+              Outcome::Throws },
+        Case{ "oversized map throws",
+              WithHeaderField(valid, offsetof(roomformat::Header, MapSize),
+                              0xFFFFFFFF),
+              Outcome::Throws },
+        Case{ "oversized player count throws",
+              WithHeaderField(valid,
+                              offsetof(roomformat::Header, PlayerCount),
+                              0xFFFFFFFF),
+              Outcome::Throws },
+        Case{ "oversized bullet count throws",
+              WithHeaderField(valid,
+                              offsetof(roomformat::Header, BulletCount),
+                              0xFFFFFFFF),
+              Outcome::Throws },
+    };
+
+    auto ok{ true };
+    for (const auto& testCase : cases)
+    {
+        ok &= Check(Deserialize(testCase.Data) == testCase.Expected,
+                    testCase.What);
+    }
+
+    auto state{ smp::server::DeserializeRoomState(valid) };
+    ok &= Check(state.Name == "room" && state.Tick == 42 &&
+                    state.Map.size() == 3 && state.Players.size() == 1 &&
+                    state.Bullets.size() == 1 &&
+                    state.Bullets.front().ShooterId == 7,
+                "state survives the round trip");
+    return ok;
+}
+
+// a standby only takes a fresh state signed for its own address
+static auto VerifyRejectsForeignStates() -> bool
+{
+    auto now{ std::chrono::system_clock::now() };
+    auto valid{ smp::server::SignRoomState(
+        SampleState(), s_Target, now + std::chrono::seconds{ 2 }, s_Key) };
+    auto expired{ smp::server::SignRoomState(
+        SampleState(), s_Target, now - std::chrono::seconds{ 1 }, s_Key) };
+    auto forged{ smp::server::SignRoomState(
+        SampleState(), s_Target, now + std::chrono::seconds{ 2 },
+        smp::discovery::ReservationKey{ 0x1111, 0x2223 }) };
+    auto tamperedMac{ valid };
+    tamperedMac.front() ^= 0x01;
+    auto tamperedState{ valid };
+    tamperedState.back() ^= 0x01;
+
+    struct Case
+    {
+        const char* What;
+        std::string Data;
+        std::string_view Target;
+        Outcome Expected;
+    };
+    std::array cases{
+        Case{ "valid state is taken", valid, s_Target, Outcome::Accepted },
+        Case{ "state for another standby is rejected", valid,
+              "10.0.0.3:27020", Outcome::Rejected },
+        Case{ "expired state is rejected", expired, s_Target,
+              Outcome::Rejected },
+        Case{ "state of another secret is rejected", forged, s_Target,
+              Outcome::Rejected },
+        Case{ "tampered mac is rejected", tamperedMac, s_Target,
+              Outcome::Rejected },
+        Case{ "tampered state is rejected", tamperedState, s_Target,
+              Outcome::Rejected },
+        Case{ "empty data is rejected", "", s_Target, Outcome::Rejected },
+        Case{ "data shorter than mac and expiry is rejected",
+              valid.substr(0, 15), s_Target, Outcome::Rejected },
+        Case{ "truncated state is rejected",
+              valid.substr(0, valid.size() - 1), s_Target,
+              Outcome::Rejected },
+        Case{ "oversized state is rejected", valid + '\0', s_Target,
+              Outcome::Rejected },
+    };
+
+    auto ok{ true };
+    for (const auto& testCase : cases)
+    {
+        ok &= Check(Verify(testCase.Data, testCase.Target) ==
+                        testCase.Expected,
+                    testCase.What);
+    }
+    return ok;
+}
+
+auto main() -> int
+{
+    auto ok{ true };
+    ok &= DeserializeRejectsMalformedStates();
+    ok &= VerifyRejectsForeignStates();
+    return ok ? 0 : 1;
+}